@@ -0,0 +1,131 @@
+/*
+ * Benchmark suite: CPU per opcode and addressing mode, PPU lines, bus
+ * dispatch, observations, ROM loading, whole frames and state restores.
+ * Results are written as JSON and can be compared with a baseline to catch
+ * regressions.
+ */
+
+#include "harness.h"
+#include "common.h"
+#include "log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]                        run the benchmarks\n"
+            "       %s -c <baseline.json> <current.json>  compare results\n"
+            "Options:\n"
+            "  -o <file>      Write results as JSON to <file> ('-' for the standard output)\n"
+            "  -f <text>      Only run benchmarks with <text> in the name, e.g. cpu.mode\n"
+            "  -t <ms>        Minimum duration of a timed run (default: 100)\n"
+            "  -r <runs>      Timed runs per benchmark, the median is reported (default: 5)\n"
+            "  -g <file>      Also time whole frames of the NES ROM <file>\n"
+            "  -b <file>      Compare the results with the baseline <file>\n"
+            "  -T <percent>   Slowdown reported as a regression (default: 10)\n"
+            "Exit status is 3 if a comparison finds regressions.\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    BenchSuite::Options opts;
+    const char *outFile = nullptr,
+               *baselineFile = nullptr,
+               *romFile = "";
+    double threshold = 10.0;
+    bool compareOnly = false;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "-o") == 0 && hasValue)
+            outFile = argv[++i];
+        else if (strcmp(arg, "-f") == 0 && hasValue)
+            opts.filter = argv[++i];
+        else if (strcmp(arg, "-t") == 0 && hasValue)
+            opts.minRunMs = atof(argv[++i]);
+        else if (strcmp(arg, "-r") == 0 && hasValue)
+            opts.runs = atoi(argv[++i]);
+        else if (strcmp(arg, "-g") == 0 && hasValue)
+            romFile = argv[++i];
+        else if (strcmp(arg, "-b") == 0 && hasValue)
+            baselineFile = argv[++i];
+        else if (strcmp(arg, "-T") == 0 && hasValue)
+            threshold = atof(argv[++i]);
+        else if (strcmp(arg, "-c") == 0)
+            compareOnly = true;
+        else if (arg[0] != '-')
+            files.push_back(arg);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((compareOnly ? files.size() != 2 : !files.empty()) || opts.minRunMs <= 0.0 || opts.runs <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        if (compareOnly)
+            return compareResults(readJSON(files[0]), readJSON(files[1]), threshold, stdout) > 0 ? 3 : 0;
+
+        // Read first: a missing baseline shouldn't waste a whole run
+        std::vector<BenchResult> baseline;
+        if (baselineFile)
+        {
+            // Benchmarks left out by the filter aren't missing
+            for (const BenchResult &r: readJSON(baselineFile))
+                if (r.name.find(opts.filter) != std::string::npos)
+                    baseline.push_back(r);
+        }
+
+        Log::instance().config().filter = Log::LEVEL_SILENT;
+
+        BenchSuite suite { opts };
+        addCPUBenchmarks(suite);
+        addPPUBenchmarks(suite);
+        addBusBenchmarks(suite);
+        addObserverBenchmarks(suite);
+        addMachineBenchmarks(suite, romFile);
+
+        // Progress goes to stderr when the JSON goes to stdout
+        const bool jsonToStdout = outFile && strcmp(outFile, "-") == 0;
+        const std::vector<BenchResult> results = suite.run(jsonToStdout ? stderr : stdout);
+        if (results.empty())
+        {
+            fprintf(stderr, "Error: no benchmark matches the filter\n");
+            return 1;
+        }
+
+        if (outFile)
+        {
+            FILE *out = jsonToStdout ? stdout : fopen(outFile, "w");
+            if (!out)
+                throw Exception(Exception::IOFailure, "unable to create the results file");
+            writeJSON(out, results, opts);
+            if (out != stdout)
+                fclose(out);
+        }
+
+        if (baselineFile)
+            return compareResults(baseline, results, threshold, jsonToStdout ? stderr : stdout) > 0 ? 3 : 0;
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Bus::readMem() and Bus::writeMem() dispatch, per region of the CPU
+ * address space.
+ */
+
+#include "harness.h"
+#include "machine.h"
+
+#include <memory>
+#include <sstream>
+
+namespace
+{
+
+struct Region
+{
+    const char *name;
+    c6502_word_t base,
+                 mask;      // Addresses touched: base + (i & mask)
+    bool write;
+};
+
+const Region REGIONS[] = {
+    { "ram", 0x0000u, 0x07FFu, false },
+    { "ram-mirror", 0x0800u, 0x07FFu, false },
+    { "ppu", 0x2002u, 0x0000u, false },         // Status register
+    { "apu", 0x4000u, 0x000Fu, false },
+    { "pad", 0x4016u, 0x0000u, false },
+    { "wram", 0x6000u, 0x1FFFu, false },
+    { "rom", 0x8000u, 0x7FFFu, false },
+    { "ram", 0x0000u, 0x07FFu, true },
+    { "ppu", 0x2003u, 0x0000u, true },          // Sprite memory address
+    { "pad", 0x4016u, 0x0000u, true },
+    { "wram", 0x6000u, 0x1FFFu, true }          // ROM writes go to mapper registers
+};
+
+}
+
+void addBusBenchmarks(BenchSuite &suite)
+{
+    for (const Region &r: REGIONS)
+    {
+        suite.add(std::string(r.write ? "bus.write." : "bus.read.") + r.name, "access", [r]() {
+            std::shared_ptr<Machine> m { new Machine { OutputMode::NTSC } };
+            std::string rom(0x8000, '\0');
+            rom[0x7FFD] = static_cast<char>(0x80);
+            std::istringstream in(rom);
+            m->loadRawData(in);
+
+            if (r.write)
+                return BenchSuite::Body([m, r](uint64_t n) {
+                    Bus &bus = m->bus();
+                    for (uint64_t i = 0; i < n; i++)
+                        bus.writeMem(r.base + (i & r.mask), static_cast<c6502_byte_t>(i & 1u));
+                });
+
+            return BenchSuite::Body([m, r](uint64_t n) {
+                Bus &bus = m->bus();
+                uint32_t sum = 0;
+                for (uint64_t i = 0; i < n; i++)
+                    sum += bus.readMem(r.base + (i & r.mask));
+                benchSink(sum);
+            });
+        });
+    }
+}
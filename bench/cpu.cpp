@@ -0,0 +1,250 @@
+/*
+ * CPU throughput per opcode and per addressing mode. Every benchmark runs
+ * a synthetic program: a block of the same instruction (or of a pair that
+ * keeps the stack balanced) repeated, ending with a jump back, loaded as
+ * raw data. Operands point to internal RAM, which is zeroed at power on,
+ * so indirect modes read their pointers from there.
+ */
+
+#include "harness.h"
+#include "machine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+
+namespace
+{
+
+constexpr c6502_word_t PROGRAM = 0x8000u,
+                       PROGRAM_END = 0xE000u,   // Pointer table of JMP (ind) follows
+                       POINTERS = 0xE000u,
+                       SUBROUTINE = 0xF000u,    // RTS
+                       HANDLER = 0xF001u;       // RTI, for IRQ/BRK and NMI
+constexpr int BLOCK = 2048;
+
+struct Op
+{
+    const char *name,
+               *mode;
+    c6502_byte_t opcode;
+};
+
+// Instructions that don't change the control flow, and branches (REL)
+// with offset 0, which continue with the next instruction either way
+const Op OPS[] = {
+    { "ADC", "IMM", 0x69 }, { "ADC", "ZP", 0x65 }, { "ADC", "ZP_X", 0x75 }, { "ADC", "ABS", 0x6D },
+    { "ADC", "ABS_X", 0x7D }, { "ADC", "ABS_Y", 0x79 }, { "ADC", "IND_X", 0x61 }, { "ADC", "IND_Y", 0x71 },
+    { "AND", "IMM", 0x29 }, { "AND", "ZP", 0x25 }, { "AND", "ZP_X", 0x35 }, { "AND", "ABS", 0x2D },
+    { "AND", "ABS_X", 0x3D }, { "AND", "ABS_Y", 0x39 }, { "AND", "IND_X", 0x21 }, { "AND", "IND_Y", 0x31 },
+    { "ASL", "ACC", 0x0A }, { "ASL", "ZP", 0x06 }, { "ASL", "ZP_X", 0x16 }, { "ASL", "ABS", 0x0E },
+    { "ASL", "ABS_X", 0x1E },
+    { "BCC", "REL", 0x90 }, { "BCS", "REL", 0xB0 }, { "BEQ", "REL", 0xF0 }, { "BMI", "REL", 0x30 },
+    { "BNE", "REL", 0xD0 }, { "BPL", "REL", 0x10 }, { "BVC", "REL", 0x50 }, { "BVS", "REL", 0x70 },
+    { "BIT", "ZP", 0x24 }, { "BIT", "ABS", 0x2C },
+    { "CLC", "IMP", 0x18 }, { "CLD", "IMP", 0xD8 }, { "CLI", "IMP", 0x58 }, { "CLV", "IMP", 0xB8 },
+    { "CMP", "IMM", 0xC9 }, { "CMP", "ZP", 0xC5 }, { "CMP", "ZP_X", 0xD5 }, { "CMP", "ABS", 0xCD },
+    { "CMP", "ABS_X", 0xDD }, { "CMP", "ABS_Y", 0xD9 }, { "CMP", "IND_X", 0xC1 }, { "CMP", "IND_Y", 0xD1 },
+    { "CPX", "IMM", 0xE0 }, { "CPX", "ZP", 0xE4 }, { "CPX", "ABS", 0xEC },
+    { "CPY", "IMM", 0xC0 }, { "CPY", "ZP", 0xC4 }, { "CPY", "ABS", 0xCC },
+    { "DEC", "ZP", 0xC6 }, { "DEC", "ZP_X", 0xD6 }, { "DEC", "ABS", 0xCE }, { "DEC", "ABS_X", 0xDE },
+    { "DEX", "IMP", 0xCA }, { "DEY", "IMP", 0x88 },
+    { "EOR", "IMM", 0x49 }, { "EOR", "ZP", 0x45 }, { "EOR", "ZP_X", 0x55 }, { "EOR", "ABS", 0x4D },
+    { "EOR", "ABS_X", 0x5D }, { "EOR", "ABS_Y", 0x59 }, { "EOR", "IND_X", 0x41 }, { "EOR", "IND_Y", 0x51 },
+    { "INC", "ZP", 0xE6 }, { "INC", "ZP_X", 0xF6 }, { "INC", "ABS", 0xEE }, { "INC", "ABS_X", 0xFE },
+    { "INX", "IMP", 0xE8 }, { "INY", "IMP", 0xC8 },
+    { "LDA", "IMM", 0xA9 }, { "LDA", "ZP", 0xA5 }, { "LDA", "ZP_X", 0xB5 }, { "LDA", "ABS", 0xAD },
+    { "LDA", "ABS_X", 0xBD }, { "LDA", "ABS_Y", 0xB9 }, { "LDA", "IND_X", 0xA1 }, { "LDA", "IND_Y", 0xB1 },
+    { "LDX", "IMM", 0xA2 }, { "LDX", "ZP", 0xA6 }, { "LDX", "ZP_Y", 0xB6 }, { "LDX", "ABS", 0xAE },
+    { "LDX", "ABS_Y", 0xBE },
+    { "LDY", "IMM", 0xA0 }, { "LDY", "ZP", 0xA4 }, { "LDY", "ZP_X", 0xB4 }, { "LDY", "ABS", 0xAC },
+    { "LDY", "ABS_X", 0xBC },
+    { "LSR", "ACC", 0x4A }, { "LSR", "ZP", 0x46 }, { "LSR", "ZP_X", 0x56 }, { "LSR", "ABS", 0x4E },
+    { "LSR", "ABS_X", 0x5E },
+    { "NOP", "IMP", 0xEA },
+    { "ORA", "IMM", 0x09 }, { "ORA", "ZP", 0x05 }, { "ORA", "ZP_X", 0x15 }, { "ORA", "ABS", 0x0D },
+    { "ORA", "ABS_X", 0x1D }, { "ORA", "ABS_Y", 0x19 }, { "ORA", "IND_X", 0x01 }, { "ORA", "IND_Y", 0x11 },
+    { "ROL", "ACC", 0x2A }, { "ROL", "ZP", 0x26 }, { "ROL", "ZP_X", 0x36 }, { "ROL", "ABS", 0x2E },
+    { "ROL", "ABS_X", 0x3E },
+    { "ROR", "ACC", 0x6A }, { "ROR", "ZP", 0x66 }, { "ROR", "ZP_X", 0x76 }, { "ROR", "ABS", 0x6E },
+    { "ROR", "ABS_X", 0x7E },
+    { "SBC", "IMM", 0xE9 }, { "SBC", "ZP", 0xE5 }, { "SBC", "ZP_X", 0xF5 }, { "SBC", "ABS", 0xED },
+    { "SBC", "ABS_X", 0xFD }, { "SBC", "ABS_Y", 0xF9 }, { "SBC", "IND_X", 0xE1 }, { "SBC", "IND_Y", 0xF1 },
+    { "SEC", "IMP", 0x38 }, { "SED", "IMP", 0xF8 }, { "SEI", "IMP", 0x78 },
+    { "STA", "ZP", 0x85 }, { "STA", "ZP_X", 0x95 }, { "STA", "ABS", 0x8D }, { "STA", "ABS_X", 0x9D },
+    { "STA", "ABS_Y", 0x99 }, { "STA", "IND_X", 0x81 }, { "STA", "IND_Y", 0x91 },
+    { "STX", "ZP", 0x86 }, { "STX", "ZP_Y", 0x96 }, { "STX", "ABS", 0x8E },
+    { "STY", "ZP", 0x84 }, { "STY", "ZP_X", 0x94 }, { "STY", "ABS", 0x8C },
+    { "TAX", "IMP", 0xAA }, { "TAY", "IMP", 0xA8 }, { "TSX", "IMP", 0xBA }, { "TXA", "IMP", 0x8A },
+    { "TXS", "IMP", 0x9A }, { "TYA", "IMP", 0x98 }
+};
+
+// Instruction bytes of @a op with operands in RAM
+std::vector<c6502_byte_t> encode(const Op &op)
+{
+    const std::string mode = op.mode;
+    if (mode == "IMP" || mode == "ACC")
+        return { op.opcode };
+    if (mode == "REL")
+        return { op.opcode, 0x00 };
+    if (mode == "IMM")
+        return { op.opcode, 0x01 };
+    if (mode == "ZP" || mode == "ZP_X" || mode == "ZP_Y")
+        return { op.opcode, 0x10 };
+    if (mode == "IND_X" || mode == "IND_Y")
+        return { op.opcode, 0x20 };
+    return { op.opcode, 0x00, 0x03 };
+}
+
+using UnitGen = std::function<std::vector<c6502_byte_t>(int index, c6502_word_t addr)>;
+
+/*!
+ * 32K program image at PROGRAM: @a count units generated by @a unit, then
+ * JMP PROGRAM; @a pointers are stored at POINTERS. Vectors point to
+ * PROGRAM (reset) and HANDLER.
+ */
+std::string image(int count, const UnitGen &unit, const std::vector<c6502_word_t> &pointers,
+                  c6502_word_t &blockEnd)
+{
+    std::string rom(0x8000, '\0');
+    auto put = [&rom](c6502_word_t addr, c6502_byte_t v) { rom[addr - PROGRAM] = static_cast<char>(v); };
+
+    c6502_word_t addr = PROGRAM;
+    for (int i = 0; i < count; i++)
+        for (c6502_byte_t b: unit(i, addr))
+            put(addr++, b);
+    if (addr + 3 > PROGRAM_END)
+        throw Exception(Exception::SizeOverflow, "benchmark program is too long");
+    blockEnd = addr;
+
+    put(addr, 0x4C);
+    put(addr + 1, PROGRAM & 0xFFu);
+    put(addr + 2, PROGRAM >> 8);
+
+    assert(POINTERS + 2 * pointers.size() <= SUBROUTINE);
+    for (size_t i = 0; i < pointers.size(); i++)
+    {
+        put(POINTERS + 2 * i, pointers[i] & 0xFFu);
+        put(POINTERS + 2 * i + 1, pointers[i] >> 8);
+    }
+
+    put(SUBROUTINE, 0x60);
+    put(HANDLER, 0x40);
+    put(0xFFFAu, HANDLER & 0xFFu);
+    put(0xFFFBu, HANDLER >> 8);
+    put(0xFFFCu, PROGRAM & 0xFFu);
+    put(0xFFFDu, PROGRAM >> 8);
+    put(0xFFFEu, HANDLER & 0xFFu);
+    put(0xFFFFu, HANDLER >> 8);
+    return rom;
+}
+
+/*!
+ * Body running the program in @a rom; an operation is one unit of
+ * @a unitSize bytes. Cycles per unit are measured by running part of the
+ * block and counting the units passed.
+ */
+BenchSuite::Body cpuBody(const std::string &rom, c6502_word_t blockEnd, int unitSize)
+{
+    std::shared_ptr<Machine> m { new Machine { OutputMode::NTSC } };
+    std::istringstream in(rom);
+    m->loadRawData(in);
+
+    CPU6502 &cpu = m->cpu();
+    int cycles = cpu.run(2 * BLOCK - 16);
+
+    // Stopped inside a unit, e.g. in a subroutine: single instructions up
+    // to the next one, the smallest budget that fits runs exactly one
+    auto misplaced = [&cpu, blockEnd, unitSize]() {
+        const c6502_word_t pc = cpu.registerStates().pc;
+        return pc >= blockEnd || (pc - PROGRAM) % unitSize != 0;
+    };
+    for (int i = 0; i < 8 && misplaced() && cpu.state() == CPU6502::STATE_RUN; i++)
+        for (int clk = 2; clk <= 16; clk++)
+            if (const int spent = cpu.run(clk))
+            {
+                cycles += spent;
+                break;
+            }
+
+    const c6502_word_t pc = cpu.registerStates().pc;
+    if (cpu.state() != CPU6502::STATE_RUN || misplaced() || pc <= PROGRAM)
+        throw Exception(Exception::IllegalOperation, "benchmark program went astray");
+    const double cyclesPerUnit = static_cast<double>(cycles) / ((pc - PROGRAM) / unitSize);
+
+    return [m, cyclesPerUnit](uint64_t n) {
+        CPU6502 &cpu = m->cpu();
+        uint64_t left = static_cast<uint64_t>(n * cyclesPerUnit);
+        while (left > 0)
+        {
+            const int spent = cpu.run(static_cast<int>(std::min<uint64_t>(left, 1u << 24)));
+            if (cpu.state() != CPU6502::STATE_RUN)
+                throw Exception(Exception::IllegalOperation, "CPU stopped");
+            // Less left than the next instruction takes
+            if (spent == 0)
+                break;
+            left -= std::min<uint64_t>(left, spent);
+        }
+    };
+}
+
+// Benchmark of @a unit repeated, @a unitSize bytes each
+void addProgram(BenchSuite &suite, const std::string &name, const char *unit, int unitSize,
+                UnitGen gen, std::vector<c6502_word_t> pointers = { })
+{
+    suite.add(name, unit, [gen, unitSize, pointers]() {
+        c6502_word_t blockEnd;
+        const std::string rom = image(BLOCK, gen, pointers, blockEnd);
+        return cpuBody(rom, blockEnd, unitSize);
+    });
+}
+
+}
+
+void addCPUBenchmarks(BenchSuite &suite)
+{
+    std::map<std::string, std::vector<std::vector<c6502_byte_t>>> modes;
+    for (const Op &op: OPS)
+    {
+        const auto bytes = encode(op);
+        addProgram(suite, std::string("cpu.op.") + op.name + "." + op.mode, "instr", bytes.size(),
+                   [bytes](int, c6502_word_t) { return bytes; });
+        modes[op.mode].push_back(bytes);
+    }
+
+    // Control flow: jumps to the next instruction, and balanced pairs
+    addProgram(suite, "cpu.op.JMP.ABS", "instr", 3, [](int, c6502_word_t addr) {
+        const c6502_word_t next = addr + 3;
+        return std::vector<c6502_byte_t> { 0x4C, static_cast<c6502_byte_t>(next & 0xFFu),
+                                           static_cast<c6502_byte_t>(next >> 8) };
+    });
+    // Pointers are at even addresses, clear of the page wrap bug
+    std::vector<c6502_word_t> next(BLOCK);
+    for (int i = 0; i < BLOCK; i++)
+        next[i] = PROGRAM + 3 * (i + 1);
+    addProgram(suite, "cpu.op.JMP.IND", "instr", 3, [](int i, c6502_word_t) {
+        const c6502_word_t ptr = POINTERS + 2 * i;
+        return std::vector<c6502_byte_t> { 0x6C, static_cast<c6502_byte_t>(ptr & 0xFFu),
+                                           static_cast<c6502_byte_t>(ptr >> 8) };
+    }, next);
+    addProgram(suite, "cpu.pair.PHA+PLA", "pair", 2,
+               [](int, c6502_word_t) { return std::vector<c6502_byte_t> { 0x48, 0x68 }; });
+    addProgram(suite, "cpu.pair.PHP+PLP", "pair", 2,
+               [](int, c6502_word_t) { return std::vector<c6502_byte_t> { 0x08, 0x28 }; });
+    addProgram(suite, "cpu.pair.JSR+RTS", "pair", 3, [](int, c6502_word_t) {
+        return std::vector<c6502_byte_t> { 0x20, SUBROUTINE & 0xFFu, SUBROUTINE >> 8 };
+    });
+    // BRK skips a padding byte, RTI of the handler returns after it
+    addProgram(suite, "cpu.pair.BRK+RTI", "pair", 2,
+               [](int, c6502_word_t) { return std::vector<c6502_byte_t> { 0x00, 0x00 }; });
+
+    // Addressing modes: all instructions of the mode in turn
+    for (const auto &m: modes)
+    {
+        const auto ops = m.second;
+        addProgram(suite, "cpu.mode." + m.first, "instr", ops.front().size(),
+                   [ops](int i, c6502_word_t) { return ops[i % ops.size()]; });
+    }
+}
@@ -0,0 +1,202 @@
+#include "harness.h"
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+static volatile uint32_t s_sink = 0;
+
+void benchSink(uint32_t v) noexcept
+{
+    s_sink = s_sink + v;
+}
+
+void BenchSuite::add(const std::string &name, const char *unit, std::function<Body()> setup)
+{
+    m_entries.push_back({ name, unit, std::move(setup) });
+}
+
+std::vector<BenchResult> BenchSuite::run(FILE *log)
+{
+    using Clock = std::chrono::steady_clock;
+    auto timeNs = [](const Body &body, uint64_t n) {
+        const auto start = Clock::now();
+        body(n);
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    };
+
+    const double minRunNs = m_opts.minRunMs * 1e6;
+    std::vector<BenchResult> results;
+    for (const Entry &e: m_entries)
+    {
+        if (!m_opts.filter.empty() && e.name.find(m_opts.filter) == std::string::npos)
+            continue;
+
+        const Body body = e.setup();
+
+        // Grow n until a run is long enough, also warming up caches and branch predictors
+        uint64_t n = 1;
+        for (;;)
+        {
+            const double ns = timeNs(body, n);
+            if (ns >= minRunNs)
+                break;
+            const double scale = ns > 0.0 ? minRunNs / ns * 1.2 : 100.0;
+            n = static_cast<uint64_t>(n * std::min(std::max(scale, 2.0), 100.0));
+        }
+
+        std::vector<double> perOp;
+        for (int r = 0; r < m_opts.runs; r++)
+            perOp.push_back(timeNs(body, n) / n);
+        std::sort(perOp.begin(), perOp.end());
+
+        BenchResult res;
+        res.name = e.name;
+        res.unit = e.unit;
+        res.opsPerRun = n;
+        res.runs = m_opts.runs;
+        res.nsPerOp = perOp[perOp.size() / 2];
+        res.minNsPerOp = perOp.front();
+        res.spreadPct = (perOp.back() - perOp.front()) / res.nsPerOp * 100.0;
+        results.push_back(res);
+
+        if (log)
+        {
+            fprintf(log, "%-32s %12.2f ns/%-6s %6.1f%%\n",
+                    res.name.c_str(), res.nsPerOp, res.unit.c_str(), res.spreadPct);
+            fflush(log);
+        }
+    }
+
+    return results;
+}
+
+static std::string quoted(const std::string &s)
+{
+    std::string q = "\"";
+    for (char c: s)
+    {
+        if (c == '"' || c == '\\')
+            q += '\\';
+        q += c;
+    }
+    return q + '"';
+}
+
+void writeJSON(FILE *out, const std::vector<BenchResult> &results, const BenchSuite::Options &opts)
+{
+    fprintf(out, "{\n  \"suite\": \"b1bench\",\n  \"version\": 1,\n");
+    fprintf(out, "  \"min_run_ms\": %g,\n  \"runs\": %d,\n  \"results\": [\n", opts.minRunMs, opts.runs);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        fprintf(out, "    { \"name\": %s, \"unit\": %s, \"ns_per_op\": %.4f, \"min_ns_per_op\": %.4f, "
+                     "\"ops_per_sec\": %.1f, \"spread_pct\": %.2f, \"ops_per_run\": %llu }%s\n",
+                quoted(r.name).c_str(), quoted(r.unit).c_str(), r.nsPerOp, r.minNsPerOp,
+                r.nsPerOp > 0.0 ? 1e9 / r.nsPerOp : 0.0, r.spreadPct,
+                static_cast<unsigned long long>(r.opsPerRun), i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Value of "key" in a line written by writeJSON(), nullptr if absent
+static const char *findValue(const std::string &line, const char *key)
+{
+    const std::string k = std::string("\"") + key + "\":";
+    const size_t pos = line.find(k);
+    if (pos == std::string::npos)
+        return nullptr;
+
+    const char *p = line.c_str() + pos + k.size();
+    while (*p == ' ')
+        p++;
+    return p;
+}
+
+static bool stringValue(const std::string &line, const char *key, std::string &val)
+{
+    const char *p = findValue(line, key);
+    if (!p || *p != '"')
+        return false;
+
+    val.clear();
+    for (p++; *p && *p != '"'; p++)
+    {
+        if (*p == '\\' && p[1])
+            p++;
+        val += *p;
+    }
+    return *p == '"';
+}
+
+std::vector<BenchResult> readJSON(const char *file)
+{
+    std::ifstream in(file);
+    if (!in.is_open())
+        throw Exception(Exception::IOFailure, "unable to open the results file");
+
+    std::vector<BenchResult> results;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        BenchResult r;
+        if (!stringValue(line, "name", r.name))
+            continue;
+
+        stringValue(line, "unit", r.unit);
+        const char *ns = findValue(line, "ns_per_op"),
+                   *minNs = findValue(line, "min_ns_per_op");
+        if (!ns)
+            throw Exception(Exception::IOFailure, "results file has a benchmark without time");
+        r.nsPerOp = strtod(ns, nullptr);
+        r.minNsPerOp = minNs ? strtod(minNs, nullptr) : r.nsPerOp;
+        results.push_back(r);
+    }
+
+    if (results.empty())
+        throw Exception(Exception::IOFailure, "results file has no benchmarks");
+    return results;
+}
+
+int compareResults(const std::vector<BenchResult> &baseline, const std::vector<BenchResult> &current,
+                   double thresholdPct, FILE *out)
+{
+    std::map<std::string, const BenchResult*> base;
+    for (const BenchResult &r: baseline)
+        base[r.name] = &r;
+
+    fprintf(out, "%-32s %12s %12s %9s\n", "benchmark", "baseline ns", "current ns", "change");
+    int regressions = 0;
+    for (const BenchResult &r: current)
+    {
+        const auto it = base.find(r.name);
+        if (it == base.end())
+        {
+            fprintf(out, "%-32s %12s %12.2f %9s  new\n", r.name.c_str(), "-", r.nsPerOp, "");
+            continue;
+        }
+
+        const double b = it->second->nsPerOp,
+                     change = b > 0.0 ? (r.nsPerOp - b) / b * 100.0 : 0.0;
+        const char *flag = "";
+        if (change > thresholdPct)
+        {
+            flag = "  REGRESSION";
+            regressions++;
+        }
+        else if (change < -thresholdPct)
+            flag = "  faster";
+        fprintf(out, "%-32s %12.2f %12.2f %+8.1f%%%s\n", r.name.c_str(), b, r.nsPerOp, change, flag);
+        base.erase(it);
+    }
+
+    for (const auto &b: base)
+        fprintf(out, "%-32s %12.2f %12s %9s  missing\n", b.first.c_str(), b.second->nsPerOp, "-", "");
+
+    fprintf(out, "%d regression(s) above %.1f%%\n", regressions, thresholdPct);
+    return regressions;
+}
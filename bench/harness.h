@@ -0,0 +1,95 @@
+/*
+ * Timing harness of the benchmark suite
+ */
+
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchResult
+{
+    std::string name,
+                unit;               // What one operation is, e.g. "instr" or "line"
+    uint64_t opsPerRun = 0;
+    int runs = 0;
+    double nsPerOp = 0.0,           // Median of the runs
+           minNsPerOp = 0.0,
+           spreadPct = 0.0;         // (max - min) / median of the runs
+};
+
+/*!
+ * Runs registered benchmarks: each one is calibrated until a run of
+ * n operations takes at least the minimum run time, then timed for a
+ * number of runs with that n. The median is reported, being less
+ * sensitive to interruptions than the mean.
+ */
+class BenchSuite
+{
+public:
+    /// Performs @a n operations; may keep state between calls.
+    using Body = std::function<void(uint64_t n)>;
+
+    struct Options
+    {
+        double minRunMs = 100.0;
+        int runs = 5;
+        std::string filter;         // Substring of the names to run, empty for all
+    };
+
+    explicit BenchSuite(const Options &opts):
+        m_opts(opts)
+    {
+    }
+
+    /*!
+     * Register a benchmark. @a setup runs once before it, right before
+     * calibration, and returns its body; the objects it creates live as
+     * long as the body.
+     */
+    void add(const std::string &name, const char *unit, std::function<Body()> setup);
+
+    /// Run the benchmarks matching the filter, reporting progress to @a log.
+    std::vector<BenchResult> run(FILE *log);
+
+private:
+    struct Entry
+    {
+        std::string name;
+        const char *unit;
+        std::function<Body()> setup;
+    };
+
+    const Options m_opts;
+    std::vector<Entry> m_entries;
+};
+
+/// Write results as JSON, one result per line.
+void writeJSON(FILE *out, const std::vector<BenchResult> &results, const BenchSuite::Options &opts);
+
+/// Read results written by writeJSON(). \throw Exception if the file can't be read.
+std::vector<BenchResult> readJSON(const char *file);
+
+/*!
+ * Print the benchmarks of @a current next to those of @a baseline with
+ * the same name and flag the ones slower by more than @a thresholdPct.
+ * @return Number of regressions.
+ */
+int compareResults(const std::vector<BenchResult> &baseline, const std::vector<BenchResult> &current,
+                   double thresholdPct, FILE *out);
+
+/// Keeps the compiler from optimizing away values computed by a benchmark.
+void benchSink(uint32_t v) noexcept;
+
+// Suites
+void addCPUBenchmarks(BenchSuite &suite);
+void addPPUBenchmarks(BenchSuite &suite);
+void addBusBenchmarks(BenchSuite &suite);
+void addObserverBenchmarks(BenchSuite &suite);
+void addMachineBenchmarks(BenchSuite &suite, const std::string &romFile);
+
+#endif	// BENCH_HARNESS_H
@@ -0,0 +1,213 @@
+/*
+ * ROM loading, whole frames and restoring machine states.
+ */
+
+#include "harness.h"
+#include "machine.h"
+#include "framebuffer.h"
+#include "loader.h"
+#include "mappedstate.h"
+
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+
+// iNES image with mapper 0 and patterned banks
+std::string nesImage(int nROMs, int nVROMs, bool trainer)
+{
+    std::string img(16, '\0');
+    img[0] = 'N';
+    img[1] = 'E';
+    img[2] = 'S';
+    img[3] = 0x1A;
+    img[4] = static_cast<char>(nROMs);
+    img[5] = static_cast<char>(nVROMs);
+    img[6] = trainer ? 0x06 : 0x01;     // Trainer and RAM, or vertical mirroring
+
+    const size_t size = (trainer ? 512 : 0) + nROMs * Mapper::ROM_SIZE + nVROMs * Mapper::VROM_SIZE;
+    for (size_t i = 0; i < size; i++)
+        img += static_cast<char>(i * 7 + (i >> 8));
+    return img;
+}
+
+void addLoadNES(BenchSuite &suite, const std::string &name, int nROMs, int nVROMs, bool trainer)
+{
+    suite.add(name, "load", [nROMs, nVROMs, trainer]() {
+        std::shared_ptr<std::istringstream> in { new std::istringstream { nesImage(nROMs, nVROMs, trainer) } };
+        return [in](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+            {
+                in->clear();
+                in->seekg(0);
+                Cartrige cart;
+                ROMLoader loader { cart };
+                loader.loadNES(*in);
+                benchSink(cart.mapper()->readROM(0x8000u));
+            }
+        };
+    });
+}
+
+/*!
+ * Game-like NROM program: the main loop does arithmetic on a RAM page and
+ * the NMI handler copies sprites with DMA and sets the scroll, with
+ * background and sprites shown.
+ */
+std::string gameImage()
+{
+    static const uint8_t program[] = {
+        0x78,                   // $8000 reset: SEI
+        0xA2, 0xFF,             //   LDX #$FF
+        0x9A,                   //   TXS
+        0xE8,                   //   INX
+        0x8A,                   // $8005 TXA        ; Sprites spread over the screen
+        0x9D, 0x00, 0x02,       //   STA $0200,X
+        0xE8,                   //   INX
+        0xD0, 0xF9,             //   BNE $8005
+        0xA9, 0x80,             //   LDA #$80       ; NMI on
+        0x8D, 0x00, 0x20,       //   STA $2000
+        0xA9, 0x1E,             //   LDA #$1E       ; Background and sprites
+        0x8D, 0x01, 0x20,       //   STA $2001
+        0xA2, 0x00,             // $8016 main: LDX #0
+        0xBD, 0x00, 0x03,       // $8018 LDA $0300,X
+        0x65, 0x10,             //   ADC $10
+        0x9D, 0x00, 0x03,       //   STA $0300,X
+        0xE8,                   //   INX
+        0xD0, 0xF5,             //   BNE $8018
+        0xE6, 0x10,             //   INC $10
+        0x4C, 0x16, 0x80,       //   JMP $8016
+        0x48,                   // $8028 nmi: PHA
+        0xA9, 0x02,             //   LDA #$02
+        0x8D, 0x14, 0x40,       //   STA $4014      ; Sprite DMA from $0200
+        0xA5, 0x10,             //   LDA $10
+        0x8D, 0x05, 0x20,       //   STA $2005
+        0xA9, 0x00,             //   LDA #0
+        0x8D, 0x05, 0x20,       //   STA $2005
+        0x68,                   //   PLA
+        0x40                    //   RTI
+    };
+
+    std::string img = nesImage(2, 1, false);
+    const size_t prg = 16;
+    img.replace(prg, sizeof(program), reinterpret_cast<const char*>(program), sizeof(program));
+    const char vectors[] = { 0x28, static_cast<char>(0x80), 0x00, static_cast<char>(0x80), 0x28, static_cast<char>(0x80) };
+    img.replace(prg + 2 * Mapper::ROM_SIZE - 6, 6, vectors, 6);
+    return img;
+}
+
+struct FrameBench
+{
+    FrameBufferBackend fb;
+    std::unique_ptr<Machine> machine;
+};
+
+// Frames of @a image, an iNES ROM, or of the file @a romFile if the image is empty
+void addFrames(BenchSuite &suite, const std::string &name, const std::string &image,
+               const std::string &romFile, bool render)
+{
+    suite.add(name, "frame", [image, romFile, render]() {
+        std::shared_ptr<FrameBench> b { new FrameBench };
+        b->machine.reset(new Machine { OutputMode::NTSC, render ? &b->fb : nullptr });
+        if (image.empty())
+            b->machine->loadNES(romFile.c_str());
+        else
+        {
+            std::istringstream in(image);
+            b->machine->loadNES(in);
+        }
+
+        return [b](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+                b->machine->runFrame();
+            benchSink(static_cast<uint32_t>(b->machine->bus().cpuCycles()));
+        };
+    });
+}
+
+// Machines seeded from one state, as a batch would be
+constexpr int RESTORE_MACHINES = 300;
+
+struct RestoreBench
+{
+    std::vector<std::unique_ptr<Machine>> machines;
+    std::vector<c6502_byte_t> state;
+    std::unique_ptr<MappedState> mapped;
+    size_t next = 0;
+};
+
+// Restores of the game state after 60 frames, from the heap or from a mapped file
+void addRestore(BenchSuite &suite, const std::string &name, const std::string &image, bool mapped)
+{
+    suite.add(name, "restore", [image, mapped]() {
+        std::shared_ptr<RestoreBench> b { new RestoreBench };
+        std::unique_ptr<Machine> m { new Machine { OutputMode::NTSC } };
+        std::istringstream in(image);
+        m->loadNES(in);
+        for (int i = 0; i < 60; i++)
+            m->runFrame();
+
+        if (mapped)
+        {
+            // The mapping outlives the file
+            char path[] = "/tmp/b1bench-XXXXXX";
+            const int fd = mkstemp(path);
+            if (fd < 0)
+                throw Exception(Exception::IOFailure, "unable to create a temporary file");
+            close(fd);
+            try
+            {
+                MappedState::write(m->bus(), path);
+                b->mapped.reset(new MappedState { path });
+            }
+            catch (...)
+            {
+                unlink(path);
+                throw;
+            }
+            unlink(path);
+        }
+        else
+            m->bus().saveState(b->state);
+
+        for (int i = 0; i < RESTORE_MACHINES; i++)
+            b->machines.push_back(m->clone());
+
+        return [b](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+            {
+                Machine &target = *b->machines[b->next];
+                b->next = (b->next + 1) % b->machines.size();
+                if (b->mapped)
+                    b->mapped->restore(target.bus());
+                else
+                    target.bus().loadState(b->state.data(), static_cast<c6502_d_word_t>(b->state.size()));
+            }
+            benchSink(static_cast<uint32_t>(b->next));
+        };
+    });
+}
+
+}
+
+void addMachineBenchmarks(BenchSuite &suite, const std::string &romFile)
+{
+    addLoadNES(suite, "loader.nes.nrom128", 1, 1, false);
+    addLoadNES(suite, "loader.nes.nrom256", 2, 1, false);
+    addLoadNES(suite, "loader.nes.nrom256-chrram-trainer", 2, 0, true);
+
+    const std::string game = gameImage();
+    addFrames(suite, "machine.frame.game", game, std::string(), false);
+    addFrames(suite, "machine.frame.game.fb", game, std::string(), true);
+    addRestore(suite, "state.restore.heap", game, false);
+    addRestore(suite, "state.restore.mapped", game, true);
+    if (!romFile.empty())
+    {
+        addFrames(suite, "machine.frame.rom", std::string(), romFile, false);
+        addFrames(suite, "machine.frame.rom.fb", std::string(), romFile, true);
+    }
+}
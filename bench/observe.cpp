@@ -0,0 +1,103 @@
+/*
+ * Observations for learning agents against composing the full-size frame
+ * they are made from.
+ */
+
+#include "harness.h"
+#include "framebuffer.h"
+#include "observation.h"
+
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+typedef PPU::RenderingBackend::Layer Layer;
+
+struct Tile
+{
+    Layer layer;
+    int x, y;
+    c6502_byte_t data[64];
+};
+
+// Screen of background tiles and 64 sprites, as the PPU would pass them
+std::vector<Tile> frameTiles()
+{
+    std::vector<Tile> tiles;
+    for (int ty = 0; ty < 30; ty++)
+        for (int tx = 0; tx < 32; tx++)
+        {
+            Tile t = { Layer::BACKGROUND, tx * 8, ty * 8, { } };
+            for (int i = 0; i < 64; i++)
+                t.data[i] = (tx * 7 + ty * 13 + i * 5) % 5 == 0 ? 0 : static_cast<c6502_byte_t>((tx + ty + i) & 0x3F);
+            tiles.push_back(t);
+        }
+    for (int s = 0; s < 64; s++)
+    {
+        Tile t = { s % 4 == 0 ? Layer::BEHIND : Layer::FRONT, s * 37 % 248, s * 29 % 232, { } };
+        for (int i = 0; i < 64; i++)
+            t.data[i] = (i + s) % 3 == 0 ? 0 : static_cast<c6502_byte_t>(0x10 + s % 16);
+        tiles.push_back(t);
+    }
+    return tiles;
+}
+
+void sendFrame(FrameBufferBackend &fb, std::vector<Tile> &tiles)
+{
+    fb.setBackground(0x0Fu);
+    for (Tile &t: tiles)
+        fb.setSymbol(t.layer, t.x, t.y, t.data);
+    fb.draw();
+}
+
+struct ComposeBench
+{
+    FrameBufferBackend fb;
+    std::vector<Tile> tiles;
+};
+
+struct ObserveBench
+{
+    FrameBufferBackend fb;
+    std::unique_ptr<Observer> observer;
+    std::vector<c6502_byte_t> out;
+};
+
+void addObserve(BenchSuite &suite, const std::string &name, int width, int height, bool maxPool)
+{
+    suite.add(name, "frame", [width, height, maxPool]() {
+        std::shared_ptr<ObserveBench> b { new ObserveBench };
+        std::vector<Tile> tiles = frameTiles();
+        sendFrame(b->fb, tiles);
+        b->observer.reset(new Observer { width, height, maxPool });
+        b->out.resize(width * height);
+
+        return [b](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+                b->observer->observe(b->fb.pixels(), b->out.data());
+            benchSink(b->out[b->out.size() / 2]);
+        };
+    });
+}
+
+}
+
+void addObserverBenchmarks(BenchSuite &suite)
+{
+    suite.add("fb.compose", "frame", []() {
+        std::shared_ptr<ComposeBench> b { new ComposeBench };
+        b->tiles = frameTiles();
+        return [b](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+                sendFrame(b->fb, b->tiles);
+            benchSink(b->fb.pixels()[FrameBufferBackend::WIDTH * 120 + 128]);
+        };
+    });
+
+    addObserve(suite, "observe.84x84", 84, 84, false);
+    addObserve(suite, "observe.84x84.maxpool", 84, 84, true);
+    addObserve(suite, "observe.128x120", 128, 120, false);
+    addObserve(suite, "observe.256x240", 256, 240, false);
+}
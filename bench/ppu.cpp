@@ -0,0 +1,116 @@
+/*
+ * PPU::drawNextLine() under different background and sprite loads. Pattern
+ * tables, name tables, palettes and sprite memory are filled with
+ * synthetic data, so every tile has visible pixels.
+ */
+
+#include "harness.h"
+#include "machine.h"
+
+#include <memory>
+#include <sstream>
+
+namespace
+{
+
+// Takes tiles without drawing them, so only the PPU is measured
+class CountingBackend: public PPU::RenderingBackend
+{
+public:
+    void setBackground(c6502_byte_t color) override
+    {
+        m_sum += color;
+    }
+
+    void setSymbol(Layer, int x, int y, c6502_byte_t colorData[64]) override
+    {
+        m_sum += x + y + colorData[0];
+    }
+
+    void draw() override
+    {
+        benchSink(m_sum);
+    }
+
+private:
+    uint32_t m_sum = 0;
+};
+
+struct PPUBench
+{
+    CountingBackend backend;
+    std::unique_ptr<Machine> machine;
+    int line = 0;
+};
+
+// Machine with picture data in video memory and @a sprites sprites spread over the screen
+std::shared_ptr<PPUBench> prepare(bool background, int sprites, bool bigSprites)
+{
+    std::shared_ptr<PPUBench> b { new PPUBench };
+    b->machine.reset(new Machine { OutputMode::NTSC, &b->backend });
+
+    // Endless loop, the CPU isn't run anyway
+    std::string rom(0x8000, '\0');
+    rom[0] = 0x4C;
+    rom[1] = 0x00;
+    rom[2] = static_cast<char>(0x80);
+    rom[0x7FFC] = 0x00;
+    rom[0x7FFD] = static_cast<char>(0x80);
+    std::istringstream in(rom);
+    b->machine->loadRawData(in);
+
+    Bus &bus = b->machine->bus();
+    for (c6502_word_t a = 0; a < 0x2000u; a++)
+        bus.writeVideoMem(a, static_cast<c6502_byte_t>(a * 37u + (a >> 4)));
+    for (c6502_word_t a = 0x2000u; a < 0x3000u; a++)
+        bus.writeVideoMem(a, static_cast<c6502_byte_t>(a * 13u));
+    for (c6502_word_t a = 0x3F00u; a < 0x3F20u; a++)
+        bus.writeVideoMem(a, static_cast<c6502_byte_t>(a & 0x3Fu));
+
+    for (int s = 0; s < 64; s++)
+    {
+        const bool shown = s < sprites;
+        bus.writeSpriteMem(s * 4, shown ? static_cast<c6502_byte_t>(s * 29 % 224) : 0xEFu);
+        bus.writeSpriteMem(s * 4 + 1, static_cast<c6502_byte_t>(s * 2));
+        bus.writeSpriteMem(s * 4 + 2, static_cast<c6502_byte_t>(s & 0xE3));
+        bus.writeSpriteMem(s * 4 + 3, static_cast<c6502_byte_t>(8 + s * 37 % 240));
+    }
+
+    // Control registers: sprite size, then what is shown (left column included)
+    bus.writeMem(0x2000u, bigSprites ? 0x20u : 0x00u);
+    bus.writeMem(0x2001u, (background ? 0x0Au : 0x00u) | (sprites > 0 ? 0x14u : 0x00u));
+    return b;
+}
+
+void addLines(BenchSuite &suite, const std::string &name, bool background, int sprites, bool bigSprites = false)
+{
+    suite.add(name, "line", [background, sprites, bigSprites]() {
+        const std::shared_ptr<PPUBench> b = prepare(background, sprites, bigSprites);
+        return [b](uint64_t n) {
+            PPU &ppu = b->machine->ppu();
+            for (uint64_t i = 0; i < n; i++)
+            {
+                if (b->line == 0)
+                    ppu.startFrame();
+                ppu.drawNextLine();
+                if (++b->line == 240)
+                {
+                    ppu.endFrame();
+                    b->line = 0;
+                }
+            }
+        };
+    });
+}
+
+}
+
+void addPPUBenchmarks(BenchSuite &suite)
+{
+    addLines(suite, "ppu.line.off", false, 0);
+    addLines(suite, "ppu.line.bg", true, 0);
+    addLines(suite, "ppu.line.sprites8", false, 8);
+    addLines(suite, "ppu.line.sprites64", false, 64);
+    addLines(suite, "ppu.line.sprites64x16", false, 64, true);
+    addLines(suite, "ppu.line.bg+sprites64", true, 64);
+}
@@ -0,0 +1,150 @@
+/*
+ * BatchRunner scaling benchmark: emulates a batch of machines with 1 up to
+ * the number of cores worker threads and reports aggregate frames/s,
+ * optionally for each kind of pages backing the machines and per NUMA node.
+ */
+
+#include "machine.h"
+#include "batch.h"
+#include "affinity.h"
+#include "log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <ROM-file>\n"
+            "  -n <machines>  Batch size (default: 1024)\n"
+            "  -f <frames>    Frames per measurement (default: 60)\n"
+            "  -t <threads>   Highest thread count (default: number of cores)\n"
+            "  -p <pages>     Machine memory pages: normal, thp, hugetlb or all (default: normal)\n"
+            "  -a             Pin workers to CPUs node by node, report throughput per node\n"
+            "  -r             ROM file is raw program data (see ROMLoader::loadRawData)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    int nMachines = 1024,
+        nFrames = 60,
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    const char *romFile = nullptr;
+    bool raw = false,
+         pin = false;
+    std::vector<PageMode> pageModes { PageMode::Normal };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "-n") == 0 && hasValue)
+            nMachines = atoi(argv[++i]);
+        else if (strcmp(arg, "-f") == 0 && hasValue)
+            nFrames = atoi(argv[++i]);
+        else if (strcmp(arg, "-t") == 0 && hasValue)
+            maxThreads = atoi(argv[++i]);
+        else if (strcmp(arg, "-p") == 0 && hasValue)
+        {
+            const char *name = argv[++i];
+            if (strcmp(name, "all") == 0)
+                pageModes = { PageMode::Normal, PageMode::Transparent, PageMode::HugeTLB };
+            else if (strcmp(name, "thp") == 0)
+                pageModes = { PageMode::Transparent };
+            else if (strcmp(name, "hugetlb") == 0)
+                pageModes = { PageMode::HugeTLB };
+            else if (strcmp(name, "normal") == 0)
+                pageModes = { PageMode::Normal };
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "-a") == 0)
+            pin = true;
+        else if (strcmp(arg, "-r") == 0)
+            raw = true;
+        else if (arg[0] != '-' && !romFile)
+            romFile = arg;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!romFile || nMachines <= 0 || nFrames <= 0 || maxThreads <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Log::instance().config().filter = Log::LEVEL_SILENT;
+
+    Machine prototype { OutputMode::NTSC };
+    try
+    {
+        if (raw)
+        {
+            std::ifstream in(romFile, std::ios::in | std::ios::binary);
+            if (!in.is_open())
+                throw Exception(Exception::IOFailure, "unable to open the file");
+            prototype.loadRawData(in);
+        }
+        else
+            prototype.loadNES(romFile);
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+
+    printf("%d machines, %d frames per run\n", nMachines, nFrames);
+    printf("threads  pages        frames/s   speedup  efficiency   steals\n");
+
+    const std::vector<int> cpus = pin ? cpusByNode() : std::vector<int> { };
+
+    // Speedup is relative to the first row: one thread, first page mode
+    double base = 0.0;
+    for (int t = 1; t <= maxThreads; t++)
+    {
+        for (PageMode pages: pageModes)
+        {
+            BatchRunner batch { prototype, nMachines, t, pages, cpus };
+
+            // Warm up caches and let the workers start
+            batch.run(1);
+            const auto before = batch.stats();
+            batch.run(nFrames);
+            const auto st = batch.stats();
+
+            if (base == 0.0)
+                base = st.lastFramesPerSec;
+            const double speedup = st.lastFramesPerSec / base;
+            // Modes fall back silently, show what was obtained
+            printf("%7d  %-8s %12.0f %9.2f %10.0f%% %8llu\n",
+                   t, pageModeName(batch.pageMode()), st.lastFramesPerSec, speedup, 100.0 * speedup / t,
+                   static_cast<unsigned long long>(st.steals - before.steals));
+
+            if (pin)
+            {
+                for (const auto &ns: batch.nodeStats())
+                {
+                    if (ns.node < 0)
+                        printf("           node -: %d unpinned worker(s) %12.0f\n", ns.workers, ns.lastFramesPerSec);
+                    else
+                        printf("           node %d: %d worker(s) %12.0f\n", ns.node, ns.workers, ns.lastFramesPerSec);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
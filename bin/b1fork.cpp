@@ -0,0 +1,215 @@
+/*
+ * Fork server and its client: the server loads a ROM once, optionally
+ * warms it up, and forks a child per request that emulates the requested
+ * number of frames and reports the RAM hash. The client measures how long
+ * it takes until a child is running.
+ */
+
+#include "machine.h"
+#include "forkserver.h"
+#include "crc32.h"
+#include "log.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Request flag: the child crashes instead of emulating, shows isolation
+static constexpr uint32_t FLAG_CRASH = 0x1u;
+
+struct Result
+{
+    uint32_t ramHash,
+             frame;
+};
+
+static ForkServer *s_pServer = nullptr;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s -l <socket> [options] <ROM-file>   serve\n"
+            "       %s -c <socket> [options]              request children\n"
+            "Server options:\n"
+            "  -w <frames>   Also prepare machine 1, warmed up for <frames> frames\n"
+            "  -r            ROM file is raw program data (see ROMLoader::loadRawData)\n"
+            "Client options:\n"
+            "  -m <machine>  Prepared machine to start from (default: 0)\n"
+            "  -n <frames>   Frames each child emulates (default: 60)\n"
+            "  -k <count>    Children to request one after another (default: 1)\n"
+            "  -x            Children crash instead of emulating\n",
+            prog, prog);
+}
+
+static void onSignal(int)
+{
+    if (s_pServer)
+        s_pServer->stop();
+}
+
+static int serve(const char *path, const char *romFile, bool raw, int warmup)
+{
+    try
+    {
+        std::unique_ptr<Machine> machine { new Machine { OutputMode::NTSC } };
+        if (raw)
+        {
+            std::ifstream in(romFile, std::ios::in | std::ios::binary);
+            if (!in.is_open())
+                throw Exception(Exception::IOFailure, "unable to open the file");
+            machine->loadRawData(in);
+        }
+        else
+            machine->loadNES(romFile);
+
+        std::unique_ptr<Machine> warm;
+        if (warmup > 0)
+        {
+            warm = machine->clone();
+            for (int i = 0; i < warmup; i++)
+                warm->runFrame();
+        }
+
+        ForkServer server { path };
+        server.add(std::move(machine));
+        if (warm)
+            server.add(std::move(warm));
+
+        s_pServer = &server;
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = onSignal;
+        sigaction(SIGINT, &sa, nullptr);
+        sigaction(SIGTERM, &sa, nullptr);
+
+        printf("serving at %s\n", path);
+        fflush(stdout);
+        server.serve([](Machine &m, int fd, const ForkRequest &req) {
+            if (req.flags & FLAG_CRASH)
+                abort();
+
+            for (uint32_t i = 0; i < req.frames; i++)
+                m.runFrame();
+
+            const Result res = { crc32(m.bus().ram(), 0x800), static_cast<uint32_t>(m.bus().currentFrame()) };
+            return send(fd, &res, sizeof(res), MSG_NOSIGNAL) == sizeof(res) ? 0 : 1;
+        });
+        s_pServer = nullptr;
+
+        const auto &st = server.stats();
+        printf("children: %llu started, %llu exited, %llu crashed, %llu rejected\n",
+               static_cast<unsigned long long>(st.started), static_cast<unsigned long long>(st.exited),
+               static_cast<unsigned long long>(st.crashed), static_cast<unsigned long long>(st.rejected));
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+
+    return 0;
+}
+
+static int request(const char *path, uint32_t machine, uint32_t frames, int count, bool crash)
+{
+    using Clock = std::chrono::steady_clock;
+
+    double startSum = 0.0,
+           totalSum = 0.0;
+    int failed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const auto t0 = Clock::now();
+        int32_t pid = 0;
+        int fd;
+        try
+        {
+            fd = ForkServer::spawn(path, { { }, machine, frames, crash ? FLAG_CRASH : 0u }, &pid);
+        }
+        catch (const Exception &ex)
+        {
+            fprintf(stderr, "Error: %s\n", ex.message());
+            return 1;
+        }
+        const auto t1 = Clock::now();
+
+        Result res;
+        const bool ok = recv(fd, &res, sizeof(res), MSG_WAITALL) == sizeof(res);
+        close(fd);
+        const auto t2 = Clock::now();
+
+        const double startUs = std::chrono::duration<double, std::micro>(t1 - t0).count(),
+                     totalUs = std::chrono::duration<double, std::micro>(t2 - t0).count();
+        startSum += startUs;
+        totalSum += totalUs;
+        if (ok)
+            printf("child %d: running after %.0f us, done after %.0f us, frame %u, RAM hash %08x\n",
+                   pid, startUs, totalUs, res.frame, res.ramHash);
+        else
+        {
+            printf("child %d: running after %.0f us, died without a result\n", pid, startUs);
+            failed++;
+        }
+    }
+
+    printf("%d children, %d failed, average start %.0f us, average total %.0f us\n",
+           count, failed, startSum / count, totalSum / count);
+    return failed > 0 ? 2 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *listenPath = nullptr,
+               *connectPath = nullptr,
+               *romFile = nullptr;
+    int warmup = 0,
+        frames = 60,
+        count = 1,
+        machine = 0;
+    bool raw = false,
+         crash = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "-l") == 0 && hasValue)
+            listenPath = argv[++i];
+        else if (strcmp(arg, "-c") == 0 && hasValue)
+            connectPath = argv[++i];
+        else if (strcmp(arg, "-w") == 0 && hasValue)
+            warmup = atoi(argv[++i]);
+        else if (strcmp(arg, "-m") == 0 && hasValue)
+            machine = atoi(argv[++i]);
+        else if (strcmp(arg, "-n") == 0 && hasValue)
+            frames = atoi(argv[++i]);
+        else if (strcmp(arg, "-k") == 0 && hasValue)
+            count = atoi(argv[++i]);
+        else if (strcmp(arg, "-r") == 0)
+            raw = true;
+        else if (strcmp(arg, "-x") == 0)
+            crash = true;
+        else if (arg[0] != '-' && !romFile)
+            romFile = arg;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    Log::instance().config().filter = Log::LEVEL_SILENT;
+
+    if (listenPath && !connectPath && romFile)
+        return serve(listenPath, romFile, raw, warmup);
+    if (connectPath && !listenPath && !romFile && frames >= 0 && count > 0 && machine >= 0)
+        return request(connectPath, machine, frames, count, crash);
+
+    usage(argv[0]);
+    return 1;
+}
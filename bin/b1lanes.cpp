@@ -0,0 +1,165 @@
+/*
+ * VectorCPU benchmark: emulates groups of machines with the lockstep
+ * interpreter and with the scalar CPU, checks that both end in the same
+ * state and reports aggregate instructions per second.
+ */
+
+#include "machine.h"
+#include "vectorcpu.h"
+#include "log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <ROM-file>\n"
+            "  -l <lanes>     Machines per VectorCPU, 1..%d (default: %d)\n"
+            "  -g <groups>    Number of VectorCPUs (default: 4)\n"
+            "  -f <frames>    Frames to emulate (default: 600)\n"
+            "  -d             Diverge: give every machine different input\n"
+            "  -r             ROM file is raw program data (see ROMLoader::loadRawData)\n",
+            prog, VectorCPU::LANES, VectorCPU::LANES);
+}
+
+// Deterministic per machine input pattern for -d
+static void setInput(Machine &m, int n, int frame)
+{
+    const bool pressed = (frame / (5 + n % 11)) % 2 == 0;
+    m.gamepad(0).buttonEvent(static_cast<Button>(n % 8), pressed, false, false);
+}
+
+int main(int argc, char **argv)
+{
+    int nLanes = VectorCPU::LANES,
+        nGroups = 4,
+        nFrames = 600;
+    const char *romFile = nullptr;
+    bool diverge = false,
+         raw = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "-l") == 0 && hasValue)
+            nLanes = atoi(argv[++i]);
+        else if (strcmp(arg, "-g") == 0 && hasValue)
+            nGroups = atoi(argv[++i]);
+        else if (strcmp(arg, "-f") == 0 && hasValue)
+            nFrames = atoi(argv[++i]);
+        else if (strcmp(arg, "-d") == 0)
+            diverge = true;
+        else if (strcmp(arg, "-r") == 0)
+            raw = true;
+        else if (arg[0] != '-' && !romFile)
+            romFile = arg;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!romFile || nLanes < 1 || nLanes > VectorCPU::LANES || nGroups <= 0 || nFrames <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Log::instance().config().filter = Log::LEVEL_SILENT;
+
+    Machine prototype { OutputMode::NTSC };
+    try
+    {
+        if (raw)
+        {
+            std::ifstream in(romFile, std::ios::in | std::ios::binary);
+            if (!in.is_open())
+                throw Exception(Exception::IOFailure, "unable to open the file");
+            prototype.loadRawData(in);
+        }
+        else
+            prototype.loadNES(romFile);
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+
+    const int nMachines = nLanes * nGroups;
+    std::vector<std::unique_ptr<Machine>> vec, scalar;
+    std::vector<std::unique_ptr<VectorCPU>> cpus;
+    for (int g = 0; g < nGroups; g++)
+    {
+        std::vector<Machine*> lanes;
+        for (int i = 0; i < nLanes; i++)
+        {
+            vec.push_back(prototype.clone());
+            scalar.push_back(prototype.clone());
+            lanes.push_back(vec.back().get());
+        }
+        cpus.emplace_back(new VectorCPU { lanes });
+    }
+
+    using std::chrono::steady_clock;
+    auto start = steady_clock::now();
+    for (int f = 0; f < nFrames; f++)
+    {
+        if (diverge)
+            for (int i = 0; i < nMachines; i++)
+                setInput(*vec[i], i, f);
+        for (auto &cpu: cpus)
+            cpu->runFrame();
+    }
+    const double vecSec = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+    start = steady_clock::now();
+    for (int f = 0; f < nFrames; f++)
+    {
+        if (diverge)
+            for (int i = 0; i < nMachines; i++)
+                setInput(*scalar[i], i, f);
+        for (auto &m: scalar)
+            m->bus().runFrame();
+    }
+    const double scalarSec = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+    int mismatches = 0;
+    for (int i = 0; i < nMachines; i++)
+    {
+        std::vector<c6502_byte_t> a, b;
+        vec[i]->bus().saveState(a);
+        scalar[i]->bus().saveState(b);
+        if (a != b)
+            mismatches++;
+    }
+
+    // Both cores retire the same instructions, VectorCPU counts them
+    VectorCPU::Stats st = { };
+    for (auto &cpu: cpus)
+    {
+        st.groupSteps += cpu->stats().groupSteps;
+        st.vectorInstr += cpu->stats().vectorInstr;
+        st.scalarInstr += cpu->stats().scalarInstr;
+    }
+    const double instr = static_cast<double>(st.vectorInstr + st.scalarInstr);
+
+    printf("%d machines (%d x %d lanes), %d frames%s\n",
+           nMachines, nGroups, nLanes, nFrames, diverge ? ", diverging input" : "");
+    printf("vector:  %8.3f s  %8.2f Minstr/s\n", vecSec, instr / vecSec / 1e6);
+    printf("scalar:  %8.3f s  %8.2f Minstr/s\n", scalarSec, instr / scalarSec / 1e6);
+    printf("speedup: %8.2f\n", scalarSec / vecSec);
+    printf("vectorized: %.1f%% of instructions, %.2f lanes per group step\n",
+           100.0 * st.vectorInstr / instr, st.groupSteps ? double(st.vectorInstr) / st.groupSteps : 0.0);
+    printf("state mismatches: %d\n", mismatches);
+
+    return mismatches == 0 ? 0 : 2;
+}
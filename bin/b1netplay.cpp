@@ -0,0 +1,193 @@
+/*
+ * Netplay check: plays two rollback sessions against each other over a
+ * loopback link with simulated latency, jitter and loss, checks that both
+ * peers end in the same state and reports rollback depth and frame cost.
+ */
+
+#include "machine.h"
+#include "netplay.h"
+#include "transport.h"
+#include "crc32.h"
+#include "log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <ROM-file>\n"
+            "  -f <frames>    Frames to play (default: 3600)\n"
+            "  -l <ms>        One-way latency (default: 50)\n"
+            "  -j <ms>        Jitter (default: 20)\n"
+            "  -p <percent>   Datagram loss (default: 5)\n"
+            "  -s <seed>      Link random seed (default: 1)\n"
+            "  -d <frames>    Local input delay, 0..%d (default: %d)\n"
+            "  -R <frames>    Maximum rollback, 1..%d (default: %d)\n"
+            "  -r             ROM file is raw program data (see ROMLoader::loadRawData)\n"
+            "Exit status is 2 if the peers diverge.\n",
+            prog,
+            RollbackSession::MAX_INPUT_DELAY, RollbackSession::DEFAULT_CONFIG.inputDelay,
+            RollbackSession::MAX_ROLLBACK, RollbackSession::DEFAULT_CONFIG.maxRollback);
+}
+
+// Deterministic input of each player, changing every few frames
+static Gamepad::Input playerInput(int player, int frame)
+{
+    const int period = player == 0 ? 7 : 11;
+    const uint16_t button = 1u << ((frame / period + player * 3) % 8);
+    return Gamepad::Input { (frame / period) % 3 == 0 ? uint16_t(0u) : button, 0u };
+}
+
+static void printStats(int player, const RollbackSession &s, double sec)
+{
+    const RollbackSession::Stats &st = s.stats();
+    printf("peer %d: %d frames, %d stalls, %d rollbacks, depth avg %.2f max %d, %d frames re-emulated\n",
+           player, st.frames, st.stalls, st.rollbacks, st.avgRollbackDepth(),
+           st.maxRollbackDepth, st.resimulatedFrames);
+    printf("        %.1f us/frame (re-emulation included), %.1f us/rollback\n",
+           sec * 1e6 / st.frames, st.avgRollbackUs);
+}
+
+int main(int argc, char **argv)
+{
+    RollbackSession::Config cfg = RollbackSession::DEFAULT_CONFIG;
+    LoopbackLink::Conditions cond = { 50.0, 20.0, 0.05, 1u };
+    int nFrames = 3600;
+    const char *romFile = nullptr;
+    bool raw = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "-f") == 0 && hasValue)
+            nFrames = atoi(argv[++i]);
+        else if (strcmp(arg, "-l") == 0 && hasValue)
+            cond.latencyMs = atof(argv[++i]);
+        else if (strcmp(arg, "-j") == 0 && hasValue)
+            cond.jitterMs = atof(argv[++i]);
+        else if (strcmp(arg, "-p") == 0 && hasValue)
+            cond.lossRate = atof(argv[++i]) / 100.0;
+        else if (strcmp(arg, "-s") == 0 && hasValue)
+            cond.seed = static_cast<unsigned>(strtoul(argv[++i], nullptr, 0));
+        else if (strcmp(arg, "-d") == 0 && hasValue)
+            cfg.inputDelay = atoi(argv[++i]);
+        else if (strcmp(arg, "-R") == 0 && hasValue)
+            cfg.maxRollback = atoi(argv[++i]);
+        else if (strcmp(arg, "-r") == 0)
+            raw = true;
+        else if (arg[0] != '-' && !romFile)
+            romFile = arg;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!romFile || nFrames <= 0 || cond.latencyMs < 0.0 || cond.jitterMs < 0.0 ||
+        cond.lossRate < 0.0 || cond.lossRate >= 1.0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Log::instance().config().filter = Log::LEVEL_SILENT;
+
+    Machine prototype { OutputMode::NTSC };
+    std::unique_ptr<Machine> machines[2];
+    LoopbackLink link { cond };
+    std::unique_ptr<RollbackSession> peers[2];
+    try
+    {
+        if (raw)
+        {
+            std::ifstream in(romFile, std::ios::in | std::ios::binary);
+            if (!in.is_open())
+                throw Exception(Exception::IOFailure, "unable to open the file");
+            prototype.loadRawData(in);
+        }
+        else
+            prototype.loadNES(romFile);
+
+        for (int p = 0; p < 2; p++)
+        {
+            machines[p] = prototype.clone();
+            peers[p].reset(new RollbackSession { *machines[p], link.endpoint(p), p, cfg });
+        }
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+
+    // Both peers try to emulate a frame per 1/60 s of link time, a stalled
+    // peer retries on the next tick
+    using std::chrono::steady_clock;
+    const double frameMs = 1000.0 / 60.0;
+    double sec[2] = { };
+    auto step = [&](int p, const Gamepad::Input &in) {
+        const auto start = steady_clock::now();
+        peers[p]->runFrame(in);
+        sec[p] += std::chrono::duration<double>(steady_clock::now() - start).count();
+    };
+
+    while (peers[0]->frame() < nFrames || peers[1]->frame() < nFrames)
+    {
+        for (int p = 0; p < 2; p++)
+            if (peers[p]->frame() < nFrames)
+                step(p, playerInput(p, peers[p]->frame()));
+        link.advanceTime(frameMs);
+    }
+
+    // Settle with released buttons: deliver everything in flight, then
+    // emulate frames on both peers until neither relies on a prediction
+    const Gamepad::Input released = { 0u, 0u };
+    const double flushMs = cond.latencyMs + cond.jitterMs + frameMs;
+    int extra = 0;
+    for (;;)
+    {
+        link.advanceTime(flushMs);
+        for (auto &peer: peers)
+            peer->poll();
+        link.advanceTime(flushMs);
+        for (auto &peer: peers)
+            peer->poll();
+
+        if (peers[0]->isSynchronized() && peers[1]->isSynchronized() &&
+            peers[0]->frame() == peers[1]->frame())
+            break;
+        if (++extra > cfg.inputDelay + cfg.maxRollback + 16)
+        {
+            fprintf(stderr, "Error: peers don't settle, is the loss rate too high?\n");
+            return 1;
+        }
+        for (int p = 0; p < 2; p++)
+            step(p, released);
+    }
+
+    std::vector<c6502_byte_t> states[2];
+    for (int p = 0; p < 2; p++)
+        machines[p]->bus().saveState(states[p]);
+    const bool diverged = states[0] != states[1];
+
+    printf("%d frames (+%d to settle), latency %.0f ms, jitter %.0f ms, loss %.1f%%, "
+           "input delay %d, max rollback %d\n",
+           nFrames, extra, cond.latencyMs, cond.jitterMs, cond.lossRate * 100.0,
+           cfg.inputDelay, cfg.maxRollback);
+    printf("link: %d datagrams, %d lost\n", link.sentDatagrams(), link.lostDatagrams());
+    for (int p = 0; p < 2; p++)
+        printStats(p, *peers[p], sec[p]);
+    printf("state CRC: %08X %08X, %s\n",
+           crc32(states[0].data(), states[0].size()), crc32(states[1].data(), states[1].size()),
+           diverged ? "DIVERGED" : "equal");
+
+    return diverged ? 2 : 0;
+}
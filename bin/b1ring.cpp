@@ -0,0 +1,125 @@
+/*
+ * Frame ring reader: follows frames published by "b1run -s" and prints
+ * their numbers and hashes. Also an example of a zero-copy ring consumer.
+ */
+
+#include "framering.h"
+#include "crc32.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <ring-name>\n"
+            "  -n <frames>   Stop after this many frames (default: run until the writer stops)\n"
+            "  -q            Quiet: print only the summary\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    long long maxFrames = -1;
+    bool quiet = false;
+    const char *name = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "-n") == 0 && i + 1 < argc)
+            maxFrames = atoll(argv[++i]);
+        else if (strcmp(arg, "-q") == 0)
+            quiet = true;
+        else if (arg[0] != '-' && !name)
+            name = arg;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!name)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        // The writer may not have started yet
+        std::unique_ptr<FrameRingReader> pReader;
+        for (int attempt = 0; !pReader; attempt++)
+        {
+            try
+            {
+                pReader.reset(new FrameRingReader { name });
+            }
+            catch (const Exception &ex)
+            {
+                if (ex.code() != Exception::IOFailure || attempt == 500)
+                    throw;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        FrameRingReader &reader = *pReader;
+
+        // Start from the oldest frame still in the ring
+        const uint64_t published = reader.published();
+        uint64_t next = published > reader.slotCount() ? published - reader.slotCount() : 0;
+        unsigned long long got = 0,
+                           skipped = 0;
+        auto lastProgress = std::chrono::steady_clock::now();
+
+        while (maxFrames < 0 || static_cast<long long>(got) < maxFrames)
+        {
+            if (next >= reader.published())
+            {
+                // The writer is gone if nothing arrives for a second
+                if (std::chrono::steady_clock::now() - lastProgress > std::chrono::seconds(1))
+                    break;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            lastProgress = std::chrono::steady_clock::now();
+
+            const auto *s = reader.slot(next);
+            if (s)
+            {
+                // Consume in place, then make sure the writer didn't overwrite it meanwhile
+                const uint64_t frame = s->frame;
+                const uint32_t hash = s->frameHash,
+                               ramHash = crc32(s->ram(), FrameRingLayout::RAM_SIZE);
+                if (reader.valid(s, next))
+                {
+                    if (!quiet)
+                        printf("frame %llu  pixels %08x  RAM %08x\n",
+                               static_cast<unsigned long long>(frame), hash, ramHash);
+                    got++;
+                    next++;
+                    continue;
+                }
+            }
+
+            // Overwritten before we got to it: jump to the oldest frame left
+            const uint64_t now = reader.published();
+            const uint64_t oldest = now > reader.slotCount() ? now - reader.slotCount() + 1 : next + 1;
+            skipped += oldest > next ? oldest - next : 1;
+            next = oldest > next ? oldest : next + 1;
+        }
+
+        printf("%llu frames read, %llu skipped\n", got, skipped);
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,416 @@
+/*
+ * Headless runner: emulates frames as fast as possible and reports
+ * throughput and state hashes. Used as a performance and regression probe.
+ */
+
+#include "machine.h"
+#include "movie.h"
+#include "framebuffer.h"
+#include "framering.h"
+#include "state.h"
+#include "warmstart.h"
+#include "videodump.h"
+#include "avcapture.h"
+#include "lockstep.h"
+#include "rewind.h"
+#include "crc32.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+
+class NullBackend: public PPU::RenderingBackend
+{
+public:
+    void setBackground(c6502_byte_t) override
+    {
+    }
+
+    void setSymbol(Layer, int, int, c6502_byte_t*) override
+    {
+    }
+
+    void draw() override
+    {
+    }
+};
+
+// Hashes everything sent to the backend, so equal hashes mean equal pictures
+class HashingBackend: public PPU::RenderingBackend
+{
+public:
+    void setBackground(c6502_byte_t color) override
+    {
+        m_crc = crc32(&color, 1, m_crc);
+    }
+
+    void setSymbol(Layer l, int x, int y, c6502_byte_t colorData[64]) override
+    {
+        const int pos[3] = { static_cast<int>(l), x, y };
+        m_crc = crc32(pos, sizeof(pos), m_crc);
+        m_crc = crc32(colorData, 64, m_crc);
+    }
+
+    void draw() override
+    {
+        m_frameHash = m_crc;
+        m_allFramesHash = crc32(&m_frameHash, sizeof(m_frameHash), m_allFramesHash);
+        m_crc = 0;
+    }
+
+    c6502_d_word_t frameHash() const noexcept
+    {
+        return m_frameHash;
+    }
+
+    c6502_d_word_t allFramesHash() const noexcept
+    {
+        return m_allFramesHash;
+    }
+
+private:
+    c6502_d_word_t m_crc = 0,
+                   m_frameHash = 0,
+                   m_allFramesHash = 0;
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <ROM-file>\n"
+            "  -n <frames>   Frames to emulate (default: movie length or 3600)\n"
+            "  -m <movie>    Play input movie\n"
+            "  -b <backend>  Rendering backend: null, hash or fb (default: hash, fb with -s, -v or -A)\n"
+            "  -s <name>     Publish frames to shared memory ring <name> (e.g. /b1-frames)\n"
+            "  -v <file>     Dump video to a YUV4MPEG2 file, '-' for the standard output\n"
+            "  -A <base>     Capture video and audio to <base>.y4m, <base>.wav and <base>.idx\n"
+            "  -c <dir>      Warm-start cache: skip the longest cached movie prefix\n"
+            "  -C <frames>   Cache the movie state every <frames> frames (default: 300)\n"
+            "  -a <frames>   Run ahead <frames> frames\n"
+            "  -R            Keep rewind history, report its size and cost\n"
+            "  -L <movie>    Lockstep check: play <movie> on this machine and on a clone drawing\n"
+            "                nothing, stop at the first difference (exit status 2)\n"
+            "  -r            ROM file is raw program data (see ROMLoader::loadRawData)\n"
+            "  -p            PAL mode\n",
+            prog);
+}
+
+static c6502_d_word_t ramHash(const Bus &bus)
+{
+    std::vector<c6502_byte_t> state;
+    bus.saveState(state);
+
+    StateHeader hdr;
+    memcpy(&hdr, state.data(), sizeof(hdr));
+    const auto &ram = hdr.sections[StateHeader::RAM];
+    return crc32(state.data() + ram.offset, ram.size);
+}
+
+// Reference is a clone with neither backend nor run-ahead
+static int checkLockstep(Machine &machine, const char *movieFile)
+{
+    LockstepChecker::Result res;
+    double sec;
+    try
+    {
+        Movie movie;
+        movie.load(movieFile);
+        std::unique_ptr<Machine> reference = machine.clone();
+        LockstepChecker checker { machine, *reference };
+
+        const auto start = std::chrono::steady_clock::now();
+        res = checker.run(movie);
+        sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+
+    printf("lockstep:      %d frames identical, %.3f s\n", res.frames, sec);
+    if (!res.diverged)
+        return 0;
+
+    printf("%s", res.report.c_str());
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    int nFrames = -1;
+    const char *movieFile = nullptr,
+               *romFile = nullptr,
+               *ringName = nullptr,
+               *cacheDir = nullptr,
+               *videoFile = nullptr,
+               *captureBase = nullptr,
+               *backendName = nullptr,
+               *lockstepFile = nullptr;
+    int cacheInterval = 300,
+        runAhead = 0;
+    bool raw = false,
+         keepHistory = false;
+    OutputMode mode = OutputMode::NTSC;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "-n") == 0 && hasValue)
+            nFrames = atoi(argv[++i]);
+        else if (strcmp(arg, "-m") == 0 && hasValue)
+            movieFile = argv[++i];
+        else if (strcmp(arg, "-b") == 0 && hasValue)
+        {
+            backendName = argv[++i];
+            if (strcmp(backendName, "null") != 0 && strcmp(backendName, "hash") != 0 &&
+                strcmp(backendName, "fb") != 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "-s") == 0 && hasValue)
+            ringName = argv[++i];
+        else if (strcmp(arg, "-v") == 0 && hasValue)
+            videoFile = argv[++i];
+        else if (strcmp(arg, "-A") == 0 && hasValue)
+            captureBase = argv[++i];
+        else if (strcmp(arg, "-c") == 0 && hasValue)
+            cacheDir = argv[++i];
+        else if (strcmp(arg, "-C") == 0 && hasValue)
+            cacheInterval = atoi(argv[++i]);
+        else if (strcmp(arg, "-a") == 0 && hasValue)
+            runAhead = atoi(argv[++i]);
+        else if (strcmp(arg, "-L") == 0 && hasValue)
+            lockstepFile = argv[++i];
+        else if (strcmp(arg, "-R") == 0)
+            keepHistory = true;
+        else if (strcmp(arg, "-r") == 0)
+            raw = true;
+        else if (strcmp(arg, "-p") == 0)
+            mode = OutputMode::PAL;
+        else if (arg[0] != '-' && !romFile)
+            romFile = arg;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!backendName)
+        backendName = ringName || videoFile || captureBase ? "fb" : "hash";
+
+    // Only the frame buffer backend has pictures to publish or dump; the
+    // lockstep check plays its own movie and produces nothing else
+    if (!romFile || cacheInterval <= 0 || runAhead < 0 || (cacheDir && !movieFile) ||
+        ((ringName || videoFile || captureBase) && strcmp(backendName, "fb") != 0) ||
+        (lockstepFile && (movieFile || cacheDir || ringName || videoFile || captureBase || keepHistory ||
+                          nFrames >= 0)))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Log::instance().config().filter = Log::LEVEL_SILENT;
+
+    const bool hashing = strcmp(backendName, "hash") == 0,
+               frameBuffer = strcmp(backendName, "fb") == 0;
+    NullBackend nullBackend;
+    HashingBackend hashBackend;
+    FrameBufferBackend fbBackend;
+    PPU::RenderingBackend *backend = &nullBackend;
+    if (hashing)
+        backend = &hashBackend;
+    else if (frameBuffer)
+        backend = &fbBackend;
+
+    Machine machine { mode, backend };
+    machine.setRunAhead(runAhead);
+    Movie movie;
+    std::unique_ptr<MoviePlayer> player;
+    std::unique_ptr<FrameRingWriter> ring;
+    std::unique_ptr<WarmStartCache> cache;
+    std::unique_ptr<VideoDumper> video;
+    std::unique_ptr<AVCapture> capture;
+    std::unique_ptr<RewindBuffer> history;
+
+    try
+    {
+        if (raw)
+        {
+            std::ifstream in(romFile, std::ios::in | std::ios::binary);
+            if (!in.is_open())
+                throw Exception(Exception::IOFailure, "unable to open the file");
+            machine.loadRawData(in);
+        }
+        else
+            machine.loadNES(romFile);
+
+        if (movieFile)
+        {
+            movie.load(movieFile);
+            player.reset(new MoviePlayer { machine, movie });
+            if (nFrames < 0)
+                nFrames = movie.length();
+        }
+
+        if (ringName)
+            ring.reset(new FrameRingWriter { ringName });
+        if (cacheDir)
+            cache.reset(new WarmStartCache { cacheDir });
+        if (videoFile)
+        {
+            // A reader of the pipe going away fails the dump, not the run
+            signal(SIGPIPE, SIG_IGN);
+            video.reset(new VideoDumper { videoFile, mode });
+            if (strcmp(videoFile, "-") == 0)
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+        }
+        if (captureBase)
+            capture.reset(new AVCapture { captureBase, mode });
+        if (keepHistory)
+            history.reset(new RewindBuffer { machine.bus() });
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+
+    if (lockstepFile)
+        return checkLockstep(machine, lockstepFile);
+
+    if (nFrames < 0)
+        nFrames = 3600;
+
+    // Restored frames count as emulated, only the rest of the movie is run
+    int skipped = 0;
+    if (cache)
+    {
+        skipped = cache->restore(machine, movie, nFrames);
+        player->skipTo(skipped);
+    }
+
+    // Buffers traded with the capture thread; there is no APU, the audio stays empty
+    std::vector<c6502_byte_t> capturePixels(FrameBufferBackend::WIDTH * FrameBufferBackend::HEIGHT);
+    std::vector<int16_t> captureAudio;
+    c6502_d_word_t pixelsHash = 0;
+    double historyUs = 0.0;
+
+    using std::chrono::steady_clock;
+    std::vector<double> frameUs(nFrames - skipped);
+    const uint64_t startCycles = machine.bus().cpuCycles();
+    const auto start = steady_clock::now();
+
+    for (int i = skipped; i < nFrames; i++)
+    {
+        const auto t = steady_clock::now();
+        if (!player || !player->runFrame())
+            machine.runFrame();
+        if (history)
+        {
+            // Measured separately, the part of the frame time it adds
+            const auto h = steady_clock::now();
+            history->onFrame();
+            historyUs += std::chrono::duration<double, std::micro>(steady_clock::now() - h).count();
+        }
+        if (ring)
+            ring->publish(machine, &fbBackend);
+        if (video)
+            video->push(fbBackend.pixels());
+        if (capture)
+        {
+            // The picture leaves the backend, so the last one is hashed first
+            if (i + 1 == nFrames)
+                pixelsHash = crc32(fbBackend.pixels(), FrameBufferBackend::WIDTH * FrameBufferBackend::HEIGHT);
+            fbBackend.swapPixels(capturePixels);
+            capture->capture(machine.bus().currentFrame(), capturePixels, captureAudio);
+        }
+        frameUs[i - skipped] = std::chrono::duration<double, std::micro>(steady_clock::now() - t).count();
+
+        if (cache && (i + 1) % cacheInterval == 0 && i + 1 <= movie.length())
+            cache->store(machine, movie, i + 1);
+    }
+    if (cache)
+        cache->flush();
+
+    const double sec = std::chrono::duration<double>(steady_clock::now() - start).count();
+    const uint64_t cycles = machine.bus().cpuCycles() - startCycles;
+
+    // Frames still queued are written after the measurement, as when the run goes on
+    if (video)
+        video->flush();
+    if (capture)
+        capture->flush();
+    else if (frameBuffer)
+        pixelsHash = crc32(fbBackend.pixels(), FrameBufferBackend::WIDTH * FrameBufferBackend::HEIGHT);
+
+    printf("frames:        %d%s\n", nFrames,
+           player ? (player->atEnd() ? " (movie played to the end)" : " (movie not finished)") : "");
+    if (cache)
+        printf("warm start:    %d frames restored, %d states stored\n", skipped, cache->stats().stored);
+    printf("time:          %.3f s\n", sec);
+    if (!frameUs.empty())
+    {
+        std::sort(frameUs.begin(), frameUs.end());
+        auto pct = [&frameUs](double p) { return frameUs[static_cast<size_t>(p * (frameUs.size() - 1))]; };
+
+        printf("frames/s:      %.1f\n", frameUs.size() / sec);
+        printf("emulated CPU:  %.3f MHz\n", cycles / sec / 1e6);
+        printf("frame time us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+               pct(0.5), pct(0.9), pct(0.99), frameUs.back());
+    }
+
+    printf("RAM crc32:     %08x\n", ramHash(machine.bus()));
+    if (hashing)
+        printf("frame crc32:   %08x (last)  %08x (all frames)\n",
+               hashBackend.frameHash(), hashBackend.allFramesHash());
+    if (frameBuffer)
+        printf("pixels crc32:  %08x (last)\n", pixelsHash);
+    if (history && !frameUs.empty())
+    {
+        uint32_t rateNum, rateDen;
+        VideoDumper::frameRate(mode, rateNum, rateDen);
+        const RewindBuffer::Config &cfg = RewindBuffer::DEFAULT_CONFIG;
+        const double frameNs = historyUs * 1e3 / frameUs.size(),
+                     avgFrameUs = sec * 1e6 / frameUs.size();
+        printf("rewind:        %d snapshots (%.1f s), %.2f of %.0f MB, %d skipped\n",
+               history->length(), history->length() * cfg.interval * double(rateDen) / rateNum,
+               history->memoryUsed() / 1048576.0, cfg.capacity / 1048576.0, history->skippedSnapshots());
+        printf("rewind cost:   %.0f ns/frame (%.2f%% of the frame time)\n",
+               frameNs, frameNs / 10.0 / avgFrameUs);
+    }
+    if (ring)
+        printf("published:     %llu frames\n", static_cast<unsigned long long>(ring->published()));
+    if (video)
+    {
+        const auto st = video->stats();
+        printf("video:         %llu frames written, %llu dropped, max %.2f ms per frame\n",
+               static_cast<unsigned long long>(st.written), static_cast<unsigned long long>(st.dropped),
+               st.maxWriteMs);
+        if (st.failed)
+            printf("video error:   %s\n", video->lastError().c_str());
+    }
+    if (capture)
+    {
+        const auto st = capture->stats();
+        printf("capture:       %llu frames (%llu dropped and repeated), %llu audio samples\n",
+               static_cast<unsigned long long>(st.written), static_cast<unsigned long long>(st.dropped),
+               static_cast<unsigned long long>(st.samples));
+        if (st.failed)
+            printf("capture error: %s\n", capture->lastError().c_str());
+    }
+
+    return 0;
+}
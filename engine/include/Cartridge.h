@@ -2,6 +2,8 @@
 #define	CARTRIDGE_H
 
 #include "storage.h"
+#include "arena.h"
+#include <memory>
 
 class Mapper
 {
@@ -98,13 +100,40 @@ public:
                                     VROM_SIZE = 8 * 1024,
                                     RAM_SIZE = 8 * 1024;
 
+    // Granularity of CHR-RAM modification tracking
+    static constexpr c6502_d_word_t CHR_PAGE_SIZE = 1024,
+                                    CHR_PAGE_COUNT = VROM_SIZE / CHR_PAGE_SIZE;
+
     typedef Storage<ROM_SIZE> ROM_BANK;
     typedef Storage<VROM_SIZE> VROM_BANK;
     typedef Storage<RAM_SIZE> RAM_BANK;
+    typedef Storage<VROM_SIZE, DirtyBlocks<256>> CHR_RAM_BANK;
 
-    Mapper(int nROMs, int nVROMs, int nRAMs);
+    /// @param pArena Arena for the mutable banks, nullptr: heap.
+    Mapper(int nROMs, int nVROMs, int nRAMs, Arena *pArena = nullptr);
     virtual ~Mapper();
 
+    Mapper(const Mapper&) = delete;
+    Mapper &operator=(const Mapper&) = delete;
+
+    /*!
+     * Mappers live in the arena of their machine when it has room, next to
+     * their banks; create() and clone() place them, destroy() disposes of them.
+     */
+    template <class T>
+    static Mapper *create(int nROMs, int nVROMs, int nRAMs, Arena *pArena)
+    {
+        return new (pArena) T { nROMs, nVROMs, nRAMs, pArena };
+    }
+
+    static void destroy(Mapper *pMapper) noexcept;
+
+    /// Copy of the mapper sharing ROM / VROM banks with this one.
+    virtual Mapper *clone(Arena *pArena = nullptr) const = 0;
+
+    /// Copy registers and cartridge-side RAM from a mapper of the same cartridge.
+    virtual void copyStateFrom(const Mapper &src) noexcept;
+
     void setROMBank(int n, const c6502_byte_t *p);
     void setVROMBank(int n, const c6502_byte_t *p);
 
@@ -114,29 +143,120 @@ public:
 
     virtual c6502_byte_t readVROM(c6502_word_t addr) = 0;
 
+    /// Writes to the pattern tables (PPU 0x0000 ~ 0x1FFF). Only cartridges
+    /// with CHR-RAM are affected, writes to CHR-ROM are ignored.
+    virtual void writeVROM(c6502_word_t addr, c6502_byte_t val) = 0;
+
     /* N.B.: some addresses control mapper behaviour (i. e.
      * force bank switching) so, despite the memory itself is r/o,
      * this operation with the mapper is legal.
      */
     virtual void writeRAM(c6502_word_t addr, c6502_byte_t val) = 0;
 
-    /* TODO: PPU has an addressing space separate from that of CPU,
-     * add routines for PPU reading / writing, e. g. readPPU(),
-     * writePPU().
+    /*!
+     * Mapper part of the machine save state: registers and cartridge-side
+     * RAM (CHR-RAM and RAM banks). Mappers with registers must extend the
+     * base implementation.
+     */
+    virtual c6502_d_word_t stateSize() const noexcept;
+    virtual void saveState(c6502_byte_t *p) const noexcept;
+    virtual void loadState(const c6502_byte_t *p) noexcept;
+
+    /// Refresh the state saved at @a p copying only modified CHR-RAM blocks.
+    virtual void updateState(c6502_byte_t *p) noexcept;
+
+    /// CRC32 of ROM and VROM contents, identifies the game.
+    c6502_d_word_t romHash() const noexcept;
+
+    /// Bytes taken by ROM and VROM banks, see relocateROM().
+    size_t romSize() const noexcept
+    {
+        return m_nROMs * sizeof(ROM_BANK) + m_nVROMs * sizeof(VROM_BANK);
+    }
+
+    /*!
+     * Move ROM and VROM banks to @a mem (romSize() bytes, e.g. a huge page
+     * block), kept alive by @a owner for as long as any mapper uses it.
+     * Mappers cloned afterwards share the new copy.
      */
+    void relocateROM(void *mem, const std::shared_ptr<void> &owner);
 
+    /// Cartridge has PRG RAM (WRAM) banks.
     bool hasRAM() const noexcept
     {
         return m_nRAMs > 0;
     }
 
+    /// Cartridge has no VROM banks, pattern tables are kept in writable CHR-RAM.
+    bool hasCHRRAM() const noexcept
+    {
+        return m_pCHRRAM != nullptr;
+    }
+
+    /*!
+     * Bitmap of CHR-RAM pages (CHR_PAGE_SIZE bytes each, bit N covers
+     * addresses N * CHR_PAGE_SIZE ~ (N + 1) * CHR_PAGE_SIZE - 1) modified
+     * since the last clearDirtyCHRPages() call. Renderers caching decoded
+     * tiles use it to refresh only the changed part of the pattern tables.
+     */
+    c6502_byte_t dirtyCHRPages() const noexcept
+    {
+        return m_chrDirty;
+    }
+
+    void clearDirtyCHRPages(c6502_byte_t mask = 0xFFu) noexcept
+    {
+        m_chrDirty &= ~mask;
+    }
+
 protected:
     const int m_nROMs, m_nVROMs, m_nRAMs;
+    Arena *const m_pArena;
+
+    // ROM contents are immutable after loading and shared between clones
+    std::shared_ptr<ROM_BANK> m_spROM;
+    std::shared_ptr<VROM_BANK> m_spVROM;
 
     ROM_BANK *m_pROM = nullptr;
     VROM_BANK *m_pVROM = nullptr;
     RAM_BANK *m_pRAM = nullptr;
 
+    // Pattern table RAM, present only when there are no VROM banks
+    CHR_RAM_BANK *m_pCHRRAM = nullptr;
+    c6502_byte_t m_chrDirty = 0u;
+
+    // Single block holding CHR-RAM and the RAM banks
+    void *m_pBanks = nullptr;
+
+    Mapper(const Mapper &src, Arena *pArena);
+
+    void allocBanks(bool hasCHRRAM);
+
+    static void *operator new(size_t size, Arena *pArena);
+    // Only called when a constructor throws
+    static void operator delete(void *p, Arena *pArena) noexcept;
+
+    // Ordinary allocations, hidden by the arena ones otherwise
+    static void *operator new(size_t size)
+    {
+        return ::operator new(size);
+    }
+
+    static void operator delete(void *p) noexcept
+    {
+        ::operator delete(p);
+    }
+
+    void writeCHRRAM(c6502_word_t addr, c6502_byte_t val) noexcept
+    {
+        assert(m_pCHRRAM);
+        if (m_pCHRRAM->Read(addr) != val)
+        {
+            m_pCHRRAM->Write(addr, val);
+            m_chrDirty |= 1u << (addr / CHR_PAGE_SIZE);
+        }
+    }
+
     friend class Cartrige;
 };
 
@@ -149,15 +269,26 @@ enum class Mirroring
 
 class Cartrige
 {
+    Arena *const m_pArena;
     Mapper *m_pMapper = nullptr;
-    c6502_byte_t *m_pTrainer = nullptr;
+    // Immutable like ROM banks, shared between copies
+    std::shared_ptr<const c6502_byte_t> m_spTrainer;
     Mirroring m_mirr = Mirroring::Horizontal;
 
 public:
+    /// @param pArena Arena of the machine for the mapper, nullptr: heap.
+    explicit Cartrige(Arena *pArena = nullptr):
+        m_pArena { pArena }
+    {
+    }
+
+    /// Copy of the cartridge; ROM banks are shared with @a src.
+    Cartrige(const Cartrige &src, Arena *pArena = nullptr);
+    Cartrige &operator=(const Cartrige&) = delete;
+
     ~Cartrige()
     {
-        delete m_pMapper;
-        delete[] m_pTrainer;
+        Mapper::destroy(m_pMapper);
     }
 
     bool isReady() const
@@ -177,11 +308,14 @@ public:
 
     const c6502_byte_t *trainer() const
     {
-        return m_pTrainer;
+        return m_spTrainer.get();
     }
 
     void setTrainer(const c6502_byte_t tr[512]);
 
+    /// CRC32 of the ROM contents (mapper banks and trainer).
+    c6502_d_word_t romHash() const noexcept;
+
     Mirroring mirroring() const
     {
         return m_mirr;
@@ -83,7 +83,8 @@ public:
                      sprmemAddr = 0;
         c6502_byte_t scrollV = 0,
                      scrollH = 0,
-                     vramReadBuf = 0;
+                     vramReadBuf = 0,
+                     reserved = 0;     // Filler, snapshots are compared bytewise
 
         c6502_word_t activePage() const noexcept
         {
@@ -91,6 +92,24 @@ public:
         }
     };
 
+    /// Complete PPU state, used for save states
+    struct Snapshot
+    {
+        State st;
+        int scrollSwitch,
+            currLine;
+        c6502_byte_t frameVScroll;
+    };
+
+    /// Power-on state
+    void reset() noexcept
+    {
+        m_st = State();
+        m_scrollSwitch = 0;
+        m_currLine = 0;
+        m_frameVScroll = 0;
+    }
+
     void writeRegister(c6502_word_t n, c6502_byte_t val) noexcept;
     c6502_byte_t readRegister(c6502_word_t n) noexcept;
 
@@ -99,6 +118,21 @@ public:
         return m_st.enableNMI;
     }
 
+    /*!
+     * With rendering disabled the PPU keeps updating its state (sprite 0 hit,
+     * sprite overflow) but doesn't decode tiles nor call the backend. Used for
+     * frames that are emulated but never presented.
+     */
+    void setRenderingEnabled(bool on) noexcept
+    {
+        m_renderingEnabled = on;
+    }
+
+    bool isRenderingEnabled() const noexcept
+    {
+        return m_renderingEnabled;
+    }
+
     void onBeginVblank() noexcept;
     void onEndVblank() noexcept;
 
@@ -112,6 +146,22 @@ public:
         return m_st;
     }
 
+    void saveState(Snapshot &s) const noexcept
+    {
+        s.st = m_st;
+        s.scrollSwitch = m_scrollSwitch;
+        s.currLine = m_currLine;
+        s.frameVScroll = m_frameVScroll;
+    }
+
+    void loadState(const Snapshot &s) noexcept
+    {
+        m_st = s.st;
+        m_scrollSwitch = s.scrollSwitch;
+        m_currLine = s.currLine;
+        m_frameVScroll = s.frameVScroll;
+    }
+
 private:
     struct PageTileInfo
     {
@@ -136,6 +186,7 @@ private:
     RenderingBackend *const m_pBackend;
 
     State m_st;
+    bool m_renderingEnabled = true;
     int m_scrollSwitch = 0;
     int m_currLine = 0;
     c6502_byte_t m_frameVScroll = 0;
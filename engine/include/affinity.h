@@ -0,0 +1,44 @@
+/*
+ * CPU placement of worker threads
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include "common.h"
+#include <vector>
+
+/*!
+ * CPUs the process may run on, grouped by NUMA node (nodes ascending, CPUs
+ * ascending within a node). Pinning worker N to element N fills one node
+ * before the next one, so workers sharing a node also share its memory.
+ */
+std::vector<int> cpusByNode();
+
+/// NUMA node of @a cpu, 0 on single node systems or when unknown.
+int cpuNode(int cpu) noexcept;
+
+/*!
+ * Saved CPU mask of the calling thread, restored when the object goes out
+ * of scope; pin() limits the thread to one CPU meanwhile. Pinning fails
+ * (returns false) where affinity is not supported or not permitted.
+ */
+class ThreadAffinity
+{
+public:
+    ThreadAffinity() noexcept;
+    ~ThreadAffinity();
+
+    ThreadAffinity(const ThreadAffinity&) = delete;
+    ThreadAffinity &operator=(const ThreadAffinity&) = delete;
+
+    bool pin(int cpu) noexcept;
+
+private:
+    // cpu_set_t, kept opaque
+    alignas(8) unsigned char m_saved[128];
+    bool m_valid = false,
+         m_pinned = false;
+};
+
+#endif	// AFFINITY_H
@@ -0,0 +1,70 @@
+/*
+ * Bump allocator keeping the memory of a machine together
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "common.h"
+#include <cstddef>
+
+/*!
+ * Hands out cache line aligned pieces of a fixed block owned by someone
+ * else. Pieces are never freed one by one, reset() recycles the whole
+ * block; allocate() returns nullptr when the block is exhausted, callers
+ * fall back to the heap.
+ */
+class Arena
+{
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    /// @param mem Block of @a size bytes, aligned to ALIGNMENT.
+    Arena(void *mem, size_t size) noexcept:
+        m_pMem { static_cast<char*>(mem) },
+        m_size { size }
+    {
+        assert(reinterpret_cast<uintptr_t>(mem) % ALIGNMENT == 0);
+    }
+
+    Arena(const Arena&) = delete;
+    Arena &operator=(const Arena&) = delete;
+
+    void *allocate(size_t size) noexcept
+    {
+        const size_t aligned = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (aligned > m_size - m_used)
+            return nullptr;
+
+        void *p = m_pMem + m_used;
+        m_used += aligned;
+        return p;
+    }
+
+    bool owns(const void *p) const noexcept
+    {
+        return p >= m_pMem && p < m_pMem + m_size;
+    }
+
+    void reset() noexcept
+    {
+        m_used = 0;
+    }
+
+    size_t used() const noexcept
+    {
+        return m_used;
+    }
+
+    size_t capacity() const noexcept
+    {
+        return m_size;
+    }
+
+private:
+    char *const m_pMem;
+    const size_t m_size;
+    size_t m_used = 0;
+};
+
+#endif	// ARENA_H
@@ -0,0 +1,120 @@
+/*
+ * Synchronized audio and video capture
+ */
+
+#ifndef AVCAPTURE_H
+#define AVCAPTURE_H
+
+#include "common.h"
+#include "bus.h"
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+ * Captures pictures and audio of every frame to a pair of files sharing
+ * one timeline: "<base>.y4m" (see VideoDumper) and "<base>.wav" (16-bit
+ * mono PCM), plus "<base>.idx", a text index with one line per video
+ * frame: "<video frame> <machine frame> <first sample> <samples>", with
+ * " r" appended to frames repeated for dropped ones.
+ *
+ * The emulation thread hands buffers over by swapping: capture() exchanges
+ * the picture and audio vectors of the caller with free ones of a fixed
+ * ring, so it neither copies nor allocates. A helper thread converts and
+ * writes them. When the ring is full the frame is dropped; the helper
+ * then repeats the previous picture with silence in its place, so video
+ * and audio stay in step with the emulated time.
+ *
+ * Frame n covers samples [n * rate / fps, (n + 1) * rate / fps); audio
+ * blocks of other lengths are cut or padded with silence. There is no
+ * APU yet, so callers pass empty blocks, which are silence.
+ */
+class AVCapture
+{
+public:
+    static constexpr int DEFAULT_MAX_QUEUED = 8,
+                         DEFAULT_SAMPLE_RATE = 48000;
+
+    /*!
+     * Create the files, replacing existing ones.
+     * \throw Exception if a file can't be created.
+     * @param maxQueued Frames that may wait for writing at the same time.
+     */
+    AVCapture(const std::string &base, OutputMode mode,
+              int maxQueued = DEFAULT_MAX_QUEUED, int sampleRate = DEFAULT_SAMPLE_RATE);
+
+    /// Writes all queued frames, repeats for frames dropped last, and completes the WAV header.
+    ~AVCapture();
+
+    AVCapture(const AVCapture&) = delete;
+    AVCapture &operator=(const AVCapture&) = delete;
+
+    /*!
+     * Hand over the picture (FrameBufferBackend::WIDTH x HEIGHT palette
+     * indices, see FrameBufferBackend::swapPixels()) and the audio samples
+     * of machine frame @a frame. Both vectors are swapped with free buffers
+     * of the same capacity.
+     * \return false if the frame is dropped; the vectors are unchanged.
+     */
+    bool capture(uint64_t frame, std::vector<c6502_byte_t> &pixels, std::vector<int16_t> &audio) noexcept;
+
+    /// Wait until all queued frames are written.
+    void flush();
+
+    int sampleRate() const noexcept
+    {
+        return m_sampleRate;
+    }
+
+    struct Stats
+    {
+        uint64_t written,       // Video frames in the files, repeated ones included
+                 dropped,       // Rejected by capture()
+                 samples;       // Audio samples in the files
+        bool failed;            // Writing stopped, see lastError()
+    };
+
+    Stats stats() const;
+
+    /// Description of the write error, empty if none.
+    std::string lastError() const;
+
+private:
+    struct Slot
+    {
+        uint64_t frame;
+        uint32_t repeats;       // Dropped frames before this one
+        std::vector<c6502_byte_t> pixels;
+        std::vector<int16_t> audio;
+    };
+
+    const int m_sampleRate;
+    uint32_t m_rateNum,
+             m_rateDen;
+
+    FILE *m_video = nullptr,
+         *m_audio = nullptr,
+         *m_index = nullptr;
+
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<Slot> m_slots;
+    size_t m_head = 0,          // Next slot to write
+           m_count = 0;         // Slots queued
+    uint32_t m_repeats = 0;     // Dropped since the last queued frame
+    bool m_busy = false,
+         m_stop = false;
+
+    Stats m_stats = { };
+    std::string m_lastError;
+
+    void workerLoop();
+    void closeFiles() noexcept;
+    uint64_t sampleAt(uint64_t videoFrame) const noexcept;
+};
+
+#endif	// AVCAPTURE_H
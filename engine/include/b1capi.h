@@ -0,0 +1,123 @@
+/*
+ * C interface of the b1 engine, for embedding through any FFI.
+ *
+ * The ABI is stable within a major B1_API_VERSION: functions are only
+ * added, structures are only extended at the end and carry no C++ types.
+ * Functions never throw; failures are reported by status codes, and
+ * b1_last_error() describes the last failure of the calling thread.
+ *
+ * Different machines may be used from different threads at the same time,
+ * a single machine must not.
+ */
+
+#ifndef B1CAPI_H
+#define B1CAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define B1_API_VERSION 1
+
+/* Status codes */
+#define B1_OK                0
+#define B1_ERROR_UNKNOWN     -1
+#define B1_ERROR_IO          -2
+#define B1_ERROR_FORMAT      -3
+#define B1_ERROR_SIZE        -4
+#define B1_ERROR_ARGUMENT    -5
+#define B1_ERROR_STATE       -6
+#define B1_ERROR_MEMORY      -7
+
+/* Machine creation flags */
+#define B1_PAL               0x1    /* PAL timing instead of NTSC */
+#define B1_NO_VIDEO          0x2    /* Don't render, b1_view.framebuffer is NULL */
+
+/* Button bits of b1_input, same as Gamepad::Input */
+#define B1_BUTTON_A          0x01
+#define B1_BUTTON_B          0x02
+#define B1_BUTTON_SELECT     0x04
+#define B1_BUTTON_START      0x08
+#define B1_BUTTON_UP         0x10
+#define B1_BUTTON_DOWN       0x20
+#define B1_BUTTON_LEFT       0x40
+#define B1_BUTTON_RIGHT      0x80
+
+/* Observation flags */
+#define B1_OBS_MAX_POOL      0x1    /* Maximum of this and the previous observation */
+
+#define B1_SCREEN_WIDTH      256
+#define B1_SCREEN_HEIGHT     240
+#define B1_RAM_SIZE          0x800
+
+typedef struct b1_machine b1_machine;
+
+/* Pressed buttons of both gamepads for the frames of one step */
+typedef struct b1_input
+{
+    uint16_t pad[2];
+} b1_input;
+
+/*
+ * Zero-copy view of a machine. Pointers stay valid until the machine is
+ * destroyed; the data they point to is updated by every step, so it must
+ * be consumed (or copied) before the next b1_step_frames() call.
+ */
+typedef struct b1_view
+{
+    const uint8_t *ram;             /* B1_RAM_SIZE bytes of internal RAM */
+    const uint8_t *framebuffer;     /* Last frame, NES palette indices, row by row */
+    int width, height;
+    const int16_t *audio;           /* Samples of the last step, NULL: no APU yet */
+    size_t audio_samples;
+    uint64_t frame;                 /* Frames emulated since power on */
+} b1_view;
+
+int b1_api_version(void);
+
+/* Message of the last failed call on this thread, never NULL */
+const char *b1_last_error(void);
+
+/* NULL on failure */
+b1_machine *b1_create(unsigned flags);
+void b1_destroy(b1_machine *m);
+
+/* Independent copy of a machine with a cartridge, sharing ROM data. NULL on failure */
+b1_machine *b1_clone(const b1_machine *m);
+
+/* Load a ROM from memory and power the machine on; the data is copied */
+int b1_load_nes(b1_machine *m, const void *data, size_t size);
+int b1_load_raw(b1_machine *m, const void *data, size_t size);
+
+int b1_reset(b1_machine *m);
+int b1_power(b1_machine *m);
+
+/*
+ * Set input and emulate @frames frames on each of @n machines, in order.
+ * @inputs holds one entry per machine, or is NULL to keep current input.
+ * Stops at the first failing machine.
+ */
+int b1_step_frames(b1_machine *const *machines, const b1_input *inputs, size_t n, int frames);
+
+int b1_get_view(const b1_machine *m, b1_view *view);
+
+/*
+ * Grayscale observation of the last frame, box-filtered down to
+ * @width x @height (at most B1_SCREEN_WIDTH x B1_SCREEN_HEIGHT) into the
+ * caller buffer @out of @width * @height bytes. See Observer.
+ */
+int b1_observe(b1_machine *m, uint8_t *out, int width, int height, unsigned flags);
+
+/* Save states, see Bus::saveState() */
+size_t b1_state_size(const b1_machine *m);
+int b1_save_state(const b1_machine *m, void *buf, size_t size);
+int b1_load_state(b1_machine *m, const void *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* B1CAPI_H */
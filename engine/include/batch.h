@@ -0,0 +1,167 @@
+/*
+ * Batch emulation of many machines on a thread pool
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "common.h"
+#include "hugepages.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Machine;
+class ThreadAffinity;
+
+/*!
+ * Owns a set of independent machines and emulates them on a pool of
+ * worker threads, one frame of one machine per task.
+ *
+ * For every frame each worker gets an equal slice of the machines. A
+ * worker takes tasks from the front of its slice and, when the slice is
+ * exhausted, steals the back half of the fullest remaining slice of
+ * another worker. Slices are kept as atomic [begin, end) pairs updated with
+ * compare-and-swap, and workers meet at a spinning barrier between frames,
+ * so the per-frame path takes no locks and allocates nothing. Workers
+ * sleep between run() calls; the calling thread works as worker 0.
+ *
+ * Optionally the machines and one shared copy of the ROM banks are placed
+ * in a single HugePageBlock, so that thousands of machines need a few
+ * dozen TLB entries instead of thousands.
+ *
+ * Workers can be pinned to CPUs. Each worker constructs the machines of
+ * its own slice, so their memory is first touched, and thus allocated, on
+ * the NUMA node the worker runs on; every frame starts from these home
+ * slices, machines only visit other workers when they are stolen.
+ */
+class BatchRunner
+{
+public:
+    /*!
+     * @param prototype Ready machine, copied @a count times (see Machine::clone()).
+     * @param nThreads Worker threads including the caller, 0 for one per core.
+     * @param pages Pages for machine memory, Normal keeps each machine in its
+     *              own heap block; see pageMode() for what was obtained.
+     * @param cpus CPU of each worker (worker N gets cpus[N % size]), e.g.
+     *             cpusByNode(); empty: workers are not pinned.
+     */
+    BatchRunner(const Machine &prototype, int count, int nThreads = 0,
+                PageMode pages = PageMode::Normal, const std::vector<int> &cpus = { });
+    ~BatchRunner();
+
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner &operator=(const BatchRunner&) = delete;
+
+    /// Emulate @a frames frames on every machine.
+    void run(int frames = 1);
+
+    Machine &machine(int n) noexcept
+    {
+        return *m_machines[n];
+    }
+
+    int size() const noexcept
+    {
+        return static_cast<int>(m_machines.size());
+    }
+
+    int threads() const noexcept
+    {
+        return m_nThreads;
+    }
+
+    PageMode pageMode() const noexcept
+    {
+        return m_spPages ? m_spPages->mode() : PageMode::Normal;
+    }
+
+    struct Stats
+    {
+        uint64_t frames,        // Machine frames emulated so far
+                 steals;        // Successful steals
+        double lastRunSec,
+               lastFramesPerSec;
+    };
+
+    Stats stats() const noexcept;
+
+    /// Throughput of the workers of one NUMA node.
+    struct NodeStats
+    {
+        int node,               // -1: workers are not pinned
+            workers;
+        uint64_t frames;        // Machine frames emulated so far
+        double lastFramesPerSec;
+    };
+
+    /// Nodes in ascending order.
+    std::vector<NodeStats> nodeStats() const;
+
+private:
+    // Slice of machine indices: begin in the high half, end in the low one.
+    // Padded to a cache line, so that workers don't share lines.
+    struct Slice
+    {
+        std::atomic<uint64_t> range;
+        uint64_t steals,
+                 frames,        // Machine frames emulated by the worker
+                 framesBefore;  // ... when the last run() started
+        int cpu,                // Pinned CPU, -1: none
+            node;
+        char padding[24];
+    };
+
+    // Machines in m_spPages are destroyed in place
+    struct MachineDeleter
+    {
+        bool inPlace;
+
+        void operator()(Machine *m) const noexcept;
+    };
+
+    // Shared with the ROM banks of the machines, released after them
+    std::shared_ptr<HugePageBlock> m_spPages;
+    std::vector<std::unique_ptr<Machine, MachineDeleter>> m_machines;
+    const int m_nThreads;
+    const std::vector<int> m_cpus;
+    std::unique_ptr<Slice[]> m_slices;
+    std::vector<std::thread> m_workers;
+
+    // Start of a run(), workers sleep on it
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    int m_runId = 0,
+        m_frames = 0;
+    bool m_stop = false;
+
+    // Construction by the workers: source of the copies, memory for them
+    // (nullptr: heap), workers done and the first failure
+    const Machine *m_pSource = nullptr;
+    char *m_pMachineMem = nullptr;
+    int m_built = 0;
+    std::exception_ptr m_buildError;
+
+    // Frame barrier
+    std::atomic<int> m_arrived { 0 };
+    std::atomic<unsigned> m_generation { 0 };
+
+    uint64_t m_totalFrames = 0;
+    double m_lastRunSec = 0.0;
+
+    void workerLoop(int n);
+    void place(int n, ThreadAffinity &affinity) noexcept;
+    void build(int n);
+    void stopWorkers() noexcept;
+    void runFrames(int n, int frames);
+    void resetSlices() noexcept;
+    bool takeOwn(int n, int &index) noexcept;
+    bool steal(int n, int &index) noexcept;
+    void barrier() noexcept;
+};
+
+#endif	// BATCH_H
@@ -2,11 +2,13 @@
 #define BUS_H
 
 #include "storage.h"
+#include <vector>
 
 class CPU6502;
 class PPU;
 class Cartrige;
 class Gamepad;
+struct StateHeader;
 
 enum class OutputMode
 {
@@ -23,19 +25,10 @@ static constexpr c6502_word_t PAL_BG = 0x3F00u,
  */
 class Bus
 {
-    /*** 6502 MEMORY MAP ***/
-    // Internal RAM: 0x0000 ~ 0x2000.
-    // 0x0000 ~ 0x0100 is a z-page, have special meaning for addressing.
-    Storage<0x800> m_ram;
-
-    // Video memory, separate address space
-    Storage<0x2000> m_vram;
-
-    // Cartridge permanent RAM
-    Storage<0x2000> m_wram;
+    friend class VectorCPU;
 
-    // Sprite memory, addressed by sprite index (0..63)
-    Storage<256> m_spriteMem;
+    // Fields used on every memory access come first and share a cache line,
+    // followed by memories in the order of their access frequency
 
     // Modules
     CPU6502 *m_pCPU = nullptr;
@@ -50,6 +43,26 @@ class Bus
 
     int m_nFrame = 0;
 
+    // CPU clocks executed, statistics only (not saved in states)
+    uint64_t m_cpuCycles = 0;
+
+    /*** 6502 MEMORY MAP ***/
+    // Internal RAM: 0x0000 ~ 0x2000.
+    // 0x0000 ~ 0x0100 is a z-page, have special meaning for addressing.
+    Storage<0x800, DirtyBlocks<64>> m_ram;
+
+    // Sprite memory, addressed by sprite index (0..63)
+    Storage<256, DirtyBlocks<64>> m_spriteMem;
+
+    // Video memory, separate address space
+    Storage<0x2000, DirtyBlocks<256>> m_vram;
+
+    // Cartridge permanent RAM
+    Storage<0x2000, DirtyBlocks<256>> m_wram;
+
+    void stateLayout(StateHeader &hdr) const noexcept;
+    void saveCore(c6502_byte_t *p) const noexcept;
+
 public:
     explicit Bus(OutputMode m):
         m_mode { m }
@@ -96,8 +109,47 @@ public:
 
     int currentTimeMs() const noexcept;
 
+    /// CPU clocks per scanline and number of vertical blank scanlines.
+    int lineCycles() const noexcept;
+    int vblankLines() const noexcept;
+
+    /// CPU clocks executed since the machine was created.
+    uint64_t cpuCycles() const noexcept
+    {
+        return m_cpuCycles;
+    }
+
     void setGamePad(int n, Gamepad *pad) noexcept;
 
+    /*!
+     * Machine save states. The state blob (see state.h) covers memory, CPU,
+     * PPU, gamepads and the cartridge mapper; ROM contents are not included,
+     * so a state can only be loaded into a machine with the same cartridge
+     * type inserted.
+     */
+    c6502_d_word_t stateSize() const noexcept;
+    void saveState(c6502_byte_t *p) const noexcept;
+    void saveState(std::vector<c6502_byte_t> &out) const;
+    void loadState(const c6502_byte_t *p, c6502_d_word_t size);
+
+    /*!
+     * Incremental save: refreshes the state at @a p, which must have been
+     * produced by saveState() of this machine, copying only memory blocks
+     * written since the previous updateState() call. Modification tracking
+     * is shared, so only one buffer per machine can be kept up to date this
+     * way.
+     */
+    void updateState(c6502_byte_t *p) noexcept;
+
+    /// Copy the complete mutable state from a machine with the same cartridge.
+    void copyStateFrom(const Bus &src) noexcept;
+
+    /// Internal RAM contents (0x800 bytes), the pointer is valid for the bus lifetime.
+    const c6502_byte_t *ram() const noexcept
+    {
+        return m_ram.Data();
+    }
+
     // CPU address space memory requests dispatching functions
     c6502_byte_t readMem(c6502_word_t addr);
     void writeMem(c6502_word_t addr, c6502_byte_t val);
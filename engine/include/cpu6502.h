@@ -17,6 +17,7 @@
 class CPU6502: public Component
 {
     friend class Debugger;
+    friend class VectorCPU;
 
 public:
     enum State
@@ -32,10 +33,13 @@ public:
      * - X, Y indexes
      * - stack pointer
      * - program counter
+     *
+     * Explicit filler instead of implicit padding: snapshots containing
+     * the registers are compared bytewise.
      */
     struct Reg
     {
-        c6502_byte_t a, x, y, s, p;
+        c6502_byte_t a, x, y, s, p, reserved;
         c6502_word_t pc;
     };
 
@@ -44,6 +48,15 @@ public:
         C = 0, Z = 1, I = 2, D = 3, B = 4, V = 6, N = 7
     };
 
+    /// Mutable processor state, used for save states
+    struct Snapshot
+    {
+        Reg regs;
+        State state;
+        int nmiCount,
+            rtiCount;
+    };
+
     CPU6502();
 
     CPU6502(const CPU6502&) = delete;
@@ -78,6 +91,22 @@ public:
         return m_rtiCount;
     }
 
+    void saveState(Snapshot &s) const noexcept
+    {
+        s.regs = m_regs;
+        s.state = m_state;
+        s.nmiCount = m_nmiCount;
+        s.rtiCount = m_rtiCount;
+    }
+
+    void loadState(const Snapshot &s) noexcept
+    {
+        m_regs = s.regs;
+        m_state = s.state;
+        m_nmiCount = s.nmiCount;
+        m_rtiCount = s.rtiCount;
+    }
+
     template <Flag FLG>
     c6502_byte_t getFlag() const noexcept
     {
@@ -86,7 +115,7 @@ public:
     }
 
 private:
-    Reg m_regs;
+    Reg m_regs { };
 
     State m_state;
 
@@ -0,0 +1,10 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include "common.h"
+#include <cstddef>
+
+/// CRC-32 (IEEE 802.3). Pass the previous result as @a crc to continue a checksum.
+c6502_d_word_t crc32(const void *p, size_t size, c6502_d_word_t crc = 0) noexcept;
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * XOR-delta / run-length codec for machine state snapshots
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "common.h"
+#include <vector>
+
+/*!
+ * Encodes a byte block as the XOR difference against a reference block,
+ * compressing runs of zero (unchanged) bytes. Consecutive snapshots of a
+ * running machine differ in a few hundred bytes at most, so the delta
+ * usually takes 1-5% of the snapshot size.
+ *
+ * Stream format is a sequence of records:
+ *   <zero run length: varint> <literal count: varint> <literal bytes>
+ * where literals are the XORed bytes. Varints are 7 bits per byte, least
+ * significant group first.
+ */
+class DeltaCodec
+{
+public:
+    /*!
+     * Append encoded difference between @a cur and @a ref to @a out.
+     * \param ref Reference block, nullptr stands for a block of zeroes
+     * (i.e. plain run-length encoding of @a cur).
+     */
+    static void encode(const c6502_byte_t *cur,
+                       const c6502_byte_t *ref,
+                       c6502_d_word_t size,
+                       std::vector<c6502_byte_t> &out);
+
+    /// Upper bound of the encoded size of a @a size byte block.
+    static uint64_t maxEncodedSize(c6502_d_word_t size) noexcept
+    {
+        // Records cover at least 9 bytes and take 2 bytes more than their
+        // literals, plus the first and last ones
+        return size + size / 4u + 16u;
+    }
+
+    /*!
+     * XOR decoded delta into @a dst. Applying a delta to either of the two
+     * blocks it was made of yields the other one.
+     * \return false if the stream is malformed or doesn't fit @a dstSize.
+     */
+    static bool apply(const c6502_byte_t *src,
+                      c6502_d_word_t srcSize,
+                      c6502_byte_t *dst,
+                      c6502_d_word_t dstSize) noexcept;
+};
+
+#endif	// DELTA_H
@@ -0,0 +1,137 @@
+/*
+ * Fork server: prepared machines in isolated processes
+ */
+
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#include "common.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class Machine;
+
+/// Request of a client, sent right after connecting.
+struct ForkRequest
+{
+    char magic[4];          // "B1FK"
+    uint32_t machine;       // Index of a prepared machine, see ForkServer::add()
+    uint32_t frames,        // Free for the handler, e.g. frames to emulate
+             flags;
+};
+
+/// First message on the connection, from the child or from the server on failure.
+struct ForkReply
+{
+    int32_t status,         // 0 or a ForkServer::Error
+            pid;            // Child process
+};
+
+/*!
+ * Keeps prepared machines (ROM loaded, possibly warmed up) in one process
+ * and fork()s a child for every client connecting to a Unix socket. The
+ * child inherits the machines copy-on-write, so it starts emulating right
+ * away; it talks to the client over the connection, which closes when the
+ * child exits. A crashing child affects neither the server nor the other
+ * children.
+ *
+ * The server process must be single-threaded while serving: fork() only
+ * duplicates the calling thread.
+ */
+class ForkServer
+{
+public:
+    static constexpr char MAGIC[4] = { 'B', '1', 'F', 'K' };
+
+    /// Time for a client to send its request after connecting, then it's rejected
+    static constexpr int REQUEST_TIMEOUT_MS = 200;
+    /// Connections with incomplete requests read at a time
+    static constexpr size_t MAX_PENDING = 64;
+
+    enum Error: int32_t
+    {
+        BAD_REQUEST = -1,
+        FORK_FAILED = -2
+    };
+
+    /*!
+     * Runs in the child with the requested machine and the connection to
+     * the client; the return value is the exit code of the child.
+     */
+    using Handler = std::function<int(Machine &machine, int fd, const ForkRequest &req)>;
+
+    /// Listen at @a path, replacing a stale socket left by a crashed server.
+    explicit ForkServer(const char *path);
+    ~ForkServer();
+
+    ForkServer(const ForkServer&) = delete;
+    ForkServer &operator=(const ForkServer&) = delete;
+
+    /// Take a ready machine; @return its index for requests.
+    uint32_t add(std::unique_ptr<Machine> machine);
+
+    /// Serve requests until stop() is called (e.g. from a signal handler).
+    void serve(const Handler &handler);
+
+    /*!
+     * Wait up to @a timeoutMs for a request and serve it, reaping exited
+     * children. Requests are read without blocking, several connections
+     * at a time, so an idle or slow client holds up nobody; one that
+     * doesn't send its request within REQUEST_TIMEOUT_MS is rejected.
+     * Returns only in the server process.
+     * @return A child was started.
+     */
+    bool serveOne(const Handler &handler, int timeoutMs);
+
+    void stop() noexcept
+    {
+        m_stop = true;
+    }
+
+    struct Stats
+    {
+        uint64_t started,       // Children forked
+                 exited,        // ... exited normally
+                 crashed,       // ... killed by a signal
+                 rejected;      // Invalid or late requests and failed forks
+    };
+
+    const Stats &stats() const noexcept
+    {
+        return m_stats;
+    }
+
+    /*!
+     * Client side: ask the server at @a path for a child running
+     * @a req.machine (magic is filled in).
+     * @return Connection to the child, to be closed by the caller.
+     */
+    static int spawn(const char *path, ForkRequest req, int32_t *pPid = nullptr);
+
+private:
+    // Accepted connection with its request still incomplete
+    struct Pending
+    {
+        int fd;
+        size_t received;
+        std::chrono::steady_clock::time_point deadline;
+        ForkRequest req;
+    };
+
+    int m_listen = -1;
+    char *m_path = nullptr;
+    std::vector<std::unique_ptr<Machine>> m_machines;
+    std::vector<Pending> m_pending;
+    std::atomic<bool> m_stop { false };
+    Stats m_stats = { };
+
+    void reap() noexcept;
+    void reject(int fd, int32_t status) noexcept;
+    bool start(const Handler &handler, int fd, const ForkRequest &req);
+    void runChild(const Handler &handler, int fd, const ForkRequest &req) noexcept;
+};
+
+#endif	// FORKSERVER_H
@@ -0,0 +1,71 @@
+/*
+ * Software rendering backend
+ */
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "PPU.h"
+#include <vector>
+
+/*!
+ * Composes PPU output into an in-memory picture of NES palette indices,
+ * for headless use where there is no GPU. Tiles are collected per layer
+ * during the frame and drawn by draw() in layer order over the background
+ * color; pixels of color 0 are transparent, as in the OpenGL backend.
+ */
+class FrameBufferBackend: public PPU::RenderingBackend
+{
+public:
+    static constexpr int WIDTH = 256,
+                         HEIGHT = 240;
+
+    FrameBufferBackend();
+
+    void setBackground(c6502_byte_t color) override;
+    void setSymbol(Layer l, int x, int y, c6502_byte_t colorData[64]) override;
+    void draw() override;
+
+    /// Last complete frame, WIDTH x HEIGHT palette indices (0..63), row by row.
+    /// The pointer only changes with swapPixels(), contents are replaced by every draw().
+    const c6502_byte_t *pixels() const noexcept
+    {
+        return m_pixels.data();
+    }
+
+    /*!
+     * Take the last frame without copying it: @a pixels, which must hold
+     * WIDTH x HEIGHT bytes, becomes the buffer of the next frame and gets
+     * the last one. pixels() is undefined until the next draw().
+     */
+    void swapPixels(std::vector<c6502_byte_t> &pixels) noexcept
+    {
+        assert(pixels.size() == m_pixels.size());
+        m_pixels.swap(pixels);
+    }
+
+    /// NES palette as RGB555 (red in the high bits), indexed by palette index.
+    static const uint16_t *palette() noexcept;
+
+    /// Number of frames drawn.
+    uint64_t frames() const noexcept
+    {
+        return m_nFrames;
+    }
+
+private:
+    struct Tile
+    {
+        int x, y;
+        c6502_byte_t data[64];
+    };
+
+    static constexpr int LAYER_COUNT = 3;
+
+    std::vector<Tile> m_layers[LAYER_COUNT];
+    c6502_byte_t m_background = 0;
+    std::vector<c6502_byte_t> m_pixels;
+    uint64_t m_nFrames = 0;
+};
+
+#endif	// FRAMEBUFFER_H
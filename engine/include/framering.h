@@ -0,0 +1,152 @@
+/*
+ * Publishing of finished frames to other processes through shared memory
+ */
+
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include "common.h"
+#include <atomic>
+#include <cstddef>
+
+class Machine;
+class FrameBufferBackend;
+
+/*!
+ * Layout of the shared memory object, a ring of fixed size slots. Every
+ * slot is guarded by its own sequence counter (seqlock): the writer makes
+ * it odd before touching the slot and even afterwards, so a reader that
+ * sees the same even value before and after reading got consistent data.
+ * The writer never waits for readers; a reader that is too slow finds its
+ * slot overwritten and skips ahead.
+ */
+struct FrameRingLayout
+{
+    static constexpr char MAGIC[4] = { 'B', '1', 'F', 'R' };
+    static constexpr uint32_t VERSION = 1;
+
+    static constexpr uint32_t WIDTH = 256,
+                              HEIGHT = 240,
+                              RAM_SIZE = 0x800,
+                              AUDIO_CAPACITY = 2048;    // Samples per frame
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version,
+                 slotCount,
+                 slotSize;          // Bytes, including the slot header
+        std::atomic<uint64_t> published;    // Frames published so far
+        char padding[40];
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t> seq;  // 2 * n + 2 when frame n is complete, odd while written
+        uint64_t frame;             // Machine frame number
+        uint32_t frameHash,         // CRC32 of the pixels
+                 audioSamples;      // Always 0 for now: no APU
+        char padding[40];
+
+        // Followed by pixels, RAM and audio
+        c6502_byte_t *pixels() noexcept
+        {
+            return reinterpret_cast<c6502_byte_t*>(this + 1);
+        }
+
+        const c6502_byte_t *pixels() const noexcept
+        {
+            return reinterpret_cast<const c6502_byte_t*>(this + 1);
+        }
+
+        const c6502_byte_t *ram() const noexcept
+        {
+            return pixels() + WIDTH * HEIGHT;
+        }
+
+        const int16_t *audio() const noexcept
+        {
+            return reinterpret_cast<const int16_t*>(ram() + RAM_SIZE);
+        }
+    };
+
+    static constexpr uint32_t SLOT_SIZE =
+        (sizeof(Slot) + WIDTH * HEIGHT + RAM_SIZE + AUDIO_CAPACITY * sizeof(int16_t) + 63) & ~63u;
+
+    static size_t totalSize(uint32_t slotCount) noexcept
+    {
+        return sizeof(Header) + static_cast<size_t>(slotCount) * SLOT_SIZE;
+    }
+};
+
+/*!
+ * Creates a POSIX shared memory object (shm_open() name, e.g. "/b1-frames")
+ * and publishes frames into it. Publishing copies the frame once into the
+ * ring and never blocks. The object is unlinked on destruction.
+ */
+class FrameRingWriter
+{
+public:
+    FrameRingWriter(const char *name, uint32_t slotCount = 8);
+    ~FrameRingWriter();
+
+    FrameRingWriter(const FrameRingWriter&) = delete;
+    FrameRingWriter &operator=(const FrameRingWriter&) = delete;
+
+    /// Publish the current frame of @a m; @a fb may be nullptr if nothing is rendered.
+    void publish(const Machine &m, const FrameBufferBackend *fb) noexcept;
+
+    uint64_t published() const noexcept
+    {
+        return m_published;
+    }
+
+private:
+    char *m_name = nullptr;
+    void *m_pMem = nullptr;
+    size_t m_size = 0;
+    FrameRingLayout::Header *m_pHeader = nullptr;
+    uint64_t m_published = 0;
+};
+
+/*!
+ * Read side, for use in other processes. Readers map the ring read-only,
+ * never write to it and are invisible to the writer; any number of them
+ * may follow the same ring.
+ */
+class FrameRingReader
+{
+public:
+    explicit FrameRingReader(const char *name);
+    ~FrameRingReader();
+
+    FrameRingReader(const FrameRingReader&) = delete;
+    FrameRingReader &operator=(const FrameRingReader&) = delete;
+
+    /// Frames published so far; frame n of the ring is in slot n % slotCount().
+    uint64_t published() const noexcept
+    {
+        return m_pHeader->published.load(std::memory_order_acquire);
+    }
+
+    uint32_t slotCount() const noexcept
+    {
+        return m_pHeader->slotCount;
+    }
+
+    /*!
+     * Zero-copy access to published frame @a n: returns the slot in place,
+     * or nullptr if the frame is not published yet, already overwritten or
+     * being written right now. Data read from the slot is only consistent
+     * if valid() confirms it afterwards.
+     */
+    const FrameRingLayout::Slot *slot(uint64_t n) const noexcept;
+    bool valid(const FrameRingLayout::Slot *s, uint64_t n) const noexcept;
+
+private:
+    const void *m_pMem = nullptr;
+    size_t m_size = 0;
+    const FrameRingLayout::Header *m_pHeader = nullptr;
+};
+
+#endif	// FRAMERING_H
@@ -41,6 +41,44 @@ public:
 
     c6502_byte_t readRegister() noexcept;
 
+    /*!
+     * Button states as bit masks: bit N is Button N of the first pad, bit
+     * 8 + N - of the doubled one. Used to record and replay input; light
+     * gun state is not included.
+     */
+    struct Input
+    {
+        uint16_t pressed,
+                 turbo;
+
+        bool operator==(const Input &o) const noexcept
+        {
+            return pressed == o.pressed && turbo == o.turbo;
+        }
+    };
+
+    Input input() const noexcept;
+    void setInput(const Input &in) noexcept;
+
+    /*!
+     * Shift register state, used for save states. Button and light gun states
+     * are frontend input, so they are not part of the snapshot.
+     */
+    struct Snapshot
+    {
+        int ind;
+    };
+
+    void saveState(Snapshot &s) const noexcept
+    {
+        s.ind = m_ind;
+    }
+
+    void loadState(const Snapshot &s) noexcept
+    {
+        m_ind = s.ind;
+    }
+
 private:
     bool m_buttonState[16] = { };
 
@@ -0,0 +1,63 @@
+/*
+ * Memory blocks backed by huge pages
+ */
+
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+
+#include "common.h"
+#include <cstddef>
+
+/// Kind of pages backing a HugePageBlock.
+enum class PageMode
+{
+    Normal,         // Base pages (usually 4K)
+    Transparent,    // Transparent huge pages requested with madvise(MADV_HUGEPAGE)
+    HugeTLB         // Reserved huge pages (MAP_HUGETLB, see vm.nr_hugepages)
+};
+
+const char *pageModeName(PageMode mode) noexcept;
+
+/*!
+ * Anonymous zero-filled mapping for large, long-lived allocations such as
+ * batches of machines, where TLB misses add up. The requested mode is a
+ * preference: HugeTLB falls back to transparent huge pages when no pages
+ * are reserved, Transparent falls back to normal pages when THP is not
+ * available; mode() tells what was obtained. Transparent huge pages are
+ * granted by the kernel at its discretion, so that mode is a request too.
+ */
+class HugePageBlock
+{
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    /// @param size Bytes, rounded up to HUGE_PAGE_SIZE.
+    HugePageBlock(size_t size, PageMode mode);
+    ~HugePageBlock();
+
+    HugePageBlock(const HugePageBlock&) = delete;
+    HugePageBlock &operator=(const HugePageBlock&) = delete;
+
+    /// Start of the block, aligned to HUGE_PAGE_SIZE.
+    void *data() const noexcept
+    {
+        return m_pMem;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    PageMode mode() const noexcept
+    {
+        return m_mode;
+    }
+
+private:
+    void *m_pMem = nullptr;
+    size_t m_size = 0;
+    PageMode m_mode = PageMode::Normal;
+};
+
+#endif	// HUGEPAGES_H
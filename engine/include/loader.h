@@ -93,6 +93,9 @@ public:
      */
     void loadNES(const char *file);
 
+    /// Loads the NES ROM image from a stream, e.g. one over a memory buffer.
+    void loadNES(std::istream &in);
+
     /*!
      * Load a binary file contents as cartridge ROM data.
      * \param file Raw data file path.
@@ -0,0 +1,74 @@
+/*
+ * Determinism checker: two machines running the same input in lockstep
+ */
+
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "common.h"
+#include "cpu6502.h"
+#include <string>
+
+class Machine;
+class Movie;
+
+/*!
+ * Replays a movie on two machines and compares them after every frame:
+ * CRC32 of RAM, OAM, VRAM, WRAM and the CPU registers. Used to validate
+ * that an optimised configuration (another rendering backend, run-ahead,
+ * a restored or cloned state, another build...) emulates exactly like the
+ * reference one.
+ *
+ * Each machine runs on its own thread and only saves its state after a
+ * frame; digests are computed and compared by the calling thread. Machines
+ * may get up to WINDOW frames ahead of the comparison, so checking costs
+ * wall time rather than emulation throughput. The check stops at the first
+ * divergence.
+ */
+class LockstepChecker
+{
+public:
+    static constexpr int WINDOW = 32;
+
+    struct Digest
+    {
+        c6502_d_word_t cpu,
+                       ram,
+                       oam,
+                       vram,
+                       wram;
+
+        bool operator==(const Digest &o) const noexcept
+        {
+            return cpu == o.cpu && ram == o.ram && oam == o.oam &&
+                   vram == o.vram && wram == o.wram;
+        }
+    };
+
+    struct Result
+    {
+        bool diverged;
+        int frames,             // Frames found identical
+            frame;              // First diverged frame (0-based), -1 if none
+        Digest digests[2];      // Digests of the diverged (or last) frame
+        CPU6502::Reg regs[2];
+        std::string report;     // Human readable description of the difference
+    };
+
+    /// Machines must have the ROM of the movies to be checked loaded.
+    LockstepChecker(Machine &a, Machine &b) noexcept:
+        m_machines { &a, &b }
+    {
+    }
+
+    LockstepChecker(const LockstepChecker&) = delete;
+    LockstepChecker &operator=(const LockstepChecker&) = delete;
+
+    /// Play @a movie on both machines from its start state.
+    Result run(const Movie &movie);
+
+private:
+    Machine *m_machines[2];
+};
+
+#endif	// LOCKSTEP_H
@@ -0,0 +1,209 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "bus.h"
+#include "cpu6502.h"
+#include "PPU.h"
+#include "Cartridge.h"
+#include "gamepad.h"
+#include "arena.h"
+#include <cstdint>
+#include <istream>
+#include <new>
+#include <memory>
+#include <vector>
+
+/*!
+ * Complete NES: bus, CPU, PPU, cartridge and two gamepads kept in a single
+ * object. Components are wired to each other by the constructor and never
+ * move, so a Machine is neither copyable nor movable; use clone() or
+ * copyStateFrom() to duplicate a running machine.
+ *
+ * All mutable state lives in the object itself: the mapper and its RAM
+ * banks are placed in an arena at its end (large cartridges spill over to
+ * the heap), only immutable ROM banks are kept outside and shared between
+ * clones. Machines are cache line aligned. The CPU, PPU and gamepad state
+ * comes first and fills a few cache lines, then the bus registers, RAM and
+ * sprite memory; the 16K of video memory and cartridge RAM follow them.
+ */
+class Machine
+{
+public:
+    /// Arena size: mapper object, CHR-RAM and one 8K RAM bank.
+    static constexpr size_t ARENA_SIZE = 17 * 1024;
+
+    /// @param pBackend Rendering backend, nullptr for a machine that draws nothing.
+    explicit Machine(OutputMode mode, PPU::RenderingBackend *pBackend = nullptr);
+
+    Machine(const Machine&) = delete;
+    Machine &operator=(const Machine&) = delete;
+
+    // Cache line aligned, plain new guarantees less before C++17. The
+    // address of the block goes in front of the object: compilers pair a
+    // posix_memalign() result passed back to free() with the wrong operator
+    // new once only one of the two is inlined
+    static void *operator new(size_t size)
+    {
+        static_assert(alignof(Machine) >= sizeof(void*), "no room for the block address");
+        void *block = ::operator new(size + alignof(Machine));
+        const uintptr_t p = (reinterpret_cast<uintptr_t>(block) + alignof(Machine)) &
+                            ~static_cast<uintptr_t>(alignof(Machine) - 1u);
+        reinterpret_cast<void**>(p)[-1] = block;
+        return reinterpret_cast<void*>(p);
+    }
+
+    static void operator delete(void *p) noexcept
+    {
+        if (p)
+            ::operator delete(static_cast<void**>(p)[-1]);
+    }
+
+    /// Load NES ROM and power the machine on.
+    void loadNES(const char *file);
+    void loadNES(std::istream &in);
+
+    /// Load raw program data (see ROMLoader::loadRawData) and power the machine on.
+    void loadRawData(std::istream &in);
+
+    bool isReady() const noexcept
+    {
+        return m_bus.getCartrige() != nullptr;
+    }
+
+    /// Reset button: restart the CPU, memory is kept.
+    void reset();
+
+    /// Power cycle: clear memory and restart.
+    void power();
+
+    /// Emulate and present one frame; with run-ahead on, see setRunAhead().
+    void runFrame();
+
+    /*!
+     * Run-ahead hides game-internal input lag: after the real frame is
+     * emulated (without rendering) and saved, @a frames more frames are
+     * emulated with the same input, the last of them is presented and the
+     * saved state is restored. Hidden frames skip rendering entirely.
+     * @param frames Number of frames to run ahead, 0 disables run-ahead.
+     */
+    void setRunAhead(int frames) noexcept
+    {
+        assert(frames >= 0);
+        m_runAhead = frames;
+    }
+
+    int runAhead() const noexcept
+    {
+        return m_runAhead;
+    }
+
+    /// Time spent on run-ahead on top of the real frame emulation.
+    struct RunAheadStats
+    {
+        double lastOverheadUs,  // Previous frame
+               avgOverheadUs;   // Exponential average
+    };
+
+    const RunAheadStats &runAheadStats() const noexcept
+    {
+        return m_runAheadStats;
+    }
+
+    /*!
+     * New machine with the same cartridge and a copy of the current state.
+     * ROM banks are shared, only mutable state is copied.
+     * @param pBackend Rendering backend of the clone, nullptr to draw nothing.
+     */
+    std::unique_ptr<Machine> clone(PPU::RenderingBackend *pBackend = nullptr) const;
+
+    /*!
+     * Same as clone(), constructing the copy at @a mem: sizeof(Machine)
+     * bytes aligned to alignof(Machine), e.g. part of a HugePageBlock.
+     * The copy must be destroyed by calling ~Machine() directly.
+     */
+    Machine *cloneAt(void *mem, PPU::RenderingBackend *pBackend = nullptr) const;
+
+    /*!
+     * Make this machine an exact copy of @a src, which must have been cloned
+     * from this one (or vice versa). Does not allocate, so it is the fast way
+     * to reset a pool of machines to a common state.
+     */
+    void copyStateFrom(const Machine &src) noexcept
+    {
+        m_bus.copyStateFrom(src.m_bus);
+    }
+
+    Bus &bus() noexcept
+    {
+        return m_bus;
+    }
+
+    const Bus &bus() const noexcept
+    {
+        return m_bus;
+    }
+
+    CPU6502 &cpu() noexcept
+    {
+        return m_cpu;
+    }
+
+    PPU &ppu() noexcept
+    {
+        return m_ppu;
+    }
+
+    Cartrige &cartrige() noexcept
+    {
+        return m_cart;
+    }
+
+    Gamepad &gamepad(int n) noexcept
+    {
+        assert(n >= 0 && n < 2);
+        return m_pads[n];
+    }
+
+private:
+    // Backend of machines that are not displayed. Backends point back to
+    // their PPU, so every machine has its own, and it must be created first
+    class NullBackend: public PPU::RenderingBackend
+    {
+    public:
+        void setBackground(c6502_byte_t) override
+        {
+        }
+
+        void setSymbol(Layer, int, int, c6502_byte_t[64]) override
+        {
+        }
+
+        void draw() override
+        {
+        }
+    };
+
+    NullBackend m_nullBackend;
+
+    // Hottest state first, ahead of the large bus memories; connect() wires
+    // the units to the bus, so they don't depend on its construction order
+    CPU6502 m_cpu;
+    PPU m_ppu;
+    Gamepad m_pads[2];
+    Bus m_bus;
+    Arena m_arena;
+    Cartrige m_cart;
+
+    int m_runAhead = 0;
+    std::vector<c6502_byte_t> m_runAheadState;
+    RunAheadStats m_runAheadStats = { };
+
+    // Memory of m_arena, last: mostly untouched for cartridges without RAM
+    alignas(Arena::ALIGNMENT) c6502_byte_t m_arenaMem[ARENA_SIZE];
+
+    Machine(const Machine &src, PPU::RenderingBackend *pBackend);
+
+    void connect() noexcept;
+};
+
+#endif
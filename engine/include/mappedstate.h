@@ -0,0 +1,55 @@
+/*
+ * Save state files restored straight from a memory mapping
+ */
+
+#ifndef MAPPEDSTATE_H
+#define MAPPEDSTATE_H
+
+#include "common.h"
+
+class Bus;
+
+/*!
+ * Read-only memory mapping of a save state file.
+ *
+ * The file is a regular state blob (see state.h) with sections of
+ * FILE_ALIGN bytes or more starting at page boundaries, and a CRC32 for
+ * every section in the header. Checksums are verified once when the file
+ * is mapped; restoring is then the same set of memcpy() calls as loading
+ * an in-memory state. All instances restored from one MappedState share
+ * the mapped pages, so seeding many machines reads the file only once.
+ */
+class MappedState
+{
+public:
+    static constexpr uint32_t FILE_ALIGN = 4096;     // Page size
+
+    /// Save the current state of @a bus in the mappable layout.
+    static void write(const Bus &bus, const char *file);
+
+    /// Map @a file and verify it; throws on I/O errors and corrupted files.
+    explicit MappedState(const char *file);
+    ~MappedState();
+
+    MappedState(const MappedState&) = delete;
+    MappedState &operator=(const MappedState&) = delete;
+
+    /// Load the mapped state into @a bus.
+    void restore(Bus &bus) const;
+
+    const c6502_byte_t *data() const noexcept
+    {
+        return m_pData;
+    }
+
+    c6502_d_word_t size() const noexcept
+    {
+        return m_size;
+    }
+
+private:
+    const c6502_byte_t *m_pData = nullptr;
+    c6502_d_word_t m_size = 0;
+};
+
+#endif	// MAPPEDSTATE_H
@@ -8,12 +8,24 @@ class DefaultMapper: public Mapper
 public:
     using Mapper::Mapper;
 
+    DefaultMapper(const DefaultMapper &src, Arena *pArena):
+        Mapper { src, pArena }
+    {
+    }
+
+    Mapper *clone(Arena *pArena) const override
+    {
+        return new (pArena) DefaultMapper { *this, pArena };
+    }
+
     c6502_byte_t readROM(c6502_word_t addr) override;
 
     c6502_byte_t readRAM(c6502_word_t addr) override;
 
     c6502_byte_t readVROM(c6502_word_t addr) override;
 
+    void writeVROM(c6502_word_t addr, c6502_byte_t val) override;
+
     /* N.B.: some addresses control mapper behaviour (i. e.
      * force bank switching) so, despite the memory itself is r/o,
      * this operation with the mapper is legal.
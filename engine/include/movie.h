@@ -0,0 +1,161 @@
+/*
+ * Input movies: deterministic recording and playback of gamepad input
+ */
+
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "common.h"
+#include "gamepad.h"
+#include <istream>
+#include <ostream>
+#include <vector>
+
+class Machine;
+
+/*!
+ * Start state of the machine followed by the gamepad input of every frame.
+ * Emulation depends only on the machine state and the input (turbo buttons
+ * are timed by the frame counter), so replaying a movie on the same ROM
+ * reproduces the recorded session exactly.
+ *
+ * File format, integers are 32-bit little endian:
+ *   "B1MV" <version> <ROM hash> <frame count>
+ *   <state size> <state blob (see state.h)>
+ *   <frame data size> <frame data>
+ * Frame data is a sequence of FRAME_RECORD_SIZE byte records: event flags,
+ * then pressed and turbo masks of both gamepads. Each record is XORed with
+ * the previous one and the result is run-length encoded (see DeltaCodec),
+ * so frames with unchanged input take almost no space.
+ */
+class Movie
+{
+public:
+    static constexpr c6502_d_word_t VERSION = 1,
+                                    FRAME_RECORD_SIZE = 9;
+
+    /// Actions taken before the frame input is applied
+    enum Event: c6502_byte_t
+    {
+        RESET = 1,
+        POWER = 2
+    };
+
+    struct Frame
+    {
+        c6502_byte_t events;
+        Gamepad::Input pads[2];
+    };
+
+    c6502_d_word_t romHash() const noexcept
+    {
+        return m_romHash;
+    }
+
+    const std::vector<c6502_byte_t> &startState() const noexcept
+    {
+        return m_startState;
+    }
+
+    const std::vector<Frame> &frames() const noexcept
+    {
+        return m_frames;
+    }
+
+    int length() const noexcept
+    {
+        return static_cast<int>(m_frames.size());
+    }
+
+    /*!
+     * 64-bit FNV-1a hash of the start state and the input of the first
+     * @a frames frames: movies with equal prefix hashes (and ROM) reach
+     * the same state after that many frames.
+     */
+    uint64_t prefixHash(int frames) const noexcept;
+
+    void save(const char *file) const;
+    void save(std::ostream &out) const;
+
+    void load(const char *file);
+    void load(std::istream &in);
+
+private:
+    c6502_d_word_t m_romHash = 0;
+    std::vector<c6502_byte_t> m_startState;
+    std::vector<Frame> m_frames;
+
+    friend class MovieRecorder;
+};
+
+/*!
+ * Records a movie starting from the current machine state. Input is taken
+ * from the machine gamepads, so the frontend keeps feeding button events
+ * to them as usual, but must run frames, reset and power cycle the machine
+ * through the recorder.
+ */
+class MovieRecorder
+{
+public:
+    /// Discards previous contents of @a movie.
+    MovieRecorder(Machine &m, Movie &movie);
+
+    MovieRecorder(const MovieRecorder&) = delete;
+    MovieRecorder &operator=(const MovieRecorder&) = delete;
+
+    void reset();
+    void power();
+
+    /// Record current gamepad input and emulate one frame.
+    void runFrame();
+
+private:
+    Machine &m_machine;
+    Movie &m_movie;
+    c6502_byte_t m_events = 0;
+};
+
+/*!
+ * Replays a movie. Playback overwrites the machine state and gamepad input;
+ * nothing throttles it, so with a null rendering backend frames are
+ * emulated as fast as the host allows.
+ */
+class MoviePlayer
+{
+public:
+    /// Loads the movie start state into @a m, which must run the same ROM.
+    MoviePlayer(Machine &m, const Movie &movie);
+
+    MoviePlayer(const MoviePlayer&) = delete;
+    MoviePlayer &operator=(const MoviePlayer&) = delete;
+
+    /// Emulate the next frame of the movie; false if the movie has ended.
+    bool runFrame();
+
+    /// Play till the end.
+    void run();
+
+    /// Continue at @a frame; the machine must already be in the state reached there.
+    void skipTo(int frame) noexcept
+    {
+        assert(frame >= 0 && frame <= m_movie.length());
+        m_pos = frame;
+    }
+
+    int position() const noexcept
+    {
+        return m_pos;
+    }
+
+    bool atEnd() const noexcept
+    {
+        return m_pos >= m_movie.length();
+    }
+
+private:
+    Machine &m_machine;
+    const Movie &m_movie;
+    int m_pos = 0;
+};
+
+#endif	// MOVIE_H
@@ -0,0 +1,155 @@
+/*
+ * Rollback netplay
+ */
+
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "common.h"
+#include "gamepad.h"
+#include <vector>
+
+class Machine;
+class Transport;
+
+/*!
+ * Two-player session with rollback. Each peer emulates the whole machine
+ * and runs ahead of the remote input: missing remote input is predicted as
+ * a repetition of the last received one. When the real input arrives and
+ * differs from the prediction, the machine is restored to the state saved
+ * before the first mispredicted frame and the frames up to the current one
+ * are emulated again without rendering.
+ *
+ * Local input is delayed by Config::inputDelay frames, which hides that
+ * much network latency without any rollbacks. If the remote input lags by
+ * more than Config::maxRollback frames, the session stalls until it
+ * arrives.
+ *
+ * Both machines must start from the same state (e.g. both freshly powered
+ * on with the same ROM, see Machine::power()).
+ *
+ * Every datagram carries all local input not yet acknowledged by the peer,
+ * so lost datagrams need no retransmission:
+ *   <'B' '1' 'N'> <ack: u32> <first frame: u32> <count: u8> <count x 4 bytes>
+ * where ack is the last frame of the peer input received so far; integers
+ * are little endian, inputs are Gamepad::Input pressed and turbo masks.
+ */
+class RollbackSession
+{
+public:
+    struct Config
+    {
+        int inputDelay,     // Frames, up to MAX_INPUT_DELAY
+            maxRollback;    // Frames, 1 ~ MAX_ROLLBACK
+    };
+
+    static constexpr int MAX_INPUT_DELAY = 30,
+                         MAX_ROLLBACK = 60;
+    static constexpr Config DEFAULT_CONFIG = { 2, 8 };
+
+    /*!
+     * @param localPlayer Gamepad controlled by this peer (0 or 1); the peer
+     * must use the other one.
+     */
+    RollbackSession(Machine &m,
+                    Transport &transport,
+                    int localPlayer,
+                    const Config &cfg = DEFAULT_CONFIG);
+
+    RollbackSession(const RollbackSession&) = delete;
+    RollbackSession &operator=(const RollbackSession&) = delete;
+
+    /*!
+     * Exchange input with the peer and emulate one frame.
+     * \return false if the session is stalled waiting for the remote input:
+     * no frame was emulated and @a local was not consumed, it must be
+     * passed again on the next call.
+     */
+    bool runFrame(const Gamepad::Input &local);
+
+    /// Send pending input and process received datagrams without emulating.
+    void poll();
+
+    /// Frames emulated so far
+    int frame() const noexcept
+    {
+        return m_frame;
+    }
+
+    /// Last frame with the remote input known for certain
+    int confirmedFrame() const noexcept
+    {
+        return m_remoteConfirmed;
+    }
+
+    /*!
+     * True if every emulated frame used the real remote input, i.e. peers
+     * that emulated the same number of frames are in the same state.
+     */
+    bool isSynchronized() const noexcept
+    {
+        return m_remoteConfirmed >= m_frame - 1 && m_rollbackFrom < 0;
+    }
+
+    struct Stats
+    {
+        int frames,             // Presented frames
+            stalls,             // runFrame() calls that emulated nothing
+            rollbacks,
+            resimulatedFrames,
+            maxRollbackDepth;
+        double lastFrameUs,     // Emulation time of the last frame, re-simulation included
+               avgFrameUs,      // Exponential average of the above
+               avgRollbackUs;   // Average cost of a rollback
+
+        double avgRollbackDepth() const noexcept
+        {
+            return rollbacks > 0 ? static_cast<double>(resimulatedFrames) / rollbacks : 0.0;
+        }
+    };
+
+    const Stats &stats() const noexcept
+    {
+        return m_stats;
+    }
+
+private:
+    // Input history, indexed by frame modulo HISTORY
+    static constexpr int HISTORY = 256;
+
+    Machine &m_machine;
+    Transport &m_transport;
+    const Config m_cfg;
+    const int m_localPlayer;
+
+    int m_frame = 0;                // Next frame to emulate
+    int m_localLast;                // Last frame with the local input set
+    int m_remoteConfirmed;          // Last frame with the remote input received
+    int m_remoteAck;                // Last frame of the local input the peer has
+    int m_rollbackFrom = -1;        // First mispredicted frame, -1 if none
+
+    Gamepad::Input m_localInput[HISTORY],
+                   m_remoteInput[HISTORY],
+                   m_usedRemote[HISTORY];   // Actually emulated, maybe predicted
+
+    // Machine states before the last maxRollback + 1 frames (the oldest
+    // one a rollback may start from), indexed by frame modulo maxRollback + 1
+    std::vector<c6502_byte_t> m_states;
+    c6502_d_word_t m_stateSize;
+
+    Stats m_stats = { };
+
+    void sendInput();
+    void receiveInput();
+    void rollback();
+    void emulate(int frame, bool render);
+
+    const Gamepad::Input &remoteInput(int frame) const noexcept;
+
+    c6502_byte_t *state(int frame) noexcept
+    {
+        return m_states.data() + (frame % (m_cfg.maxRollback + 1)) * m_stateSize;
+    }
+};
+
+#endif	// NETPLAY_H
@@ -0,0 +1,84 @@
+/*
+ * Reduced grayscale frames for learning agents
+ */
+
+#ifndef OBSERVATION_H
+#define OBSERVATION_H
+
+#include "common.h"
+#include <vector>
+
+/*!
+ * Turns pictures of FrameBufferBackend (palette indices) into small
+ * grayscale observations, e.g. 84x84 or 128x120, in one pass: palette
+ * indices go through a luma table, are summed per column over the source
+ * rows of an output row, and every output pixel is the rounded mean of its
+ * box of source pixels, taken from prefix sums of the column sums.
+ * The lookup is scalar, the sums use SSE2 where available.
+ * Boxes partition the picture, so every source pixel counts exactly once.
+ *
+ * With max-pooling on, each output pixel is the maximum of the current and
+ * the previous observation, which hides sprite flicker.
+ */
+class Observer
+{
+public:
+    /// @param width, height Output size, up to the picture size (256x240).
+    Observer(int width, int height, bool maxPool = false);
+
+    /*!
+     * @param pixels Picture, see FrameBufferBackend::pixels().
+     * @param out Caller buffer of width() * height() bytes, rows without padding.
+     */
+    void observe(const c6502_byte_t *pixels, c6502_byte_t *out) noexcept;
+
+    /// Forget the previous frame (e.g. after a reset), used by max-pooling.
+    void reset() noexcept
+    {
+        m_hasPrev = false;
+    }
+
+    int width() const noexcept
+    {
+        return m_width;
+    }
+
+    int height() const noexcept
+    {
+        return m_height;
+    }
+
+    bool maxPool() const noexcept
+    {
+        return m_maxPool;
+    }
+
+    /// Luma (0..255) of the NES palette colors, indexed by palette index.
+    static const c6502_byte_t *lumaTable() noexcept;
+
+private:
+    const int m_width,
+              m_height;
+    const bool m_maxPool;
+    bool m_hasPrev = false;
+
+    // Box boundaries: output column x covers source columns m_cols[x] .. m_cols[x + 1] - 1
+    std::vector<int> m_cols,
+                     m_rows;
+    // 2^24 / box area, indexed by area
+    std::vector<uint32_t> m_recip;
+    std::vector<c6502_byte_t> m_prev;
+
+    // Luma of one source row
+    alignas(16) c6502_byte_t m_luma[256];
+    // Column sums of the source rows of the current output row: at most
+    // 240 rows of 255 fit 16 bits
+    alignas(16) uint16_t m_rowSum[256];
+    // m_prefix[x]: sum of the column sums left of x, box sums are differences
+    alignas(16) uint32_t m_prefix[256 + 4];
+
+    void sumRows(const c6502_byte_t *src, int rows) noexcept;
+    void prefixSums() noexcept;
+};
+
+#endif	// OBSERVATION_H
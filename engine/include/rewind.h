@@ -0,0 +1,129 @@
+/*
+ * Rewind support: history of compressed machine snapshots
+ */
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "common.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class Bus;
+
+/*!
+ * Keeps the history of machine states in a fixed-size ring buffer.
+ *
+ * A snapshot is taken every Config::interval frames and stored as the XOR
+ * delta against the previous one (see DeltaCodec), every
+ * Config::keyframeInterval-th snapshot is stored as a run-length encoded
+ * keyframe. Rewinding walks the history backwards: XOR delta applied to a
+ * state gives the previous state, so a step back costs one delta decode
+ * except for keyframes, which are unwound by replaying deltas from the
+ * preceding keyframe. The oldest entries are dropped when the buffer is full.
+ *
+ * With Config::threaded set, the emulation thread only copies the machine
+ * state, compression is done by a helper thread. A snapshot arriving while
+ * the previous one is still being compressed is skipped rather than
+ * stalling the emulation. On a single CPU the snapshots are compressed
+ * right away instead, which costs less than switching to the helper.
+ */
+class RewindBuffer
+{
+public:
+    struct Config
+    {
+        c6502_d_word_t capacity;    // Bytes for compressed snapshots
+        int maxEntries,             // Limit on the number of snapshots
+            interval,               // Frames between snapshots
+            keyframeInterval;       // Snapshots between keyframes
+        bool threaded;
+    };
+
+    static constexpr Config DEFAULT_CONFIG = {
+        16u * 1024u * 1024u,
+        8192,
+        1,
+        120,
+        true
+    };
+
+    explicit RewindBuffer(Bus &bus, const Config &cfg = DEFAULT_CONFIG);
+    ~RewindBuffer();
+
+    RewindBuffer(const RewindBuffer&) = delete;
+    RewindBuffer &operator=(const RewindBuffer&) = delete;
+
+    /// Must be called after each emulated frame.
+    void onFrame();
+
+    /// Restore the most recent snapshot and drop it from the history.
+    /// @return false if the history is empty.
+    bool rewind();
+
+    /// Drop the whole history.
+    void clear();
+
+    /// Number of snapshots available for rewinding.
+    int length() const;
+
+    /// Bytes of the ring buffer occupied by compressed snapshots.
+    c6502_d_word_t memoryUsed() const;
+
+    /// Number of snapshots skipped because the helper thread was busy.
+    int skippedSnapshots() const noexcept
+    {
+        return m_nSkipped;
+    }
+
+private:
+    struct Entry
+    {
+        c6502_d_word_t offset,
+                       size;
+        bool keyframe;
+    };
+
+    Bus &m_bus;
+    const Config m_cfg;
+
+    // Compressed snapshots and their descriptors, both are circular
+    std::vector<c6502_byte_t> m_data;
+    std::vector<Entry> m_entries;
+    int m_first = 0,
+        m_count = 0;
+    c6502_d_word_t m_head = 0;
+
+    // Newest state (uncompressed) and the one waiting for compression
+    std::vector<c6502_byte_t> m_current,
+                              m_pending;
+    std::vector<c6502_byte_t> m_encoded;
+    int m_sinceKeyframe = 0,
+        m_frameCounter = 0,
+        m_nSkipped = 0;
+
+    // Helper thread
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_cv;
+    bool m_hasPending = false,
+         m_stop = false;
+
+    void workerLoop();
+    void store();
+    void waitIdle(std::unique_lock<std::mutex> &lock) const;
+
+    Entry &entry(int i) noexcept
+    {
+        return m_entries[(m_first + i) % m_entries.size()];
+    }
+
+    void evictOldest() noexcept;
+    void append(const std::vector<c6502_byte_t> &enc, bool keyframe);
+    bool unwindNewest();
+    void resetHistory() noexcept;
+};
+
+#endif	// REWIND_H
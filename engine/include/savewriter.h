@@ -0,0 +1,101 @@
+/*
+ * Background writing of save state files
+ */
+
+#ifndef SAVEWRITER_H
+#define SAVEWRITER_H
+
+#include "common.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Bus;
+
+/*!
+ * Writes save state files without stalling the emulation. save() only
+ * copies the machine state to memory (well under a microsecond); a helper
+ * thread compresses it and writes the file, which may take tens of
+ * milliseconds on slow flash.
+ *
+ * Files are replaced atomically: the data goes to a temporary file with a
+ * unique name ("<file>.XXXXXX", see mkstemp()), which is synced and renamed
+ * over the target, so a crash or power loss leaves either the old or the
+ * new save, never a truncated one, and processes saving the same file
+ * don't disturb each other.
+ *
+ * File format, integers are 32-bit little endian:
+ *   "B1SZ" <state size> <CRC32 of the state> <run-length encoded state>
+ * (see DeltaCodec; the state is encoded against zeroes).
+ */
+class SaveStateWriter
+{
+public:
+    static constexpr int DEFAULT_MAX_QUEUED = 4;
+
+    /// @param maxQueued Saves that may wait for writing at the same time.
+    explicit SaveStateWriter(int maxQueued = DEFAULT_MAX_QUEUED);
+
+    /// Writes all queued saves before returning.
+    ~SaveStateWriter();
+
+    SaveStateWriter(const SaveStateWriter&) = delete;
+    SaveStateWriter &operator=(const SaveStateWriter&) = delete;
+
+    /*!
+     * Capture the machine state and queue it for writing to @a file.
+     * A queued save to the same file which hasn't been started yet is
+     * replaced by this one.
+     * \return false if the queue is full; the save is dropped.
+     */
+    bool save(const Bus &bus, const std::string &file);
+
+    /// Wait until all queued saves are written.
+    void flush();
+
+    struct Stats
+    {
+        int written,
+            failed,
+            dropped,            // Rejected by save(), queue was full
+            coalesced;          // Replaced by a newer save to the same file
+        double lastWriteMs,     // Compression and I/O of the last save
+               maxWriteMs;
+    };
+
+    Stats stats() const;
+
+    /// Description of the last failed write, empty if none.
+    std::string lastError() const;
+
+    /// Read a file written by SaveStateWriter, the result is ready for Bus::loadState().
+    static void readFile(const char *file, std::vector<c6502_byte_t> &state);
+
+private:
+    struct Job
+    {
+        std::string file;
+        std::vector<c6502_byte_t> state;
+    };
+
+    const int m_maxQueued;
+
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Job> m_queue;
+    std::vector<std::vector<c6502_byte_t>> m_freeBuffers;
+    bool m_busy = false,
+         m_stop = false;
+
+    Stats m_stats = { };
+    std::string m_lastError;
+
+    void workerLoop();
+    static void writeFile(const std::string &file, const std::vector<c6502_byte_t> &state);
+};
+
+#endif	// SAVEWRITER_H
@@ -0,0 +1,81 @@
+/*
+ * Machine state snapshot (save state) layout
+ */
+
+#ifndef STATE_H
+#define STATE_H
+
+#include "common.h"
+
+/*!
+ * Upper bound of a state blob: the bus memories, CHR-RAM and as many 8K
+ * PRG-RAM banks as an iNES header can declare, with room for the header
+ * and alignment. Readers check sizes from files against it before
+ * allocating for them.
+ */
+constexpr c6502_d_word_t MAX_STATE_SIZE = 0x10000u + (3 + 1 + 255) * 0x2000u;
+
+/*!
+ * Header of the binary machine state blob produced by Bus::saveState().
+ *
+ * The blob consists of the header followed by a fixed set of sections, each
+ * one aligned to SECTION_ALIGN bytes. Sections are plain memory images, so
+ * saving and restoring is a sequence of memcpy() calls. Section offsets are
+ * stored in the header; readers must use them instead of assuming that the
+ * sections are packed.
+ */
+struct StateHeader
+{
+    enum Section
+    {
+        CORE,           // CPU, PPU, gamepads and bus registers
+        RAM,            // Internal RAM, 0x800 bytes
+        SPRITE_MEM,     // OAM, 256 bytes
+        VRAM,           // Name tables and palettes, 0x2000 bytes
+        WRAM,           // Cartridge RAM at 0x6000, 0x2000 bytes
+        MAPPER,         // Mapper registers and cartridge-side RAM, variable
+        SECTION_COUNT
+    };
+
+    struct Region
+    {
+        uint32_t offset,
+                 size,
+                 crc;       // CRC32 of the section contents, 0 if not computed
+    };
+
+    static constexpr uint32_t VERSION = 1,
+                              SECTION_ALIGN = 64;
+
+    char magic[4];
+    uint32_t version,
+             size;          // Total blob size including the header
+    Region sections[SECTION_COUNT];
+
+    /*!
+     * Fill in the magic, version and packed section layout.
+     * @param largeAlign Sections of at least this size start at a multiple
+     * of it (e.g. page size for files mapped into memory).
+     */
+    void init(const uint32_t (&sizes)[SECTION_COUNT], uint32_t largeAlign = SECTION_ALIGN) noexcept;
+
+    /// Check the magic, version and that all sections fit in @a blobSize bytes.
+    bool checkValid(c6502_d_word_t blobSize) const noexcept;
+
+    /// Fill in CRCs of all sections of the blob @a p starts with.
+    void computeCRCs(const c6502_byte_t *p) noexcept;
+
+    /*!
+     * Check section CRCs of the blob @a p. Sections without CRC are
+     * skipped unless @a required is set; then every CRC field must match,
+     * so a zeroed one is caught too.
+     */
+    bool checkCRCs(const c6502_byte_t *p, bool required = false) const noexcept;
+
+    static constexpr uint32_t align(uint32_t v, uint32_t a = SECTION_ALIGN) noexcept
+    {
+        return (v + a - 1u) / a * a;
+    }
+};
+
+#endif	// STATE_H
@@ -1,4 +1,4 @@
-/* 
+/*
  * Implements memory (RAM/ROM) objects
  */
 
@@ -9,45 +9,155 @@
 #include <cstring>
 #include <cassert>
 
-template <c6502_d_word_t SIZE>
-class Storage
+/// Storage policy: writes are not tracked.
+struct NoTracking
+{
+    template <c6502_d_word_t SIZE>
+    class Map
+    {
+    protected:
+        void markDirty(c6502_d_word_t) noexcept
+        {
+        }
+
+        void markDirty(c6502_d_word_t, c6502_d_word_t) noexcept
+        {
+        }
+    };
+};
+
+/*!
+ * Storage policy: keeps a bitmap with one bit per BLOCK bytes, set on every
+ * write to the block. Used to copy only the modified memory when updating
+ * snapshots.
+ */
+template <c6502_d_word_t BLOCK>
+struct DirtyBlocks
+{
+    template <c6502_d_word_t SIZE>
+    class Map
+    {
+        static_assert(SIZE % BLOCK == 0, "storage size must be a multiple of the block size");
+
+    public:
+        static constexpr c6502_d_word_t BLOCK_SIZE = BLOCK,
+                                        BLOCK_COUNT = SIZE / BLOCK;
+
+        bool isDirty(c6502_d_word_t block) const noexcept
+        {
+            assert(block < BLOCK_COUNT);
+            return (m_bits[block / 64] >> (block % 64)) & 1u;
+        }
+
+        void clearDirty() noexcept
+        {
+            memset(m_bits, 0, sizeof(m_bits));
+        }
+
+        /// Call f(offset, length) for each run of adjacent dirty blocks.
+        template <typename F>
+        void forEachDirty(F f) const
+        {
+            c6502_d_word_t b = 0;
+            while (b < BLOCK_COUNT)
+            {
+                if (!isDirty(b))
+                {
+                    b++;
+                    continue;
+                }
+
+                const auto first = b;
+                while (b < BLOCK_COUNT && isDirty(b))
+                    b++;
+                f(first * BLOCK, (b - first) * BLOCK);
+            }
+        }
+
+    protected:
+        void markDirty(c6502_d_word_t addr) noexcept
+        {
+            const auto block = addr / BLOCK;
+            m_bits[block / 64] |= static_cast<uint64_t>(1u) << (block % 64);
+        }
+
+        void markDirty(c6502_d_word_t addr, c6502_d_word_t count) noexcept
+        {
+            if (count == 0)
+                return;
+            for (auto b = addr / BLOCK; b <= (addr + count - 1) / BLOCK; b++)
+                m_bits[b / 64] |= static_cast<uint64_t>(1u) << (b % 64);
+        }
+
+    private:
+        uint64_t m_bits[(BLOCK_COUNT + 63) / 64] = { };
+    };
+};
+
+template <c6502_d_word_t SIZE, class TRACKING = NoTracking>
+class Storage: public TRACKING::template Map<SIZE>
 {
 public:
     c6502_byte_t Read(c6502_word_t addr) const noexcept;
+    void Read(c6502_word_t addr, c6502_byte_t *dest, c6502_d_word_t count) const noexcept;
 
     void Write(c6502_word_t addr, c6502_byte_t val) noexcept;
     void Write(c6502_word_t addr, const c6502_byte_t *beg, c6502_d_word_t count) noexcept;
 
+    /// Copy contents of another storage of the same size.
+    template <class T>
+    void Assign(const Storage<SIZE, T> &src) noexcept
+    {
+        src.Read(0, m_mem, SIZE);
+        this->markDirty(0, SIZE);
+    }
+
+    /// Read-only view of the whole contents (SIZE bytes).
+    const c6502_byte_t *Data() const noexcept
+    {
+        return m_mem;
+    }
+
     void Clear() noexcept
     {
         memset(m_mem, 0, SIZE);
+        this->markDirty(0, SIZE);
     }
 
 private:
     c6502_byte_t m_mem[SIZE];
 };
 
-template <c6502_d_word_t SIZE>
-c6502_byte_t Storage<SIZE>::Read(c6502_word_t addr) const noexcept
+template <c6502_d_word_t SIZE, class TRACKING>
+c6502_byte_t Storage<SIZE, TRACKING>::Read(c6502_word_t addr) const noexcept
 {
     assert(addr < SIZE);
     return m_mem[addr];
 }
 
-template <c6502_d_word_t SIZE>
-void Storage<SIZE>::Write(c6502_word_t addr, c6502_byte_t val) noexcept
+template <c6502_d_word_t SIZE, class TRACKING>
+void Storage<SIZE, TRACKING>::Read(c6502_word_t addr, c6502_byte_t *dest, c6502_d_word_t count) const noexcept
+{
+    assert(addr < SIZE);
+    assert(count <= SIZE - addr);
+    memcpy(dest, m_mem + addr, count);
+}
+
+template <c6502_d_word_t SIZE, class TRACKING>
+void Storage<SIZE, TRACKING>::Write(c6502_word_t addr, c6502_byte_t val) noexcept
 {
     assert(addr < SIZE);
     m_mem[addr] = val;
+    this->markDirty(addr);
 }
 
-template <c6502_d_word_t SIZE>
-void Storage<SIZE>::Write(c6502_word_t addr, const c6502_byte_t* beg, c6502_d_word_t count) noexcept
+template <c6502_d_word_t SIZE, class TRACKING>
+void Storage<SIZE, TRACKING>::Write(c6502_word_t addr, const c6502_byte_t* beg, c6502_d_word_t count) noexcept
 {
     assert(count <= SIZE);
     assert(addr < SIZE);
     memcpy(m_mem + addr, beg, count);
+    this->markDirty(addr, count);
 }
 
 #endif	// STORAGE_H
-
@@ -0,0 +1,137 @@
+/*
+ * Datagram transports for netplay
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "common.h"
+#include <map>
+#include <mutex>
+#include <random>
+#include <vector>
+
+/*!
+ * Unreliable datagram channel to a single peer. Datagrams may be lost,
+ * duplicated or reordered; the protocol on top deals with that. Both
+ * operations never block.
+ */
+class Transport
+{
+public:
+    static constexpr c6502_d_word_t MAX_DATAGRAM = 1024;
+
+    virtual ~Transport() = default;
+
+    virtual void send(const c6502_byte_t *p, c6502_d_word_t size) = 0;
+
+    /*!
+     * Fetch the next received datagram.
+     * \return Datagram size, 0 if nothing has arrived. Datagrams longer than
+     * @a maxSize are truncated.
+     */
+    virtual c6502_d_word_t receive(c6502_byte_t *buf, c6502_d_word_t maxSize) = 0;
+};
+
+/*!
+ * In-process link between two endpoints with configurable latency, jitter
+ * and loss, used to run and measure netplay sessions without a network.
+ * Time is simulated: datagrams are delivered only as the link clock is
+ * moved by advanceTime(), which keeps runs reproducible and independent
+ * of the host speed. Endpoints may be used from different threads.
+ */
+class LoopbackLink
+{
+public:
+    struct Conditions
+    {
+        double latencyMs,   // One-way delay
+               jitterMs,    // Uniformly distributed extra delay, reorders datagrams
+               lossRate;    // Probability of a datagram to be dropped
+        unsigned seed;
+    };
+
+    static constexpr Conditions PERFECT = { 0.0, 0.0, 0.0, 1u };
+
+    explicit LoopbackLink(const Conditions &cond = PERFECT);
+
+    LoopbackLink(const LoopbackLink&) = delete;
+    LoopbackLink &operator=(const LoopbackLink&) = delete;
+
+    /// Endpoint 0 talks to endpoint 1 and vice versa.
+    Transport &endpoint(int n) noexcept
+    {
+        assert(n >= 0 && n < 2);
+        return m_ends[n];
+    }
+
+    void advanceTime(double ms) noexcept;
+
+    double timeMs() const noexcept
+    {
+        return m_timeMs;
+    }
+
+    int sentDatagrams() const noexcept
+    {
+        return m_nSent;
+    }
+
+    int lostDatagrams() const noexcept
+    {
+        return m_nLost;
+    }
+
+private:
+    class Endpoint: public Transport
+    {
+    public:
+        void send(const c6502_byte_t *p, c6502_d_word_t size) override;
+        c6502_d_word_t receive(c6502_byte_t *buf, c6502_d_word_t maxSize) override;
+
+    private:
+        LoopbackLink *m_pLink = nullptr;
+        int m_n = 0;
+
+        friend class LoopbackLink;
+    };
+
+    const Conditions m_cond;
+    std::mutex m_mutex;
+    std::mt19937 m_rng;
+    double m_timeMs = 0.0;
+    int m_nSent = 0,
+        m_nLost = 0;
+
+    // Datagrams in flight to each endpoint, ordered by delivery time
+    std::multimap<double, std::vector<c6502_byte_t>> m_inFlight[2];
+
+    Endpoint m_ends[2];
+};
+
+/// UDP transport (IPv4, POSIX sockets).
+class UdpTransport: public Transport
+{
+public:
+    /*!
+     * Bind to @a localPort and exchange datagrams with @a remoteHost.
+     * Datagrams from other addresses are ignored.
+     */
+    UdpTransport(uint16_t localPort, const char *remoteHost, uint16_t remotePort);
+    ~UdpTransport() override;
+
+    UdpTransport(const UdpTransport&) = delete;
+    UdpTransport &operator=(const UdpTransport&) = delete;
+
+    void send(const c6502_byte_t *p, c6502_d_word_t size) override;
+    c6502_d_word_t receive(c6502_byte_t *buf, c6502_d_word_t maxSize) override;
+
+private:
+    int m_socket = -1;
+
+    // Remote address, network byte order
+    uint32_t m_remoteAddr = 0;
+    uint16_t m_remotePort = 0;
+};
+
+#endif	// TRANSPORT_H
@@ -0,0 +1,93 @@
+/*
+ * Experimental lockstep interpreter for batches of machines running the
+ * same program
+ */
+
+#ifndef VECTORCPU_H
+#define VECTORCPU_H
+
+#include "common.h"
+#include <vector>
+
+class Machine;
+class Bus;
+class CPU6502;
+
+/*!
+ * Runs the CPUs of up to LANES machines with a struct-of-arrays register
+ * file: A, X, Y, S and P of every machine live in one SIMD lane each.
+ *
+ * On every step the lane that is furthest behind in clocks is chosen as
+ * leader, and all lanes at the same PC with the same opcode form a group.
+ * If the opcode belongs to the vectorized subset (loads, stores, ALU,
+ * register transfers, flag operations, accumulator shifts, branches and
+ * JMP abs), the group executes it at once: operands are gathered through
+ * each lane's bus, flags and results are computed for all lanes with SSE2.
+ * Any other opcode runs through CPU6502 one lane at a time. Lanes split
+ * whenever their PCs differ and rejoin as soon as they meet at the same PC.
+ *
+ * Results are identical to running Bus::runFrame() on each machine alone;
+ * run-ahead settings of the machines are ignored.
+ */
+class VectorCPU
+{
+public:
+    static constexpr int LANES = 16;
+
+    /// @param machines Ready machines of the same output mode, 1 to LANES of them.
+    explicit VectorCPU(const std::vector<Machine*> &machines);
+
+    VectorCPU(const VectorCPU&) = delete;
+    VectorCPU &operator=(const VectorCPU&) = delete;
+
+    /// Emulate one frame on every machine (see Bus::runFrame()).
+    void runFrame();
+
+    int size() const noexcept
+    {
+        return m_count;
+    }
+
+    struct Stats
+    {
+        uint64_t groupSteps,    // Instructions executed by a lane group at once
+                 vectorInstr,   // Instructions retired by lanes inside groups
+                 scalarInstr;   // Instructions retired through CPU6502
+    };
+
+    const Stats &stats() const noexcept
+    {
+        return m_stats;
+    }
+
+    /// Clocks of @a opcode as executed by CPU6502, <= 0 for illegal opcodes.
+    static int opTacts(int opcode, bool &usePenalty) noexcept;
+
+private:
+    // Register file, one lane per machine
+    alignas(16) c6502_byte_t m_a[LANES],
+                             m_x[LANES],
+                             m_y[LANES],
+                             m_s[LANES],
+                             m_p[LANES],
+                             m_op[LANES];   // Gathered operands
+    c6502_word_t m_pc[LANES];
+    int m_clk[LANES],       // Clocks left in the current run()
+        m_spent[LANES];     // Clocks spent in the current run()
+
+    int m_count;
+    Bus *m_pBus[LANES];
+    CPU6502 *m_pCPU[LANES];
+
+    Stats m_stats = { };
+
+    void loadLanes(unsigned lanes) noexcept;
+    void storeLanes(unsigned lanes) noexcept;
+
+    // Lane sets are bit masks, bit n stands for lane n
+    void run(int clk, unsigned lanes);
+    unsigned stepGroup(int leader, unsigned active);
+    bool stepScalar(int lane);
+};
+
+#endif	// VECTORCPU_H
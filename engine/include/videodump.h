@@ -0,0 +1,111 @@
+/*
+ * Background dumping of frames to YUV4MPEG2 streams
+ */
+
+#ifndef VIDEODUMP_H
+#define VIDEODUMP_H
+
+#include "common.h"
+#include "bus.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+ * Streams pictures of FrameBufferBackend (palette indices) to a raw video
+ * file in YUV4MPEG2 format (".y4m", 4:2:0, BT.601 limited range), which
+ * players and ffmpeg read directly, e.g. for visual regression review.
+ *
+ * push() only copies the 60 KB picture of palette indices into a slot of a
+ * ring allocated up front; a helper thread converts it to YUV and writes
+ * it. When the queue
+ * is full the frame is dropped and counted instead of stalling the
+ * emulation, so the video may skip frames but the run is not slowed down
+ * by a slow disk or a slow reader of the pipe.
+ *
+ * The target may be a file, a named pipe or "-" for the standard output,
+ * which is duplicated when the dumper is created.
+ * Readers of pipes going away make writes fail with EPIPE, which only
+ * happens without SIGPIPE, so callers writing to pipes should ignore it.
+ */
+class VideoDumper
+{
+public:
+    static constexpr int DEFAULT_MAX_QUEUED = 8;
+
+    /*!
+     * Open @a file and write the stream header; the frame rate is that of
+     * @a mode. \throw Exception if the file can't be created.
+     * @param maxQueued Frames that may wait for writing at the same time.
+     */
+    VideoDumper(const std::string &file, OutputMode mode, int maxQueued = DEFAULT_MAX_QUEUED);
+
+    /// Writes all queued frames before returning.
+    ~VideoDumper();
+
+    VideoDumper(const VideoDumper&) = delete;
+    VideoDumper &operator=(const VideoDumper&) = delete;
+
+    /*!
+     * Queue a picture of FrameBufferBackend::WIDTH x HEIGHT palette indices.
+     * \return false if the frame is dropped: the queue is full or writing
+     * has failed.
+     */
+    bool push(const c6502_byte_t *pixels);
+
+    /// Wait until all queued frames are written.
+    void flush();
+
+    struct Stats
+    {
+        uint64_t written,
+                 dropped;       // Rejected by push()
+        bool failed;            // Writing stopped, see lastError()
+        double lastWriteMs,     // Conversion and I/O of the last frame
+               maxWriteMs;
+    };
+
+    Stats stats() const;
+
+    /// Description of the write error, empty if none.
+    std::string lastError() const;
+
+    /*!
+     * Convert a picture of palette indices to planar YUV 4:2:0: Y plane
+     * (WIDTH x HEIGHT), then U and V (WIDTH / 2 x HEIGHT / 2 each).
+     */
+    static void toYUV420(const c6502_byte_t *pixels, c6502_byte_t *yuv) noexcept;
+
+    static constexpr size_t FRAME_SIZE = 256 * 240 * 3 / 2;
+
+    /// Frame rate of @a mode: @a num frames per @a den seconds.
+    static void frameRate(OutputMode mode, uint32_t &num, uint32_t &den) noexcept;
+
+    /// YUV4MPEG2 stream header of the pictures, including the line feed.
+    static std::string streamHeader(OutputMode mode);
+
+private:
+    const int m_maxQueued;
+    int m_fd = -1;
+
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<c6502_byte_t> m_pictures;   // Ring of maxQueued + 1 slots, one is being written
+    size_t m_head = 0,          // Next slot to write
+           m_count = 0;         // Slots queued
+    bool m_busy = false,
+         m_stop = false;
+
+    Stats m_stats = { };
+    std::string m_lastError;
+
+    c6502_byte_t *slot(size_t i) noexcept;
+
+    void workerLoop();
+    bool writeAll(const void *p, size_t size, std::string &error) noexcept;
+};
+
+#endif	// VIDEODUMP_H
@@ -0,0 +1,73 @@
+/*
+ * Warm-start cache: snapshots of movie prefixes shared between jobs
+ */
+
+#ifndef WARMSTART_H
+#define WARMSTART_H
+
+#include "common.h"
+#include "savewriter.h"
+#include <string>
+
+class Machine;
+class Movie;
+
+/*!
+ * Directory of states reached by playing the first frames of movies, for
+ * test farms where many jobs replay the same boot and title sequences.
+ * Emulation is deterministic, so a state is keyed by the ROM hash and the
+ * hash of the movie start state and input up to that frame (see
+ * Movie::prefixHash()); a job restores the longest cached prefix of its
+ * movie and emulates only the rest.
+ *
+ * Files are named "<ROM hash>-<frames>-<prefix hash>.b1sz" and written in
+ * the background by SaveStateWriter, which replaces them atomically, so
+ * any number of processes may share the directory.
+ */
+class WarmStartCache
+{
+public:
+    /// @param dir Existing directory.
+    explicit WarmStartCache(const std::string &dir);
+
+    WarmStartCache(const WarmStartCache&) = delete;
+    WarmStartCache &operator=(const WarmStartCache&) = delete;
+
+    /*!
+     * Load the state of the longest cached prefix of @a movie, at most
+     * @a maxFrames frames long, into @a m, which runs the movie ROM.
+     * @return Frames of the movie covered by the state, 0 if none was found.
+     */
+    int restore(Machine &m, const Movie &movie, int maxFrames);
+
+    /// Cache the state of @a m, reached by playing the first @a frames frames of @a movie.
+    void store(const Machine &m, const Movie &movie, int frames);
+
+    /// Wait until stored states are written.
+    void flush()
+    {
+        m_writer.flush();
+    }
+
+    struct Stats
+    {
+        int hits,
+            misses,
+            stored;
+        uint64_t framesSkipped;
+    };
+
+    const Stats &stats() const noexcept
+    {
+        return m_stats;
+    }
+
+private:
+    const std::string m_dir;
+    SaveStateWriter m_writer;
+    Stats m_stats = { };
+
+    std::string path(c6502_d_word_t romHash, int frames, uint64_t prefixHash) const;
+};
+
+#endif	// WARMSTART_H
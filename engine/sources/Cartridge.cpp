@@ -1,24 +1,181 @@
 #include "Cartridge.h"
+#include "crc32.h"
 #include <algorithm>
 #include <memory>
+#include <new>
+#include <type_traits>
 
-Mapper::Mapper(int nROMs, int nVROMs, int nRAMs):
+static_assert(std::is_trivially_destructible<Mapper::RAM_BANK>::value &&
+              std::is_trivially_destructible<Mapper::CHR_RAM_BANK>::value,
+              "banks are placed in raw memory and never destroyed");
+
+namespace
+{
+
+// Offset of the RAM banks in the bank block
+size_t ramBanksOffset(bool hasCHRRAM) noexcept
+{
+    return hasCHRRAM ? (sizeof(Mapper::CHR_RAM_BANK) + Arena::ALIGNMENT - 1) & ~(Arena::ALIGNMENT - 1) : 0;
+}
+
+void *allocate(size_t size, Arena *pArena)
+{
+    void *p = pArena ? pArena->allocate(size) : nullptr;
+    return p ? p : ::operator new(size);
+}
+
+void release(void *p, Arena *pArena) noexcept
+{
+    if (!pArena || !pArena->owns(p))
+        ::operator delete(p);
+}
+
+}
+
+void *Mapper::operator new(size_t size, Arena *pArena)
+{
+    return allocate(size, pArena);
+}
+
+void Mapper::operator delete(void *p, Arena *pArena) noexcept
+{
+    release(p, pArena);
+}
+
+void Mapper::destroy(Mapper *pMapper) noexcept
+{
+    if (!pMapper)
+        return;
+
+    Arena *pArena = pMapper->m_pArena;
+    pMapper->~Mapper();
+    release(pMapper, pArena);
+}
+
+Mapper::Mapper(int nROMs, int nVROMs, int nRAMs, Arena *pArena):
     m_nROMs(nROMs),
     m_nVROMs(nVROMs),
-    m_nRAMs(nRAMs)
+    m_nRAMs(nRAMs),
+    m_pArena(pArena)
 {
-    m_pROM = new ROM_BANK[nROMs];
+    // Zero-initialised: banks not filled by the loader must not differ
+    // between runs, ROM contents are hashed to identify the game
+    m_spROM.reset(new ROM_BANK[nROMs](), std::default_delete<ROM_BANK[]>());
+    m_pROM = m_spROM.get();
     if (nVROMs > 0)
-        m_pVROM = new VROM_BANK[nVROMs];
-    if (nRAMs > 0)
-        m_pRAM = new RAM_BANK[nRAMs];
+    {
+        m_spVROM.reset(new VROM_BANK[nVROMs](), std::default_delete<VROM_BANK[]>());
+        m_pVROM = m_spVROM.get();
+    }
+
+    // No pattern tables in ROM, cartridge provides CHR-RAM instead
+    allocBanks(nVROMs == 0);
+    if (m_pCHRRAM)
+    {
+        m_pCHRRAM->Clear();
+        m_chrDirty = 0xFFu;
+    }
+}
+
+Mapper::Mapper(const Mapper &src, Arena *pArena):
+    m_nROMs(src.m_nROMs),
+    m_nVROMs(src.m_nVROMs),
+    m_nRAMs(src.m_nRAMs),
+    m_pArena(pArena),
+    m_spROM(src.m_spROM),
+    m_spVROM(src.m_spVROM),
+    m_pROM(src.m_pROM),
+    m_pVROM(src.m_pVROM)
+{
+    allocBanks(src.m_pCHRRAM != nullptr);
+    copyStateFrom(src);
 }
 
 Mapper::~Mapper()
 {
-    delete[] m_pROM;
-    delete[] m_pVROM;
-    delete[] m_pRAM;
+    if (m_pBanks)
+        release(m_pBanks, m_pArena);
+}
+
+void Mapper::allocBanks(bool hasCHRRAM)
+{
+    const size_t offset = ramBanksOffset(hasCHRRAM),
+                 size = offset + m_nRAMs * sizeof(RAM_BANK);
+    if (size == 0)
+        return;
+
+    m_pBanks = allocate(size, m_pArena);
+    char *p = static_cast<char*>(m_pBanks);
+    if (hasCHRRAM)
+        m_pCHRRAM = new (p) CHR_RAM_BANK;
+    if (m_nRAMs > 0)
+    {
+        m_pRAM = reinterpret_cast<RAM_BANK*>(p + offset);
+        for (int i = 0; i < m_nRAMs; i++)
+            new (m_pRAM + i) RAM_BANK;
+    }
+}
+
+c6502_d_word_t Mapper::stateSize() const noexcept
+{
+    return (m_pCHRRAM ? VROM_SIZE : 0u) + m_nRAMs * RAM_SIZE;
+}
+
+void Mapper::saveState(c6502_byte_t *p) const noexcept
+{
+    if (m_pCHRRAM)
+    {
+        m_pCHRRAM->Read(0, p, VROM_SIZE);
+        p += VROM_SIZE;
+    }
+
+    for (int i = 0; i < m_nRAMs; i++, p += RAM_SIZE)
+        m_pRAM[i].Read(0, p, RAM_SIZE);
+}
+
+void Mapper::loadState(const c6502_byte_t *p) noexcept
+{
+    if (m_pCHRRAM)
+    {
+        m_pCHRRAM->Write(0, p, VROM_SIZE);
+        p += VROM_SIZE;
+
+        // Pattern tables may have changed entirely
+        m_chrDirty = 0xFFu;
+    }
+
+    for (int i = 0; i < m_nRAMs; i++, p += RAM_SIZE)
+        m_pRAM[i].Write(0, p, RAM_SIZE);
+}
+
+void Mapper::updateState(c6502_byte_t *p) noexcept
+{
+    if (m_pCHRRAM)
+    {
+        m_pCHRRAM->forEachDirty([this, p](c6502_d_word_t off, c6502_d_word_t len)
+        {
+            m_pCHRRAM->Read(off, p + off, len);
+        });
+        m_pCHRRAM->clearDirty();
+        p += VROM_SIZE;
+    }
+
+    for (int i = 0; i < m_nRAMs; i++, p += RAM_SIZE)
+        m_pRAM[i].Read(0, p, RAM_SIZE);
+}
+
+void Mapper::copyStateFrom(const Mapper &src) noexcept
+{
+    assert(m_nRAMs == src.m_nRAMs && (m_pCHRRAM != nullptr) == (src.m_pCHRRAM != nullptr));
+
+    for (int i = 0; i < m_nRAMs; i++)
+        m_pRAM[i].Assign(src.m_pRAM[i]);
+
+    if (m_pCHRRAM)
+    {
+        m_pCHRRAM->Assign(*src.m_pCHRRAM);
+        m_chrDirty = 0xFFu;
+    }
 }
 
 void Mapper::setROMBank(int n, const c6502_byte_t *p)
@@ -35,11 +192,62 @@ void Mapper::setVROMBank(int n, const c6502_byte_t *p)
     m_pVROM[n].Write(0, p, VROM_SIZE);
 }
 
+c6502_d_word_t Mapper::romHash() const noexcept
+{
+    c6502_d_word_t crc = 0;
+    for (int i = 0; i < m_nROMs; i++)
+        crc = crc32(m_pROM[i].Data(), ROM_SIZE, crc);
+    for (int i = 0; i < m_nVROMs; i++)
+        crc = crc32(m_pVROM[i].Data(), VROM_SIZE, crc);
+    return crc;
+}
+
+void Mapper::relocateROM(void *mem, const std::shared_ptr<void> &owner)
+{
+    static_assert(std::is_trivially_copyable<ROM_BANK>::value &&
+                  std::is_trivially_copyable<VROM_BANK>::value,
+                  "banks are moved bytewise");
+
+    ROM_BANK *rom = static_cast<ROM_BANK*>(mem);
+    VROM_BANK *vrom = reinterpret_cast<VROM_BANK*>(rom + m_nROMs);
+    memcpy(rom, m_pROM, m_nROMs * sizeof(ROM_BANK));
+    if (m_nVROMs > 0)
+        memcpy(vrom, m_pVROM, m_nVROMs * sizeof(VROM_BANK));
+
+    // Aliasing pointers: the banks live as long as the owner
+    m_spROM = std::shared_ptr<ROM_BANK>(owner, rom);
+    m_pROM = rom;
+    if (m_nVROMs > 0)
+    {
+        m_spVROM = std::shared_ptr<VROM_BANK>(owner, vrom);
+        m_pVROM = vrom;
+    }
+}
+
+Cartrige::Cartrige(const Cartrige &src, Arena *pArena):
+    m_pArena(pArena),
+    m_spTrainer(src.m_spTrainer),
+    m_mirr(src.m_mirr)
+{
+    if (src.m_pMapper)
+        m_pMapper = src.m_pMapper->clone(pArena);
+}
+
 void Cartrige::setTrainer(const c6502_byte_t tr[512])
 {
-    if (!m_pTrainer)
-        m_pTrainer = new c6502_byte_t[512];
-    memcpy(m_pTrainer, tr, 512);
+    // Copies may share the current one, so it is replaced, not overwritten
+    c6502_byte_t *p = new c6502_byte_t[512];
+    memcpy(p, tr, 512);
+    m_spTrainer.reset(p, std::default_delete<c6502_byte_t[]>());
+}
+
+c6502_d_word_t Cartrige::romHash() const noexcept
+{
+    assert(m_pMapper);
+    c6502_d_word_t crc = m_pMapper->romHash();
+    if (m_spTrainer)
+        crc = crc32(m_spTrainer.get(), 512, crc);
+    return crc;
 }
 
 #include "mappers.h"
@@ -49,22 +257,23 @@ void Cartrige::setMapper(uint8_t type,
                          int nVROMs,
                          int nRAMs)
 {
-    std::unique_ptr<Mapper> tmp;
+    Mapper *(*create)(int, int, int, Arena*) = nullptr;
     switch (type)
     {
         case Mapper::Default:
-            tmp.reset(new DefaultMapper { nROMs, nVROMs, nRAMs });
+            create = &Mapper::create<DefaultMapper>;
             break;
         default:
             throw Exception(Exception::IllegalArgument,
                             "mapper type is not supported");
     }
 
-    if (tmp)
-    {
-        delete m_pMapper;
-        m_pMapper = tmp.release();
-    }
+    // The new mapper takes over the arena memory of the old one
+    Mapper::destroy(m_pMapper);
+    m_pMapper = nullptr;
+    if (m_pArena)
+        m_pArena->reset();
+    m_pMapper = create(nROMs, nVROMs, nRAMs, m_pArena);
 }
 
 
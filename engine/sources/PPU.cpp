@@ -177,7 +177,8 @@ void PPU::startFrame() noexcept
     m_currLine = 0;
     m_frameVScroll = m_st.scrollV;
 
-    m_pBackend->setBackground(bus().readVideoMem(0x3F00u));
+    if (m_renderingEnabled)
+        m_pBackend->setBackground(bus().readVideoMem(0x3F00u));
 }
 
 void PPU::drawNextLine() noexcept
@@ -218,7 +219,7 @@ void PPU::drawNextLine() noexcept
 
     // Render background
     const bool skipTopAndBottom = bus().getMode() == OutputMode::NTSC;
-    if (m_st.backgroundVisible && m_currLine % 8 == 7 &&
+    if (m_renderingEnabled && m_st.backgroundVisible && m_currLine % 8 == 7 &&
         (!skipTopAndBottom || (m_currLine >= 8 && m_currLine < 232)))
     {
         const int y = m_currLine - 7,
@@ -267,6 +268,13 @@ void PPU::drawNextLine() noexcept
                 (!m_st.allSpritesVisible && (x >> 3) == 0))
                 continue;
 
+            nSprites++;
+            if (ns == 0)
+                m_st.sprite0 = true;
+
+            if (!m_renderingEnabled)
+                continue;
+
             const auto lyr = test<5>(attrs) ?
                              RenderingBackend::Layer::BEHIND :
                              RenderingBackend::Layer::FRONT;
@@ -290,10 +298,6 @@ void PPU::drawNextLine() noexcept
                 if (readCharacter(nChar + 1 - e, baddr, fliph, flipv, clrHi, PAL_SPR))
                     m_pBackend->setSymbol(lyr, x, y + 8, sym);
             }
-
-            nSprites++;
-            if (ns == 0)
-                m_st.sprite0 = true;
         }
         m_st.over8sprites = nSprites > 8;
     }
@@ -303,7 +307,8 @@ void PPU::drawNextLine() noexcept
 
 void PPU::endFrame() noexcept
 {
-    m_pBackend->draw();
+    if (m_renderingEnabled)
+        m_pBackend->draw();
 }
 
 void PPU::readCharacterLine(c6502_byte_t *line,
@@ -0,0 +1,105 @@
+#include "affinity.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <cstdio>
+
+static_assert(sizeof(cpu_set_t) <= 128, "CPU mask does not fit in ThreadAffinity");
+#endif
+
+int cpuNode(int cpu) noexcept
+{
+#ifdef __linux__
+    // cpuN contains a nodeK link on NUMA kernels
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (!dir)
+        return 0;
+
+    int node = 0;
+    while (const dirent *e = readdir(dir))
+    {
+        if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9')
+        {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+#else
+    (void)cpu;
+    return 0;
+#endif
+}
+
+std::vector<int> cpusByNode()
+{
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int i = 0; i < CPU_SETSIZE; i++)
+            if (CPU_ISSET(i, &set))
+                cpus.push_back(i);
+    }
+#endif
+    if (cpus.empty())
+    {
+        const int n = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 0; i < n; i++)
+            cpus.push_back(i);
+    }
+
+    std::vector<std::pair<int, int>> byNode;
+    for (int cpu: cpus)
+        byNode.emplace_back(cpuNode(cpu), cpu);
+    std::sort(byNode.begin(), byNode.end());
+
+    for (size_t i = 0; i < byNode.size(); i++)
+        cpus[i] = byNode[i].second;
+    return cpus;
+}
+
+ThreadAffinity::ThreadAffinity() noexcept
+{
+#ifdef __linux__
+    m_valid = sched_getaffinity(0, sizeof(cpu_set_t), reinterpret_cast<cpu_set_t*>(m_saved)) == 0;
+#endif
+}
+
+ThreadAffinity::~ThreadAffinity()
+{
+#ifdef __linux__
+    if (m_pinned && m_valid)
+        sched_setaffinity(0, sizeof(cpu_set_t), reinterpret_cast<const cpu_set_t*>(m_saved));
+#endif
+}
+
+bool ThreadAffinity::pin(int cpu) noexcept
+{
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return false;
+
+    m_pinned = true;
+    return true;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -0,0 +1,245 @@
+#include "avcapture.h"
+#include "framebuffer.h"
+#include "videodump.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+constexpr int AVCapture::DEFAULT_MAX_QUEUED;
+constexpr int AVCapture::DEFAULT_SAMPLE_RATE;
+
+static constexpr size_t PICTURE_SIZE = FrameBufferBackend::WIDTH * FrameBufferBackend::HEIGHT,
+                        WAV_HEADER_SIZE = 44;
+
+static void put16(c6502_byte_t *p, uint16_t v) noexcept
+{
+    p[0] = v & 0xFFu;
+    p[1] = v >> 8;
+}
+
+static void put32(c6502_byte_t *p, c6502_d_word_t v) noexcept
+{
+    p[0] = v & 0xFFu;
+    p[1] = (v >> 8) & 0xFFu;
+    p[2] = (v >> 16) & 0xFFu;
+    p[3] = v >> 24;
+}
+
+// RIFF header of 16-bit mono PCM with @a samples samples
+static void wavHeader(c6502_byte_t *p, int sampleRate, uint64_t samples) noexcept
+{
+    // Sizes saturate at the 4 GB limit of RIFF, players then read to the end
+    const c6502_d_word_t dataSize = static_cast<c6502_d_word_t>(std::min<uint64_t>(samples * 2, 0xFFFFFFFFu - 36));
+    memcpy(p, "RIFF", 4);
+    put32(p + 4, 36 + dataSize);
+    memcpy(p + 8, "WAVEfmt ", 8);
+    put32(p + 16, 16);
+    put16(p + 20, 1);               // PCM
+    put16(p + 22, 1);               // Channels
+    put32(p + 24, sampleRate);
+    put32(p + 28, sampleRate * 2);  // Bytes per second
+    put16(p + 32, 2);               // Bytes per sample frame
+    put16(p + 34, 16);              // Bits per sample
+    memcpy(p + 36, "data", 4);
+    put32(p + 40, dataSize);
+}
+
+AVCapture::AVCapture(const std::string &base, OutputMode mode, int maxQueued, int sampleRate):
+    m_sampleRate(sampleRate)
+{
+    assert(maxQueued > 0 && sampleRate > 0);
+    VideoDumper::frameRate(mode, m_rateNum, m_rateDen);
+
+    m_video = fopen((base + ".y4m").c_str(), "wb");
+    m_audio = fopen((base + ".wav").c_str(), "wb");
+    m_index = fopen((base + ".idx").c_str(), "w");
+    if (!m_video || !m_audio || !m_index)
+    {
+        const int err = errno;
+        closeFiles();
+        throw Exception(Exception::IOFailure, strerror(err));
+    }
+
+    const std::string header = VideoDumper::streamHeader(mode);
+    c6502_byte_t wav[WAV_HEADER_SIZE];
+    wavHeader(wav, sampleRate, 0);
+    if (fwrite(header.data(), header.size(), 1, m_video) != 1 ||
+        fwrite(wav, sizeof(wav), 1, m_audio) != 1 ||
+        fputs("# video-frame machine-frame first-sample samples\n", m_index) < 0)
+    {
+        const int err = errno;
+        closeFiles();
+        throw Exception(Exception::IOFailure, strerror(err));
+    }
+
+    // All buffers are allocated here: capture() only swaps them
+    const size_t maxSamples = sampleAt(1) + 1;
+    m_slots.resize(maxQueued);
+    for (Slot &s: m_slots)
+    {
+        s.pixels.resize(PICTURE_SIZE);
+        s.audio.reserve(2 * maxSamples);
+    }
+
+    m_worker = std::thread(&AVCapture::workerLoop, this);
+}
+
+AVCapture::~AVCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+
+    // The sample count is known only now
+    c6502_byte_t wav[WAV_HEADER_SIZE];
+    wavHeader(wav, m_sampleRate, m_stats.samples);
+    if (fseek(m_audio, 0, SEEK_SET) == 0)
+        fwrite(wav, sizeof(wav), 1, m_audio);
+
+    closeFiles();
+}
+
+void AVCapture::closeFiles() noexcept
+{
+    for (FILE *f: { m_video, m_audio, m_index })
+        if (f)
+            fclose(f);
+    m_video = m_audio = m_index = nullptr;
+}
+
+uint64_t AVCapture::sampleAt(uint64_t videoFrame) const noexcept
+{
+    return videoFrame * m_sampleRate * m_rateDen / m_rateNum;
+}
+
+bool AVCapture::capture(uint64_t frame, std::vector<c6502_byte_t> &pixels, std::vector<int16_t> &audio) noexcept
+{
+    assert(pixels.size() == PICTURE_SIZE);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stats.failed || m_count == m_slots.size())
+    {
+        m_stats.dropped++;
+        m_repeats++;
+        return false;
+    }
+
+    Slot &s = m_slots[(m_head + m_count) % m_slots.size()];
+    s.frame = frame;
+    s.repeats = m_repeats;
+    s.pixels.swap(pixels);
+    s.audio.swap(audio);
+    m_repeats = 0;
+    m_count++;
+    m_cv.notify_all();
+    return true;
+}
+
+void AVCapture::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_count == 0 && !m_busy; });
+}
+
+AVCapture::Stats AVCapture::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string AVCapture::lastError() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastError;
+}
+
+void AVCapture::workerLoop()
+{
+    static const char FRAME_HEADER[] = "FRAME\n";
+    constexpr size_t HEADER_SIZE = sizeof(FRAME_HEADER) - 1;
+
+    // Picture before the first frame is black
+    std::vector<c6502_byte_t> yuv(HEADER_SIZE + VideoDumper::FRAME_SIZE);
+    memcpy(yuv.data(), FRAME_HEADER, HEADER_SIZE);
+    memset(yuv.data() + HEADER_SIZE, 16, PICTURE_SIZE);
+    memset(yuv.data() + HEADER_SIZE + PICTURE_SIZE, 128, VideoDumper::FRAME_SIZE - PICTURE_SIZE);
+
+    std::vector<c6502_byte_t> pcm(2 * (sampleAt(1) + 1));
+    uint64_t videoFrame = 0,
+             samples = 0,
+             lastFrame = 0;
+
+    // One video frame and its share of the audio; nullptr audio is silence
+    auto writeFrame = [&](uint64_t frame, const std::vector<int16_t> *audio, bool repeated) {
+        const uint64_t n = sampleAt(videoFrame + 1) - samples,
+                       given = audio ? std::min<uint64_t>(audio->size(), n) : 0;
+        for (uint64_t i = 0; i < n; i++)
+            put16(pcm.data() + 2 * i, i < given ? static_cast<uint16_t>((*audio)[i]) : 0);
+
+        const bool ok = fwrite(yuv.data(), yuv.size(), 1, m_video) == 1 &&
+                        (n == 0 || fwrite(pcm.data(), 2 * n, 1, m_audio) == 1) &&
+                        fprintf(m_index, "%llu %llu %llu %llu%s\n",
+                                static_cast<unsigned long long>(videoFrame), static_cast<unsigned long long>(frame),
+                                static_cast<unsigned long long>(samples), static_cast<unsigned long long>(n),
+                                repeated ? " r" : "") > 0;
+        videoFrame++;
+        samples += n;
+        return ok;
+    };
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_cv.wait(lock, [this] { return m_count > 0 || m_stop; });
+        if (m_count == 0)
+        {
+            // Frames dropped at the end still take their time in the files
+            const uint32_t repeats = m_stats.failed ? 0 : m_repeats;
+            m_repeats = 0;
+            lock.unlock();
+            bool ok = true;
+            for (uint32_t i = 0; ok && i < repeats; i++)
+                ok = writeFrame(lastFrame + 1 + i, nullptr, true);
+            lock.lock();
+            m_stats.written = videoFrame;
+            m_stats.samples = samples;
+            break;
+        }
+
+        Slot &s = m_slots[m_head];
+        m_busy = true;
+        // Frames queued before a write error are discarded
+        bool ok = !m_stats.failed;
+        lock.unlock();
+
+        // Dropped frames: the previous picture again, with silence
+        for (uint32_t i = 0; ok && i < s.repeats; i++)
+            ok = writeFrame(s.frame - s.repeats + i, nullptr, true);
+
+        if (ok)
+        {
+            VideoDumper::toYUV420(s.pixels.data(), yuv.data() + HEADER_SIZE);
+            ok = writeFrame(s.frame, &s.audio, false);
+        }
+        lastFrame = s.frame;
+        const int err = errno;
+        s.audio.clear();
+
+        lock.lock();
+        m_stats.written = videoFrame;
+        m_stats.samples = samples;
+        if (!ok && !m_stats.failed)
+        {
+            m_stats.failed = true;
+            m_lastError = err != 0 ? strerror(err) : "write error";
+        }
+        m_head = (m_head + 1) % m_slots.size();
+        m_count--;
+        m_busy = false;
+        m_cv.notify_all();
+    }
+}
@@ -0,0 +1,348 @@
+#include "batch.h"
+#include "machine.h"
+#include "affinity.h"
+
+#include <algorithm>
+#include <chrono>
+
+static constexpr uint64_t packRange(uint32_t begin, uint32_t end) noexcept
+{
+    return (static_cast<uint64_t>(begin) << 32) | end;
+}
+
+static constexpr uint32_t rangeBegin(uint64_t r) noexcept
+{
+    return static_cast<uint32_t>(r >> 32);
+}
+
+static constexpr uint32_t rangeEnd(uint64_t r) noexcept
+{
+    return static_cast<uint32_t>(r);
+}
+
+void BatchRunner::MachineDeleter::operator()(Machine *m) const noexcept
+{
+    if (inPlace)
+        m->~Machine();
+    else
+        delete m;
+}
+
+BatchRunner::BatchRunner(const Machine &prototype, int count, int nThreads, PageMode pages,
+                         const std::vector<int> &cpus):
+    m_nThreads(nThreads > 0 ? nThreads : std::max(1u, std::thread::hardware_concurrency())),
+    m_cpus(cpus)
+{
+    if (!prototype.isReady())
+        throw Exception(Exception::IllegalArgument, "prototype machine has no cartridge");
+    if (count <= 0)
+        throw Exception(Exception::IllegalArgument, "batch must contain at least one machine");
+
+    // Everything is allocated here, run() only emulates
+    m_machines.resize(count);
+    std::unique_ptr<Machine> seed;
+    m_pSource = &prototype;
+    if (pages != PageMode::Normal)
+    {
+        // Block layout: ROM banks, then the machines
+        seed = prototype.clone();
+        Mapper *mapper = seed->cartrige().mapper();
+        const size_t romSize = (mapper->romSize() + alignof(Machine) - 1) & ~(alignof(Machine) - 1);
+        m_spPages = std::make_shared<HugePageBlock>(romSize + count * sizeof(Machine), pages);
+
+        mapper->relocateROM(m_spPages->data(), m_spPages);
+        m_pSource = seed.get();
+        m_pMachineMem = static_cast<char*>(m_spPages->data()) + romSize;
+    }
+
+    m_slices.reset(new Slice[m_nThreads]);
+    for (int i = 0; i < m_nThreads; i++)
+    {
+        m_slices[i].range.store(0);
+        m_slices[i].steals = 0;
+        m_slices[i].frames = 0;
+        m_slices[i].framesBefore = 0;
+    }
+
+    // Workers build their own slices, the caller builds slice 0
+    m_workers.reserve(m_nThreads - 1);
+    for (int i = 1; i < m_nThreads; i++)
+        m_workers.emplace_back(&BatchRunner::workerLoop, this, i);
+
+    std::exception_ptr error;
+    {
+        ThreadAffinity affinity;
+        place(0, affinity);
+        try
+        {
+            build(0);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_built == m_nThreads - 1; });
+        if (!error)
+            error = m_buildError;
+        m_pSource = nullptr;
+    }
+
+    if (error)
+    {
+        stopWorkers();
+        std::rethrow_exception(error);
+    }
+}
+
+BatchRunner::~BatchRunner()
+{
+    stopWorkers();
+}
+
+void BatchRunner::stopWorkers() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+
+    for (auto &t: m_workers)
+        t.join();
+    m_workers.clear();
+}
+
+void BatchRunner::place(int n, ThreadAffinity &affinity) noexcept
+{
+    Slice &s = m_slices[n];
+    s.cpu = -1;
+    s.node = -1;
+    if (m_cpus.empty())
+        return;
+
+    const int cpu = m_cpus[n % m_cpus.size()];
+    if (affinity.pin(cpu))
+    {
+        s.cpu = cpu;
+        s.node = cpuNode(cpu);
+    }
+}
+
+void BatchRunner::build(int n)
+{
+    // Same partition as the home slices of resetSlices()
+    const size_t count = m_machines.size(),
+                 begin = count * n / m_nThreads,
+                 end = count * (n + 1) / m_nThreads;
+    for (size_t i = begin; i < end; i++)
+    {
+        if (m_pMachineMem)
+            m_machines[i] = { m_pSource->cloneAt(m_pMachineMem + i * sizeof(Machine)), MachineDeleter { true } };
+        else
+            m_machines[i] = { m_pSource->clone().release(), MachineDeleter { false } };
+    }
+}
+
+void BatchRunner::run(int frames)
+{
+    if (frames <= 0)
+        return;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // The caller works as worker 0, on its CPU for the time of the run
+    ThreadAffinity affinity;
+    if (m_slices[0].cpu >= 0)
+        affinity.pin(m_slices[0].cpu);
+
+    resetSlices();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int i = 0; i < m_nThreads; i++)
+            m_slices[i].framesBefore = m_slices[i].frames;
+        m_frames = frames;
+        m_runId++;
+    }
+    m_cv.notify_all();
+
+    runFrames(0, frames);
+
+    m_lastRunSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_totalFrames += static_cast<uint64_t>(frames) * m_machines.size();
+}
+
+BatchRunner::Stats BatchRunner::stats() const noexcept
+{
+    Stats st;
+    st.frames = m_totalFrames;
+    st.steals = 0;
+    for (int i = 0; i < m_nThreads; i++)
+        st.steals += m_slices[i].steals;
+    st.lastRunSec = m_lastRunSec;
+    st.lastFramesPerSec = m_lastRunSec > 0.0 ?
+        static_cast<double>(m_frames) * m_machines.size() / m_lastRunSec : 0.0;
+    return st;
+}
+
+std::vector<BatchRunner::NodeStats> BatchRunner::nodeStats() const
+{
+    std::vector<NodeStats> nodes;
+    for (int i = 0; i < m_nThreads; i++)
+    {
+        const Slice &s = m_slices[i];
+        auto it = std::find_if(nodes.begin(), nodes.end(),
+                               [&s](const NodeStats &ns) { return ns.node == s.node; });
+        if (it == nodes.end())
+            it = nodes.insert(nodes.end(), NodeStats { s.node, 0, 0, 0.0 });
+
+        it->workers++;
+        it->frames += s.frames;
+        if (m_lastRunSec > 0.0)
+            it->lastFramesPerSec += (s.frames - s.framesBefore) / m_lastRunSec;
+    }
+
+    std::sort(nodes.begin(), nodes.end(),
+              [](const NodeStats &a, const NodeStats &b) { return a.node < b.node; });
+    return nodes;
+}
+
+void BatchRunner::workerLoop(int n)
+{
+    // Pinned for the whole life of the thread
+    ThreadAffinity affinity;
+    place(n, affinity);
+
+    std::exception_ptr error;
+    try
+    {
+        build(n);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (error && !m_buildError)
+            m_buildError = error;
+        m_built++;
+    }
+    m_cv.notify_all();
+
+    int lastRun = 0;
+    for (;;)
+    {
+        int frames;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this, lastRun] { return m_stop || m_runId != lastRun; });
+            if (m_stop)
+                return;
+            lastRun = m_runId;
+            frames = m_frames;
+        }
+
+        runFrames(n, frames);
+    }
+}
+
+void BatchRunner::runFrames(int n, int frames)
+{
+    for (int f = 0; f < frames; f++)
+    {
+        int index;
+        while (takeOwn(n, index) || steal(n, index))
+        {
+            m_machines[index]->runFrame();
+            m_slices[n].frames++;
+        }
+
+        // The last worker to arrive prepares slices for the next frame
+        barrier();
+    }
+}
+
+void BatchRunner::resetSlices() noexcept
+{
+    const uint64_t count = m_machines.size();
+    for (int i = 0; i < m_nThreads; i++)
+        m_slices[i].range.store(packRange(count * i / m_nThreads, count * (i + 1) / m_nThreads),
+                                std::memory_order_relaxed);
+}
+
+bool BatchRunner::takeOwn(int n, int &index) noexcept
+{
+    auto &range = m_slices[n].range;
+    uint64_t r = range.load(std::memory_order_acquire);
+    while (rangeBegin(r) < rangeEnd(r))
+    {
+        if (range.compare_exchange_weak(r, packRange(rangeBegin(r) + 1, rangeEnd(r)),
+                                        std::memory_order_acq_rel))
+        {
+            index = rangeBegin(r);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool BatchRunner::steal(int n, int &index) noexcept
+{
+    for (;;)
+    {
+        // Victim is the worker with the most work left
+        int victim = -1;
+        uint32_t most = 0;
+        for (int i = 0; i < m_nThreads; i++)
+        {
+            const uint64_t r = m_slices[i].range.load(std::memory_order_acquire);
+            const uint32_t left = rangeEnd(r) - rangeBegin(r);
+            if (i != n && rangeBegin(r) < rangeEnd(r) && left > most)
+            {
+                victim = i;
+                most = left;
+            }
+        }
+
+        if (victim < 0)
+            return false;
+
+        auto &range = m_slices[victim].range;
+        uint64_t r = range.load(std::memory_order_acquire);
+        const uint32_t b = rangeBegin(r),
+                       e = rangeEnd(r);
+        if (b >= e)
+            continue;
+
+        const uint32_t mid = e - (e - b + 1) / 2;
+        if (!range.compare_exchange_strong(r, packRange(b, mid), std::memory_order_acq_rel))
+            continue;
+
+        // Own slice is empty, only failing thieves may be looking at it
+        index = mid;
+        m_slices[n].range.store(packRange(mid + 1, e), std::memory_order_release);
+        m_slices[n].steals++;
+        return true;
+    }
+}
+
+void BatchRunner::barrier() noexcept
+{
+    const unsigned gen = m_generation.load(std::memory_order_acquire);
+    if (m_arrived.fetch_add(1, std::memory_order_acq_rel) == m_nThreads - 1)
+    {
+        m_arrived.store(0, std::memory_order_relaxed);
+        resetSlices();
+        m_generation.store(gen + 1, std::memory_order_release);
+        return;
+    }
+
+    while (m_generation.load(std::memory_order_acquire) == gen)
+        std::this_thread::yield();
+}
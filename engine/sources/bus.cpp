@@ -3,20 +3,33 @@
 #include "PPU.h"
 #include "Cartridge.h"
 #include "gamepad.h"
+#include "state.h"
 #include "log.h"
 
 #include <cassert>
+#include <cstring>
+
+static_assert(MAX_STATE_SIZE >= 0x10000u + 3 * 0x2000u + Mapper::VROM_SIZE + 255 * Mapper::RAM_SIZE,
+              "MAX_STATE_SIZE doesn't cover the largest cartridge");
 
 void Bus::injectCartrige(Cartrige *cart)
 {
     m_pCart = cart;
 
-    // Clear memory
+    // Clear memory. Power-on state must not depend on what ran before,
+    // otherwise recorded input would not replay identically.
     m_ram.Clear();
     m_vram.Clear();
+    m_wram.Clear();
     m_spriteMem.Clear();
 
     m_pCPU->reset();
+    m_pPPU->reset();
+
+    m_strobeReg = 0u;
+    for (auto pad: m_pGamePads)
+        if (pad)
+            pad->strobe();
 
     m_nFrame = 0;
 }
@@ -51,8 +64,8 @@ static constexpr int PAL_FPS = 50,
 
 void Bus::runFrame()
 {
-    const int CPL = m_mode == OutputMode::PAL ? PAL_LINE_CYCLES : NTSC_LINE_CYCLES,
-              NMI_LINES = m_mode == OutputMode::PAL ? PAL_NMI_LINES : NTSC_NMI_LINES;
+    const int CPL = lineCycles(),
+              NMI_LINES = vblankLines();
 
     m_nFrame++;
 
@@ -62,7 +75,7 @@ void Bus::runFrame()
     for (int i = 0; i < 240; i++)
     {
         m_pPPU->drawNextLine();
-        m_pCPU->run(CPL);
+        m_cpuCycles += m_pCPU->run(CPL);
     }
 
     m_pPPU->endFrame();
@@ -75,17 +88,27 @@ void Bus::runFrame()
         // Sending of NMI signal from PPU to CPU takes 7 clocks.
         // At this time CPU is still running and VBLANK flag is
         // already set.
-        m_pCPU->run(7);
-        m_pCPU->NMI();
+        m_cpuCycles += m_pCPU->run(7);
+        m_cpuCycles += m_pCPU->NMI();
     }
 
     // PPU is opened for writinng only during VSYNC
     for (int i = 0; i < NMI_LINES; i++)
-        m_pCPU->run(CPL);
+        m_cpuCycles += m_pCPU->run(CPL);
 
     m_pPPU->onEndVblank();
 }
 
+int Bus::lineCycles() const noexcept
+{
+    return m_mode == OutputMode::PAL ? PAL_LINE_CYCLES : NTSC_LINE_CYCLES;
+}
+
+int Bus::vblankLines() const noexcept
+{
+    return m_mode == OutputMode::PAL ? PAL_NMI_LINES : NTSC_NMI_LINES;
+}
+
 int Bus::currentTimeMs() const noexcept
 {
     return m_nFrame * 1000 / (m_mode == OutputMode::PAL ? PAL_FPS : NTSC_FPS);
@@ -180,12 +203,8 @@ void Bus::writeMem(c6502_word_t addr, c6502_byte_t val)
 c6502_byte_t Bus::readVideoMem(c6502_word_t addr) const noexcept
 {
     if (addr < 0x2000u)
-    {
-        if (m_pCart->mapper()->hasRAM())
-            return m_pCart->mapper()->readRAM(addr);
-        else
-            return m_pCart->mapper()->readVROM(addr);
-    }
+        // Pattern tables, either CHR-ROM or CHR-RAM depending on the cartridge
+        return m_pCart->mapper()->readVROM(addr);
     else
         return m_vram.Read(addr - 0x2000u);
 }
@@ -195,10 +214,7 @@ void Bus::writeVideoMem(c6502_word_t addr, c6502_byte_t val) noexcept
     const auto mt = m_pCart->mirroring();
 
     if (addr < 0x2000u)
-    {
-        assert(m_pCart->mapper()->hasRAM());
-        m_pCart->mapper()->writeRAM(addr, val);
-    }
+        m_pCart->mapper()->writeVROM(addr, val);
     else
     {
         constexpr auto PBG = PAL_BG - 0x2000u,
@@ -233,3 +249,189 @@ void Bus::writeVideoMem(c6502_word_t addr, c6502_byte_t val) noexcept
         m_vram.Write(addr, val);
     }
 }
+
+// CORE section of the save state
+struct CoreState
+{
+    CPU6502::Snapshot cpu;
+    PPU::Snapshot ppu;
+    Gamepad::Snapshot pads[2];
+    int nFrame;
+    c6502_byte_t strobeReg,
+                 mode;
+};
+
+void Bus::stateLayout(StateHeader &hdr) const noexcept
+{
+    const uint32_t sizes[StateHeader::SECTION_COUNT] = {
+        sizeof(CoreState),
+        0x800u,
+        256u,
+        0x2000u,
+        0x2000u,
+        m_pCart && m_pCart->isReady() ? m_pCart->mapper()->stateSize() : 0u
+    };
+    hdr.init(sizes);
+}
+
+c6502_d_word_t Bus::stateSize() const noexcept
+{
+    StateHeader hdr;
+    stateLayout(hdr);
+    return hdr.size;
+}
+
+void Bus::saveState(c6502_byte_t *p) const noexcept
+{
+    assert(m_pCPU != nullptr && m_pPPU != nullptr);
+
+    StateHeader hdr;
+    stateLayout(hdr);
+    memcpy(p, &hdr, sizeof(hdr));
+
+    // Keep alignment gaps zeroed so that equal states give equal blobs
+    c6502_d_word_t end = sizeof(hdr);
+    for (const auto &s: hdr.sections)
+    {
+        memset(p + end, 0, s.offset - end);
+        end = s.offset + s.size;
+    }
+    memset(p + end, 0, hdr.size - end);
+
+    saveCore(p + hdr.sections[StateHeader::CORE].offset);
+
+    m_ram.Read(0, p + hdr.sections[StateHeader::RAM].offset, 0x800u);
+    m_spriteMem.Read(0, p + hdr.sections[StateHeader::SPRITE_MEM].offset, 256u);
+    m_vram.Read(0, p + hdr.sections[StateHeader::VRAM].offset, 0x2000u);
+    m_wram.Read(0, p + hdr.sections[StateHeader::WRAM].offset, 0x2000u);
+
+    if (hdr.sections[StateHeader::MAPPER].size > 0)
+        m_pCart->mapper()->saveState(p + hdr.sections[StateHeader::MAPPER].offset);
+}
+
+void Bus::saveState(std::vector<c6502_byte_t> &out) const
+{
+    out.resize(stateSize());
+    saveState(out.data());
+}
+
+void Bus::saveCore(c6502_byte_t *p) const noexcept
+{
+    CoreState core;
+    memset(static_cast<void*>(&core), 0, sizeof(core));
+    m_pCPU->saveState(core.cpu);
+    m_pPPU->saveState(core.ppu);
+    for (int i = 0; i < 2; i++)
+        if (m_pGamePads[i])
+            m_pGamePads[i]->saveState(core.pads[i]);
+    core.nFrame = m_nFrame;
+    core.strobeReg = m_strobeReg;
+    core.mode = static_cast<c6502_byte_t>(m_mode);
+    memcpy(p, &core, sizeof(core));
+}
+
+// Copy modified blocks of the storage to its image at @a p
+template <c6502_d_word_t SIZE, class TRACKING>
+static void copyDirty(Storage<SIZE, TRACKING> &mem, c6502_byte_t *p) noexcept
+{
+    mem.forEachDirty([&mem, p](c6502_d_word_t off, c6502_d_word_t len)
+    {
+        mem.Read(off, p + off, len);
+    });
+    mem.clearDirty();
+}
+
+void Bus::updateState(c6502_byte_t *p) noexcept
+{
+    assert(m_pCPU != nullptr && m_pPPU != nullptr);
+
+    StateHeader hdr;
+    memcpy(&hdr, p, sizeof(hdr));
+#ifndef NDEBUG
+    StateHeader expected;
+    stateLayout(expected);
+    assert(memcmp(&hdr, &expected, sizeof(hdr)) == 0 && "state was saved by another machine");
+#endif
+
+    saveCore(p + hdr.sections[StateHeader::CORE].offset);
+    copyDirty(m_ram, p + hdr.sections[StateHeader::RAM].offset);
+    copyDirty(m_spriteMem, p + hdr.sections[StateHeader::SPRITE_MEM].offset);
+    copyDirty(m_vram, p + hdr.sections[StateHeader::VRAM].offset);
+    copyDirty(m_wram, p + hdr.sections[StateHeader::WRAM].offset);
+
+    if (hdr.sections[StateHeader::MAPPER].size > 0)
+        m_pCart->mapper()->updateState(p + hdr.sections[StateHeader::MAPPER].offset);
+}
+
+void Bus::loadState(const c6502_byte_t *p, c6502_d_word_t size)
+{
+    assert(m_pCPU != nullptr && m_pPPU != nullptr);
+
+    if (size < sizeof(StateHeader))
+        throw Exception(Exception::IllegalFormat, "save state is truncated");
+
+    StateHeader hdr, expected;
+    memcpy(&hdr, p, sizeof(hdr));
+    if (!hdr.checkValid(size))
+        throw Exception(Exception::IllegalFormat, "incorrect save state header");
+
+    stateLayout(expected);
+    for (int i = 0; i < StateHeader::SECTION_COUNT; i++)
+        if (hdr.sections[i].size != expected.sections[i].size)
+            throw Exception(Exception::IllegalArgument, "save state does not match the cartridge");
+
+    CoreState core;
+    memcpy(&core, p + hdr.sections[StateHeader::CORE].offset, sizeof(core));
+    if (core.mode != static_cast<c6502_byte_t>(m_mode))
+        throw Exception(Exception::IllegalArgument, "save state output mode mismatch");
+
+    m_pCPU->loadState(core.cpu);
+    m_pPPU->loadState(core.ppu);
+    for (int i = 0; i < 2; i++)
+        if (m_pGamePads[i])
+            m_pGamePads[i]->loadState(core.pads[i]);
+    m_nFrame = core.nFrame;
+    m_strobeReg = core.strobeReg;
+
+    m_ram.Write(0, p + hdr.sections[StateHeader::RAM].offset, 0x800u);
+    m_spriteMem.Write(0, p + hdr.sections[StateHeader::SPRITE_MEM].offset, 256u);
+    m_vram.Write(0, p + hdr.sections[StateHeader::VRAM].offset, 0x2000u);
+    m_wram.Write(0, p + hdr.sections[StateHeader::WRAM].offset, 0x2000u);
+
+    if (hdr.sections[StateHeader::MAPPER].size > 0)
+        m_pCart->mapper()->loadState(p + hdr.sections[StateHeader::MAPPER].offset);
+}
+
+void Bus::copyStateFrom(const Bus &src) noexcept
+{
+    assert(m_pCPU != nullptr && m_pPPU != nullptr);
+    assert(src.m_pCPU != nullptr && src.m_pPPU != nullptr);
+    assert(m_mode == src.m_mode);
+
+    CPU6502::Snapshot cpu;
+    src.m_pCPU->saveState(cpu);
+    m_pCPU->loadState(cpu);
+
+    PPU::Snapshot ppu;
+    src.m_pPPU->saveState(ppu);
+    m_pPPU->loadState(ppu);
+
+    for (int i = 0; i < 2; i++)
+        if (m_pGamePads[i] && src.m_pGamePads[i])
+        {
+            Gamepad::Snapshot pad;
+            src.m_pGamePads[i]->saveState(pad);
+            m_pGamePads[i]->loadState(pad);
+        }
+
+    m_nFrame = src.m_nFrame;
+    m_strobeReg = src.m_strobeReg;
+
+    m_ram.Assign(src.m_ram);
+    m_spriteMem.Assign(src.m_spriteMem);
+    m_vram.Assign(src.m_vram);
+    m_wram.Assign(src.m_wram);
+
+    if (m_pCart && src.m_pCart && m_pCart->isReady())
+        m_pCart->mapper()->copyStateFrom(*src.m_pCart->mapper());
+}
@@ -0,0 +1,274 @@
+#include "b1capi.h"
+#include "machine.h"
+#include "framebuffer.h"
+#include "observation.h"
+
+#include <cstring>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+
+struct b1_machine
+{
+    std::unique_ptr<FrameBufferBackend> fb;
+    std::unique_ptr<Machine> machine;
+    std::unique_ptr<Observer> observer;
+};
+
+namespace
+{
+
+thread_local std::string t_lastError;
+
+int fail(int status, const char *msg) noexcept
+{
+    try
+    {
+        t_lastError = msg ? msg : "";
+    }
+    catch (...)
+    {
+    }
+    return status;
+}
+
+int fail(const Exception &ex) noexcept
+{
+    static const int STATUS[] = {
+        B1_ERROR_UNKNOWN,       // Unknown
+        B1_ERROR_IO,            // IOFailure
+        B1_ERROR_FORMAT,        // IllegalFormat
+        B1_ERROR_SIZE,          // SizeOverflow
+        B1_ERROR_ARGUMENT,      // IllegalArgument
+        B1_ERROR_STATE          // IllegalOperation
+    };
+
+    const int code = static_cast<int>(ex.code());
+    return fail(code >= 0 && code < static_cast<int>(sizeof(STATUS) / sizeof(STATUS[0])) ?
+                    STATUS[code] : B1_ERROR_UNKNOWN,
+                ex.message());
+}
+
+/// Run @a f, turning exceptions into status codes; nothing may leak through the C boundary
+template <typename F>
+int guarded(F f) noexcept
+{
+    try
+    {
+        return f();
+    }
+    catch (const Exception &ex)
+    {
+        return fail(ex);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return fail(B1_ERROR_MEMORY, "out of memory");
+    }
+    catch (...)
+    {
+        return fail(B1_ERROR_UNKNOWN, "unexpected error");
+    }
+}
+
+b1_machine *create(const Machine *src, unsigned flags)
+{
+    std::unique_ptr<b1_machine> m { new b1_machine };
+    if (!(flags & B1_NO_VIDEO))
+        m->fb.reset(new FrameBufferBackend);
+
+    if (src)
+        m->machine = src->clone(m->fb.get());
+    else
+        m->machine.reset(new Machine { flags & B1_PAL ? OutputMode::PAL : OutputMode::NTSC, m->fb.get() });
+
+    // Hidden frames don't depend on rendering (see Machine::setRunAhead())
+    if (!m->fb)
+        m->machine->ppu().setRenderingEnabled(false);
+
+    return m.release();
+}
+
+} // namespace
+
+int b1_api_version(void)
+{
+    return B1_API_VERSION;
+}
+
+const char *b1_last_error(void)
+{
+    return t_lastError.c_str();
+}
+
+b1_machine *b1_create(unsigned flags)
+{
+    b1_machine *m = nullptr;
+    guarded([&m, flags] {
+        m = create(nullptr, flags);
+        return B1_OK;
+    });
+    return m;
+}
+
+void b1_destroy(b1_machine *m)
+{
+    delete m;
+}
+
+b1_machine *b1_clone(const b1_machine *m)
+{
+    b1_machine *c = nullptr;
+    guarded([&c, m] {
+        if (!m || !m->machine->isReady())
+            return fail(B1_ERROR_ARGUMENT, "machine has no cartridge");
+
+        c = create(m->machine.get(), m->fb ? 0u : B1_NO_VIDEO);
+        return B1_OK;
+    });
+    return c;
+}
+
+int b1_load_nes(b1_machine *m, const void *data, size_t size)
+{
+    return guarded([=] {
+        if (!m || !data)
+            return fail(B1_ERROR_ARGUMENT, "null argument");
+
+        std::istringstream in { std::string(static_cast<const char*>(data), size),
+                                std::ios::in | std::ios::binary };
+        m->machine->loadNES(in);
+        return B1_OK;
+    });
+}
+
+int b1_load_raw(b1_machine *m, const void *data, size_t size)
+{
+    return guarded([=] {
+        if (!m || !data)
+            return fail(B1_ERROR_ARGUMENT, "null argument");
+
+        std::istringstream in { std::string(static_cast<const char*>(data), size),
+                                std::ios::in | std::ios::binary };
+        m->machine->loadRawData(in);
+        return B1_OK;
+    });
+}
+
+int b1_reset(b1_machine *m)
+{
+    if (!m || !m->machine->isReady())
+        return fail(B1_ERROR_STATE, "machine has no cartridge");
+
+    m->machine->reset();
+    return B1_OK;
+}
+
+int b1_power(b1_machine *m)
+{
+    if (!m || !m->machine->isReady())
+        return fail(B1_ERROR_STATE, "machine has no cartridge");
+
+    m->machine->power();
+    return B1_OK;
+}
+
+int b1_step_frames(b1_machine *const *machines, const b1_input *inputs, size_t n, int frames)
+{
+    if (!machines || frames < 0)
+        return fail(B1_ERROR_ARGUMENT, "invalid argument");
+
+    // Hot path: no allocations, no locks, the only check per machine is a pointer test
+    return guarded([=] {
+        for (size_t i = 0; i < n; i++)
+        {
+            b1_machine *m = machines[i];
+            if (!m || !m->machine->isReady())
+                return fail(B1_ERROR_STATE, "machine has no cartridge");
+
+            Machine &machine = *m->machine;
+            if (inputs)
+            {
+                machine.gamepad(0).setInput({ inputs[i].pad[0], 0u });
+                machine.gamepad(1).setInput({ inputs[i].pad[1], 0u });
+            }
+
+            for (int f = 0; f < frames; f++)
+                machine.runFrame();
+        }
+        return B1_OK;
+    });
+}
+
+int b1_get_view(const b1_machine *m, b1_view *view)
+{
+    if (!m || !view)
+        return fail(B1_ERROR_ARGUMENT, "null argument");
+
+    const Machine &machine = *m->machine;
+    view->ram = machine.bus().ram();
+    view->framebuffer = m->fb ? m->fb->pixels() : nullptr;
+    view->width = FrameBufferBackend::WIDTH;
+    view->height = FrameBufferBackend::HEIGHT;
+    view->audio = nullptr;
+    view->audio_samples = 0;
+    view->frame = static_cast<uint64_t>(machine.bus().currentFrame());
+    return B1_OK;
+}
+
+int b1_observe(b1_machine *m, uint8_t *out, int width, int height, unsigned flags)
+{
+    return guarded([=] {
+        if (!m || !out)
+            return fail(B1_ERROR_ARGUMENT, "null argument");
+        if (!m->fb)
+            return fail(B1_ERROR_STATE, "machine was created without video");
+
+        // Kept between calls for max-pooling, rebuilt when the format changes
+        const bool maxPool = (flags & B1_OBS_MAX_POOL) != 0;
+        Observer *obs = m->observer.get();
+        if (!obs || obs->width() != width || obs->height() != height || obs->maxPool() != maxPool)
+        {
+            m->observer.reset(new Observer { width, height, maxPool });
+            obs = m->observer.get();
+        }
+
+        obs->observe(m->fb->pixels(), out);
+        return B1_OK;
+    });
+}
+
+size_t b1_state_size(const b1_machine *m)
+{
+    return m && m->machine->isReady() ? m->machine->bus().stateSize() : 0;
+}
+
+int b1_save_state(const b1_machine *m, void *buf, size_t size)
+{
+    if (!m || !buf)
+        return fail(B1_ERROR_ARGUMENT, "null argument");
+    if (!m->machine->isReady())
+        return fail(B1_ERROR_STATE, "machine has no cartridge");
+    if (size < m->machine->bus().stateSize())
+        return fail(B1_ERROR_SIZE, "state buffer is too small");
+
+    m->machine->bus().saveState(static_cast<c6502_byte_t*>(buf));
+    return B1_OK;
+}
+
+int b1_load_state(b1_machine *m, const void *buf, size_t size)
+{
+    return guarded([=] {
+        if (!m || !buf)
+            return fail(B1_ERROR_ARGUMENT, "null argument");
+        if (!m->machine->isReady())
+            return fail(B1_ERROR_STATE, "machine has no cartridge");
+        if (size > 0xFFFFFFFFu)
+            return fail(B1_ERROR_SIZE, "state is too large");
+
+        m->machine->bus().loadState(static_cast<const c6502_byte_t*>(buf),
+                                    static_cast<c6502_d_word_t>(size));
+        return B1_OK;
+    });
+}
@@ -0,0 +1,48 @@
+#include "crc32.h"
+
+namespace
+{
+
+// Slicing-by-4 tables
+struct CRCTable
+{
+    c6502_d_word_t t[4][256];
+
+    CRCTable() noexcept
+    {
+        for (c6502_d_word_t i = 0; i < 256; i++)
+        {
+            c6502_d_word_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[0][i] = c;
+        }
+
+        for (c6502_d_word_t i = 0; i < 256; i++)
+            for (int s = 1; s < 4; s++)
+                t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFFu];
+    }
+};
+
+const CRCTable s_table;
+
+}
+
+c6502_d_word_t crc32(const void *p, size_t size, c6502_d_word_t crc) noexcept
+{
+    const auto &t = s_table.t;
+    auto b = static_cast<const c6502_byte_t*>(p);
+    crc = ~crc;
+
+    for (; size >= 4; size -= 4, b += 4)
+    {
+        crc ^= b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<c6502_d_word_t>(b[3]) << 24);
+        crc = t[3][crc & 0xFFu] ^ t[2][(crc >> 8) & 0xFFu] ^
+              t[1][(crc >> 16) & 0xFFu] ^ t[0][crc >> 24];
+    }
+
+    while (size-- > 0)
+        crc = t[0][(crc ^ *b++) & 0xFFu] ^ (crc >> 8);
+
+    return ~crc;
+}
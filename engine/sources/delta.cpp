@@ -0,0 +1,125 @@
+#include "delta.h"
+#include <cstring>
+
+// Literal run is closed after this many zero delta bytes
+static constexpr c6502_d_word_t MIN_ZERO_RUN = 8;
+
+static void putVarint(std::vector<c6502_byte_t> &out, c6502_d_word_t v)
+{
+    while (v >= 0x80u)
+    {
+        out.push_back(static_cast<c6502_byte_t>(v | 0x80u));
+        v >>= 7;
+    }
+    out.push_back(static_cast<c6502_byte_t>(v));
+}
+
+static bool getVarint(const c6502_byte_t *&p, const c6502_byte_t *end, c6502_d_word_t &v) noexcept
+{
+    v = 0;
+    for (int shift = 0; shift < 32 && p < end; shift += 7)
+    {
+        const c6502_byte_t b = *p++;
+        v |= static_cast<c6502_d_word_t>(b & 0x7Fu) << shift;
+        if ((b & 0x80u) == 0)
+            return true;
+    }
+    return false;
+}
+
+static uint64_t load64(const c6502_byte_t *p) noexcept
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Length of the run of equal bytes starting at @a i
+static c6502_d_word_t equalRun(const c6502_byte_t *cur,
+                               const c6502_byte_t *ref,
+                               c6502_d_word_t i,
+                               c6502_d_word_t size) noexcept
+{
+    const c6502_d_word_t start = i;
+    if (ref)
+    {
+        while (i + 8 <= size && load64(cur + i) == load64(ref + i))
+            i += 8;
+        while (i < size && cur[i] == ref[i])
+            i++;
+    }
+    else
+    {
+        while (i + 8 <= size && load64(cur + i) == 0)
+            i += 8;
+        while (i < size && cur[i] == 0)
+            i++;
+    }
+    return i - start;
+}
+
+void DeltaCodec::encode(const c6502_byte_t *cur,
+                        const c6502_byte_t *ref,
+                        c6502_d_word_t size,
+                        std::vector<c6502_byte_t> &out)
+{
+    c6502_d_word_t i = 0;
+    while (i < size)
+    {
+        const c6502_d_word_t zeroes = equalRun(cur, ref, i, size);
+        i += zeroes;
+        if (i == size)
+        {
+            if (zeroes > 0)
+            {
+                putVarint(out, zeroes);
+                putVarint(out, 0);
+            }
+            break;
+        }
+
+        // Collect literals until a long enough zero run or the end of block
+        const c6502_d_word_t litStart = i;
+        c6502_d_word_t litEnd = i;
+        while (litEnd < size)
+        {
+            const c6502_d_word_t run = equalRun(cur, ref, litEnd, size);
+            if (run >= MIN_ZERO_RUN || litEnd + run == size)
+                break;
+            litEnd += run + 1;
+        }
+
+        putVarint(out, zeroes);
+        putVarint(out, litEnd - litStart);
+        const auto pos = out.size();
+        out.resize(pos + (litEnd - litStart));
+        c6502_byte_t *pOut = out.data() + pos;
+        for (c6502_d_word_t j = litStart; j < litEnd; j++)
+            *pOut++ = ref ? cur[j] ^ ref[j] : cur[j];
+
+        i = litEnd;
+    }
+}
+
+bool DeltaCodec::apply(const c6502_byte_t *src,
+                       c6502_d_word_t srcSize,
+                       c6502_byte_t *dst,
+                       c6502_d_word_t dstSize) noexcept
+{
+    const c6502_byte_t *const end = src + srcSize;
+    c6502_d_word_t pos = 0;
+    while (src < end)
+    {
+        c6502_d_word_t zeroes, lits;
+        if (!getVarint(src, end, zeroes) || !getVarint(src, end, lits))
+            return false;
+        if (zeroes > dstSize - pos || lits > dstSize - pos - zeroes ||
+            lits > static_cast<c6502_d_word_t>(end - src))
+            return false;
+
+        pos += zeroes;
+        for (c6502_d_word_t j = 0; j < lits; j++)
+            dst[pos++] ^= *src++;
+    }
+    return true;
+}
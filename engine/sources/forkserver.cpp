@@ -0,0 +1,278 @@
+#include "forkserver.h"
+#include "machine.h"
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+constexpr char ForkServer::MAGIC[4];
+constexpr int ForkServer::REQUEST_TIMEOUT_MS;
+constexpr size_t ForkServer::MAX_PENDING;
+
+namespace
+{
+
+sockaddr_un socketAddress(const char *path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        throw Exception(Exception::IllegalArgument, "socket path is too long");
+    strcpy(addr.sun_path, path);
+    return addr;
+}
+
+bool sendAll(int fd, const void *p, size_t size) noexcept
+{
+    const char *c = static_cast<const char*>(p);
+    while (size > 0)
+    {
+        // No SIGPIPE when the client is gone, the server must survive it
+        const ssize_t n = send(fd, c, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        c += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool receiveAll(int fd, void *p, size_t size) noexcept
+{
+    char *c = static_cast<char*>(p);
+    while (size > 0)
+    {
+        const ssize_t n = recv(fd, c, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        c += n;
+        size -= n;
+    }
+    return true;
+}
+
+}
+
+ForkServer::ForkServer(const char *path)
+{
+    const sockaddr_un addr = socketAddress(path);
+
+    m_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listen < 0)
+        throw Exception(Exception::IOFailure, "unable to create a socket");
+
+    unlink(path);
+    if (bind(m_listen, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(m_listen, 64) != 0)
+    {
+        close(m_listen);
+        throw Exception(Exception::IOFailure, "unable to listen at the socket path");
+    }
+
+    m_path = new char[strlen(path) + 1];
+    strcpy(m_path, path);
+}
+
+ForkServer::~ForkServer()
+{
+    close(m_listen);
+    for (const Pending &p: m_pending)
+        close(p.fd);
+    unlink(m_path);
+    delete[] m_path;
+
+    // Children keep running, only their exit status is collected
+    reap();
+}
+
+uint32_t ForkServer::add(std::unique_ptr<Machine> machine)
+{
+    if (!machine || !machine->isReady())
+        throw Exception(Exception::IllegalArgument, "machine has no cartridge");
+
+    m_machines.push_back(std::move(machine));
+    return static_cast<uint32_t>(m_machines.size() - 1);
+}
+
+void ForkServer::serve(const Handler &handler)
+{
+    while (!m_stop)
+        serveOne(handler, 100);
+}
+
+bool ForkServer::serveOne(const Handler &handler, int timeoutMs)
+{
+    using std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+
+    reap();
+
+    // Wait for new connections and for the requests still being sent, but
+    // not past the earliest deadline; with too many of the latter, new
+    // connections wait in the backlog
+    steady_clock::time_point now = steady_clock::now();
+    const short accepting = m_pending.size() < MAX_PENDING ? POLLIN : 0;
+    std::vector<pollfd> pfds { { m_listen, accepting, 0 } };
+    for (const Pending &p: m_pending)
+    {
+        pfds.push_back({ p.fd, POLLIN, 0 });
+        const auto left = std::chrono::duration_cast<milliseconds>(p.deadline - now).count() + 1;
+        if (timeoutMs < 0 || left < timeoutMs)
+            timeoutMs = left > 0 ? static_cast<int>(left) : 0;
+    }
+
+    if (poll(pfds.data(), pfds.size(), timeoutMs) < 0)
+        return false;
+
+    if (pfds[0].revents & POLLIN)
+    {
+        const int fd = accept(m_listen, nullptr, nullptr);
+        if (fd >= 0)
+        {
+            // The client has most likely sent its request already
+            m_pending.push_back({ fd, 0, steady_clock::now() + milliseconds(REQUEST_TIMEOUT_MS), ForkRequest() });
+            pfds.push_back({ fd, POLLIN, POLLIN });
+        }
+    }
+
+    bool started = false;
+    now = steady_clock::now();
+    for (size_t i = 0; i < m_pending.size(); )
+    {
+        Pending &p = m_pending[i];
+        bool failed = false;
+        if (pfds[i + 1].revents != 0)
+        {
+            const ssize_t n = recv(p.fd, reinterpret_cast<char*>(&p.req) + p.received,
+                                   sizeof(p.req) - p.received, MSG_DONTWAIT);
+            if (n > 0)
+                p.received += n;
+            else
+                failed = n == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK);
+        }
+
+        const bool complete = p.received == sizeof(p.req);
+        if (!complete && !failed && now < p.deadline)
+        {
+            i++;
+            continue;
+        }
+
+        const int fd = p.fd;
+        const ForkRequest req = p.req;
+        // Keep the poll results in step with the pending connections
+        m_pending.erase(m_pending.begin() + i);
+        pfds.erase(pfds.begin() + i + 1);
+
+        if (!complete ||
+            memcmp(req.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            req.machine >= m_machines.size())
+            reject(fd, BAD_REQUEST);
+        else
+            started |= start(handler, fd, req);
+    }
+
+    return started;
+}
+
+void ForkServer::reject(int fd, int32_t status) noexcept
+{
+    const ForkReply reply = { status, 0 };
+    sendAll(fd, &reply, sizeof(reply));
+    close(fd);
+    m_stats.rejected++;
+}
+
+bool ForkServer::start(const Handler &handler, int fd, const ForkRequest &req)
+{
+    const pid_t pid = fork();
+    if (pid == 0)
+        runChild(handler, fd, req);
+
+    if (pid < 0)
+    {
+        reject(fd, FORK_FAILED);
+        return false;
+    }
+
+    m_stats.started++;
+    // The connection belongs to the child now
+    close(fd);
+    return true;
+}
+
+void ForkServer::runChild(const Handler &handler, int fd, const ForkRequest &req) noexcept
+{
+    close(m_listen);
+    for (const Pending &p: m_pending)
+        close(p.fd);
+
+    int code = 1;
+    const ForkReply reply = { 0, static_cast<int32_t>(getpid()) };
+    if (sendAll(fd, &reply, sizeof(reply)))
+    {
+        try
+        {
+            code = handler(*m_machines[req.machine], fd, req);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    // No destructors, no atexit handlers: they belong to the server
+    _exit(code);
+}
+
+void ForkServer::reap() noexcept
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        if (WIFSIGNALED(status))
+            m_stats.crashed++;
+        else
+            m_stats.exited++;
+    }
+}
+
+int ForkServer::spawn(const char *path, ForkRequest req, int32_t *pPid)
+{
+    const sockaddr_un addr = socketAddress(path);
+    memcpy(req.magic, MAGIC, sizeof(MAGIC));
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw Exception(Exception::IOFailure, "unable to create a socket");
+
+    ForkReply reply;
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        !sendAll(fd, &req, sizeof(req)) ||
+        !receiveAll(fd, &reply, sizeof(reply)))
+    {
+        close(fd);
+        throw Exception(Exception::IOFailure, "fork server is not reachable");
+    }
+
+    if (reply.status != 0)
+    {
+        close(fd);
+        throw Exception(reply.status == BAD_REQUEST ? Exception::IllegalArgument : Exception::IllegalOperation,
+                        reply.status == BAD_REQUEST ? "fork server rejected the request" :
+                                                      "fork server failed to start a child");
+    }
+
+    if (pPid)
+        *pPid = reply.pid;
+    return fd;
+}
@@ -0,0 +1,81 @@
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr int FrameBufferBackend::WIDTH;
+constexpr int FrameBufferBackend::HEIGHT;
+constexpr int FrameBufferBackend::LAYER_COUNT;
+
+// NES palette as RGB555 (red in the high bits), the same as the OpenGL frontend uses
+static const uint16_t NES_PALETTE[64] = {
+    0x39CE, 0x1071, 0x0015, 0x2013, 0x440E, 0x5402, 0x5000, 0x3C20,
+    0x20A0, 0x0100, 0x0140, 0x00E2, 0x0CEB, 0x0000, 0x0000, 0x0000,
+    0x5EF7, 0x01DD, 0x10FD, 0x401E, 0x5C17, 0x700B, 0x6CA0, 0x6521,
+    0x45C0, 0x0240, 0x02A0, 0x0247, 0x0211, 0x0000, 0x0000, 0x0000,
+    0x7FFF, 0x1EFF, 0x2E5F, 0x663F, 0x79FF, 0x7DD6, 0x7DCC, 0x7E67,
+    0x7AE7, 0x4342, 0x2769, 0x2FF3, 0x03BB, 0x3DEF, 0x0000, 0x0000,
+    0x7FFF, 0x579F, 0x635F, 0x6B3F, 0x7F1F, 0x7F1B, 0x7EF6, 0x7F75,
+    0x7F94, 0x73F4, 0x57D7, 0x5BF9, 0x4FFE, 0x6318, 0x0000, 0x0000
+};
+
+const uint16_t *FrameBufferBackend::palette() noexcept
+{
+    return NES_PALETTE;
+}
+
+FrameBufferBackend::FrameBufferBackend():
+    m_pixels(WIDTH * HEIGHT, 0)
+{
+    // Full screen of background tiles plus sprites, so drawing doesn't allocate
+    m_layers[static_cast<int>(Layer::BACKGROUND)].reserve(33 * 31);
+    m_layers[static_cast<int>(Layer::BEHIND)].reserve(128);
+    m_layers[static_cast<int>(Layer::FRONT)].reserve(128);
+}
+
+void FrameBufferBackend::setBackground(c6502_byte_t color)
+{
+    m_background = color & 0x3Fu;
+}
+
+void FrameBufferBackend::setSymbol(Layer l, int x, int y, c6502_byte_t colorData[64])
+{
+    // Tiles entirely off screen never show up
+    if (x <= -8 || x >= WIDTH || y <= -8 || y >= HEIGHT)
+        return;
+
+    auto &layer = m_layers[static_cast<int>(l)];
+    layer.emplace_back();
+    Tile &t = layer.back();
+    t.x = x;
+    t.y = y;
+    memcpy(t.data, colorData, sizeof(t.data));
+}
+
+void FrameBufferBackend::draw()
+{
+    c6502_byte_t *out = m_pixels.data();
+    memset(out, m_background, m_pixels.size());
+
+    for (auto &layer: m_layers)
+    {
+        for (const Tile &t: layer)
+        {
+            const int x0 = std::max(t.x, 0),
+                      x1 = std::min(t.x + 8, WIDTH),
+                      y0 = std::max(t.y, 0),
+                      y1 = std::min(t.y + 8, HEIGHT);
+            for (int y = y0; y < y1; y++)
+            {
+                const c6502_byte_t *src = t.data + (y - t.y) * 8;
+                c6502_byte_t *dst = out + y * WIDTH;
+                for (int x = x0; x < x1; x++)
+                    if (src[x - t.x] != 0)
+                        dst[x] = src[x - t.x] & 0x3Fu;
+            }
+        }
+        layer.clear();
+    }
+
+    m_nFrames++;
+}
@@ -0,0 +1,154 @@
+#include "framering.h"
+#include "framebuffer.h"
+#include "machine.h"
+#include "crc32.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+constexpr char FrameRingLayout::MAGIC[4];
+constexpr uint32_t FrameRingLayout::VERSION;
+constexpr uint32_t FrameRingLayout::WIDTH;
+constexpr uint32_t FrameRingLayout::HEIGHT;
+constexpr uint32_t FrameRingLayout::RAM_SIZE;
+constexpr uint32_t FrameRingLayout::AUDIO_CAPACITY;
+constexpr uint32_t FrameRingLayout::SLOT_SIZE;
+
+static_assert(sizeof(FrameRingLayout::Header) == 64 && sizeof(FrameRingLayout::Slot) == 64,
+              "ring headers must keep their size, other processes depend on it");
+static_assert(FrameRingLayout::WIDTH == FrameBufferBackend::WIDTH &&
+              FrameRingLayout::HEIGHT == FrameBufferBackend::HEIGHT,
+              "frame size mismatch");
+
+static FrameRingLayout::Slot *slotAt(void *mem, uint64_t n, uint32_t slotCount) noexcept
+{
+    return reinterpret_cast<FrameRingLayout::Slot*>(static_cast<char*>(mem) + sizeof(FrameRingLayout::Header) +
+                                                    (n % slotCount) * FrameRingLayout::SLOT_SIZE);
+}
+
+FrameRingWriter::FrameRingWriter(const char *name, uint32_t slotCount)
+{
+    if (slotCount == 0 || slotCount > 4096)
+        throw Exception(Exception::IllegalArgument, "unsupported number of ring slots");
+
+    // A stale ring of a crashed writer is replaced, its readers keep the old mapping
+    shm_unlink(name);
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        throw Exception(Exception::IOFailure, "unable to create the shared memory object");
+
+    m_size = FrameRingLayout::totalSize(slotCount);
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(m_size)) == 0)
+        p = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(name);
+        throw Exception(Exception::IOFailure, "unable to map the shared memory object");
+    }
+
+    m_pMem = p;
+    m_name = new char[strlen(name) + 1];
+    strcpy(m_name, name);
+
+    // Fresh object is zero filled: all sequence counters are 0, no frame is valid
+    m_pHeader = static_cast<FrameRingLayout::Header*>(p);
+    m_pHeader->version = FrameRingLayout::VERSION;
+    m_pHeader->slotCount = slotCount;
+    m_pHeader->slotSize = FrameRingLayout::SLOT_SIZE;
+    m_pHeader->published.store(0, std::memory_order_relaxed);
+
+    // Magic last: readers check it before anything else
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_pHeader->magic, FrameRingLayout::MAGIC, sizeof(m_pHeader->magic));
+}
+
+FrameRingWriter::~FrameRingWriter()
+{
+    munmap(m_pMem, m_size);
+    shm_unlink(m_name);
+    delete[] m_name;
+}
+
+void FrameRingWriter::publish(const Machine &m, const FrameBufferBackend *fb) noexcept
+{
+    using Layout = FrameRingLayout;
+
+    const uint64_t n = m_published;
+    Layout::Slot *s = slotAt(m_pMem, n, m_pHeader->slotCount);
+
+    s->seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    c6502_byte_t *pixels = s->pixels();
+    if (fb)
+    {
+        memcpy(pixels, fb->pixels(), Layout::WIDTH * Layout::HEIGHT);
+        s->frameHash = crc32(pixels, Layout::WIDTH * Layout::HEIGHT);
+    }
+    else
+    {
+        memset(pixels, 0, Layout::WIDTH * Layout::HEIGHT);
+        s->frameHash = 0;
+    }
+    memcpy(pixels + Layout::WIDTH * Layout::HEIGHT, m.bus().ram(), Layout::RAM_SIZE);
+    s->frame = static_cast<uint64_t>(m.bus().currentFrame());
+    s->audioSamples = 0;
+
+    s->seq.store(2 * n + 2, std::memory_order_release);
+    m_pHeader->published.store(n + 1, std::memory_order_release);
+    m_published = n + 1;
+}
+
+FrameRingReader::FrameRingReader(const char *name)
+{
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        throw Exception(Exception::IOFailure, "unable to open the shared memory object");
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(FrameRingLayout::Header)))
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+        throw Exception(Exception::IOFailure, "unable to map the shared memory object");
+
+    m_pMem = p;
+    m_size = st.st_size;
+    m_pHeader = static_cast<const FrameRingLayout::Header*>(p);
+
+    const bool ok = memcmp(m_pHeader->magic, FrameRingLayout::MAGIC, sizeof(m_pHeader->magic)) == 0 &&
+                    m_pHeader->version == FrameRingLayout::VERSION &&
+                    m_pHeader->slotSize == FrameRingLayout::SLOT_SIZE &&
+                    m_pHeader->slotCount > 0 &&
+                    FrameRingLayout::totalSize(m_pHeader->slotCount) <= m_size;
+    if (!ok)
+    {
+        munmap(p, m_size);
+        throw Exception(Exception::IllegalFormat, "not a frame ring");
+    }
+}
+
+FrameRingReader::~FrameRingReader()
+{
+    munmap(const_cast<void*>(m_pMem), m_size);
+}
+
+const FrameRingLayout::Slot *FrameRingReader::slot(uint64_t n) const noexcept
+{
+    const auto *s = slotAt(const_cast<void*>(m_pMem), n, m_pHeader->slotCount);
+    return s->seq.load(std::memory_order_acquire) == 2 * n + 2 ? s : nullptr;
+}
+
+bool FrameRingReader::valid(const FrameRingLayout::Slot *s, uint64_t n) const noexcept
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s->seq.load(std::memory_order_relaxed) == 2 * n + 2;
+}
@@ -17,6 +17,28 @@ void Gamepad::buttonEvent(Button b, bool pressed, bool turbo, bool pad2) noexcep
     m_turboOn[i] = turbo;
 }
 
+Gamepad::Input Gamepad::input() const noexcept
+{
+    Input in = { 0u, 0u };
+    for (int i = 0; i < 16; i++)
+    {
+        if (m_buttonState[i])
+            in.pressed |= 1u << i;
+        if (m_turboOn[i])
+            in.turbo |= 1u << i;
+    }
+    return in;
+}
+
+void Gamepad::setInput(const Input &in) noexcept
+{
+    for (int i = 0; i < 16; i++)
+    {
+        m_buttonState[i] = (in.pressed >> i) & 1u;
+        m_turboOn[i] = (in.turbo >> i) & 1u;
+    }
+}
+
 bool Gamepad::turboTest(int btnInd) const noexcept
 {
     if (!m_turboOn[btnInd])
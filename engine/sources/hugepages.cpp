@@ -0,0 +1,62 @@
+#include "hugepages.h"
+
+#include <new>
+#include <sys/mman.h>
+
+constexpr size_t HugePageBlock::HUGE_PAGE_SIZE;
+
+const char *pageModeName(PageMode mode) noexcept
+{
+    switch (mode)
+    {
+        case PageMode::Transparent:
+            return "thp";
+        case PageMode::HugeTLB:
+            return "hugetlb";
+        default:
+            return "normal";
+    }
+}
+
+HugePageBlock::HugePageBlock(size_t size, PageMode mode)
+{
+    m_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    if (m_size == 0)
+        m_size = HUGE_PAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+    if (mode == PageMode::HugeTLB)
+    {
+        void *p = mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+        {
+            m_pMem = p;
+            m_mode = PageMode::HugeTLB;
+            return;
+        }
+    }
+#endif
+
+    // One extra huge page to align the start: THP backs only aligned ranges
+    char *p = static_cast<char*>(mmap(nullptr, m_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (p == MAP_FAILED)
+        throw std::bad_alloc();
+
+    const size_t head = (HUGE_PAGE_SIZE - reinterpret_cast<uintptr_t>(p) % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+    if (head > 0)
+        munmap(p, head);
+    munmap(p + head + m_size, HUGE_PAGE_SIZE - head);
+    m_pMem = p + head;
+
+#ifdef MADV_HUGEPAGE
+    if (mode != PageMode::Normal && madvise(m_pMem, m_size, MADV_HUGEPAGE) == 0)
+        m_mode = PageMode::Transparent;
+#endif
+}
+
+HugePageBlock::~HugePageBlock()
+{
+    munmap(m_pMem, m_size);
+}
@@ -77,65 +77,61 @@ void ROMLoader::loadNES(const char *file)
     if (!in.is_open())
         throw Exception(Exception::IOFailure, "unable to open the file");
 
+    loadNES(in);
+}
+
+void ROMLoader::loadNES(istream &in)
+{
     // Read & check header
-    try
+    sread(&m_hdr, sizeof(NESHeader), in);
+
+    if (!m_hdr.checkValid())
+        throw Exception(Exception::IllegalFormat, "incorrect NES ROM header");
+
+    c6502_byte_t zeroes[6];
+    sread(zeroes, 6, in);
+
+    for (int i = 0; i < 6; i++)
+        if (zeroes[i] != 0)
+            throw Exception(Exception::IllegalFormat, "unexpected data");
+
+    if (m_hdr.hasTrainer)
+    {
+        c6502_byte_t train[512];
+        sread(train, 512, in);
+        m_cart.setTrainer(train);
+    }
+
+    if (m_hdr.fourScreenVRAM)
+        m_cart.setMirroring(Mirroring::FourScreen);
+    else if (m_hdr.mirror)
+        m_cart.setMirroring(Mirroring::Vertical);
+    else
+        m_cart.setMirroring(Mirroring::Horizontal);
+
+    // RAM counter fixup for compatibility
+    const int nRAMs = (m_hdr.hasRAM && m_hdr.nRAMs == 0) ? 1 : m_hdr.nRAMs;
+    m_cart.setMapper(m_hdr.mapperLo | (m_hdr.mapperHi << 4),
+                     m_hdr.nROMs,
+                     m_hdr.nVROMs,
+                     nRAMs);
+    Mapper *map = m_cart.mapper();
+
+    c6502_byte_t rom[Mapper::ROM_SIZE];
+    for (int i = 0; i < m_hdr.nROMs; i++)
     {
-        sread(&m_hdr, sizeof(NESHeader), in);
-
-        if (!m_hdr.checkValid())
-            throw Exception(Exception::IllegalFormat, "incorrect NES ROM header");
-
-        c6502_byte_t zeroes[6];
-        sread(zeroes, 6, in);
-
-        for (int i = 0; i < 6; i++)
-            if (zeroes[i] != 0)
-                throw Exception(Exception::IllegalFormat, "unexpected data");
-
-        if (m_hdr.hasTrainer)
-        {
-            c6502_byte_t train[512];
-            sread(train, 512, in);
-            m_cart.setTrainer(train);
-        }
-
-        if (m_hdr.fourScreenVRAM)
-            m_cart.setMirroring(Mirroring::FourScreen);
-        else if (m_hdr.mirror)
-            m_cart.setMirroring(Mirroring::Vertical);
-        else
-            m_cart.setMirroring(Mirroring::Horizontal);
-
-        // RAM counter fixup for compatibility
-        const int nRAMs = (m_hdr.hasRAM && m_hdr.nRAMs == 0) ? 1 : m_hdr.nRAMs;
-        m_cart.setMapper(m_hdr.mapperLo | (m_hdr.mapperHi << 4),
-                         m_hdr.nROMs,
-                         m_hdr.nVROMs,
-                         nRAMs);
-        Mapper *map = m_cart.mapper();
-
-        c6502_byte_t rom[Mapper::ROM_SIZE];
-        for (int i = 0; i < m_hdr.nROMs; i++)
-        {
-            sread(rom, Mapper::ROM_SIZE, in);
-            map->setROMBank(i, rom);
-        }
-
-        c6502_byte_t vrom[Mapper::VROM_SIZE];
-        for (int i = 0; i < m_hdr.nVROMs; i++)
-        {
-            sread(vrom, Mapper::VROM_SIZE, in);
-            map->setVROMBank(i, vrom);
-        }
-
-        // No data left
-        if (in.get() != ifstream::traits_type::eof())
-            throw Exception(Exception::IllegalFormat, "enormous file size excession");
+        sread(rom, Mapper::ROM_SIZE, in);
+        map->setROMBank(i, rom);
     }
-    catch (const Exception&)
+
+    c6502_byte_t vrom[Mapper::VROM_SIZE];
+    for (int i = 0; i < m_hdr.nVROMs; i++)
     {
-        in.close();
-        throw;
+        sread(vrom, Mapper::VROM_SIZE, in);
+        map->setVROMBank(i, vrom);
     }
-    in.close();
+
+    // No data left
+    if (in.get() != istream::traits_type::eof())
+        throw Exception(Exception::IllegalFormat, "enormous file size excession");
 }
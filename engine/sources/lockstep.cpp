@@ -0,0 +1,219 @@
+#include "lockstep.h"
+#include "machine.h"
+#include "movie.h"
+#include "state.h"
+#include "crc32.h"
+
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr int LockstepChecker::WINDOW;
+
+namespace
+{
+
+// Frames produced by one of the machines, kept until compared
+struct Lane
+{
+    std::vector<c6502_byte_t> states;
+    CPU6502::Reg regs[LockstepChecker::WINDOW];
+    c6502_d_word_t stateSize;
+    int produced = 0;
+
+    const c6502_byte_t *state(int frame) const noexcept
+    {
+        return states.data() + (frame % LockstepChecker::WINDOW) * stateSize;
+    }
+};
+
+struct Region
+{
+    const char *name;
+    StateHeader::Section section;
+};
+
+const Region REGIONS[] = {
+    { "RAM", StateHeader::RAM },
+    { "OAM", StateHeader::SPRITE_MEM },
+    { "VRAM", StateHeader::VRAM },
+    { "WRAM", StateHeader::WRAM }
+};
+
+}
+
+static c6502_d_word_t regionCRC(const c6502_byte_t *state, StateHeader::Section s) noexcept
+{
+    StateHeader hdr;
+    memcpy(&hdr, state, sizeof(hdr));
+    return crc32(state + hdr.sections[s].offset, hdr.sections[s].size);
+}
+
+static LockstepChecker::Digest digest(const c6502_byte_t *state, const CPU6502::Reg &regs) noexcept
+{
+    LockstepChecker::Digest d;
+    d.cpu = crc32(&regs, sizeof(regs));
+    d.ram = regionCRC(state, StateHeader::RAM);
+    d.oam = regionCRC(state, StateHeader::SPRITE_MEM);
+    d.vram = regionCRC(state, StateHeader::VRAM);
+    d.wram = regionCRC(state, StateHeader::WRAM);
+    return d;
+}
+
+static void appendf(std::string &s, const char *fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    s += buf;
+}
+
+static void appendRegs(std::string &s, const CPU6502::Reg &r)
+{
+    appendf(s, "A=%02X X=%02X Y=%02X S=%02X P=%02X PC=%04X", r.a, r.x, r.y, r.s, r.p, r.pc);
+}
+
+static std::string describe(const LockstepChecker::Result &res,
+                            const c6502_byte_t *stateA,
+                            const c6502_byte_t *stateB)
+{
+    constexpr int MAX_LISTED = 8;
+
+    std::string s;
+    appendf(s, "machines diverged at frame %d\n", res.frame);
+
+    if (!(res.digests[0].cpu == res.digests[1].cpu))
+    {
+        s += "  CPU  ";
+        appendRegs(s, res.regs[0]);
+        s += "  vs  ";
+        appendRegs(s, res.regs[1]);
+        s += '\n';
+    }
+
+    StateHeader hdr;
+    memcpy(&hdr, stateA, sizeof(hdr));
+    for (const auto &r: REGIONS)
+    {
+        const auto &sec = hdr.sections[r.section];
+        const c6502_byte_t *a = stateA + sec.offset,
+                           *b = stateB + sec.offset;
+        if (memcmp(a, b, sec.size) == 0)
+            continue;
+
+        int count = 0;
+        std::string listed;
+        for (c6502_d_word_t i = 0; i < sec.size; i++)
+        {
+            if (a[i] == b[i])
+                continue;
+            if (count++ < MAX_LISTED)
+                appendf(listed, " %04X:%02X/%02X", i, a[i], b[i]);
+        }
+
+        appendf(s, "  %-4s %d byte(s) differ, offset:A/B%s%s\n",
+                r.name, count, listed.c_str(), count > MAX_LISTED ? " ..." : "");
+    }
+
+    return s;
+}
+
+LockstepChecker::Result LockstepChecker::run(const Movie &movie)
+{
+    // Players load the start state and validate the ROM, so create them here
+    std::unique_ptr<MoviePlayer> players[2];
+    Lane lanes[2];
+    for (int i = 0; i < 2; i++)
+    {
+        players[i].reset(new MoviePlayer { *m_machines[i], movie });
+        lanes[i].stateSize = m_machines[i]->bus().stateSize();
+        lanes[i].states.resize(lanes[i].stateSize * WINDOW);
+    }
+
+    if (lanes[0].stateSize != lanes[1].stateSize)
+        throw Exception(Exception::IllegalArgument, "machines run different cartridges");
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int consumed = 0;
+    bool stop = false;
+
+    auto worker = [&](int n)
+    {
+        Machine &m = *m_machines[n];
+        Lane &lane = lanes[n];
+        CPU6502::Snapshot cpu;
+
+        for (int f = 0; f < movie.length(); f++)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return stop || f - consumed < WINDOW; });
+                if (stop)
+                    return;
+            }
+
+            // Slot f % WINDOW has been compared, nobody reads it now
+            players[n]->runFrame();
+            m.bus().saveState(lane.states.data() + (f % WINDOW) * lane.stateSize);
+            m.cpu().saveState(cpu);
+            lane.regs[f % WINDOW] = cpu.regs;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                lane.produced = f + 1;
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::thread threads[2] = { std::thread(worker, 0), std::thread(worker, 1) };
+
+    Result res = { };
+    res.frame = -1;
+    for (int f = 0; f < movie.length(); f++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return lanes[0].produced > f && lanes[1].produced > f; });
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            res.regs[i] = lanes[i].regs[f % WINDOW];
+            res.digests[i] = digest(lanes[i].state(f), res.regs[i]);
+        }
+
+        const bool diverged = !(res.digests[0] == res.digests[1]);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (diverged)
+                stop = true;
+            else
+                consumed = f + 1;
+        }
+        cv.notify_all();
+
+        if (diverged)
+        {
+            res.diverged = true;
+            res.frame = f;
+            res.report = describe(res, lanes[0].state(f), lanes[1].state(f));
+            break;
+        }
+
+        res.frames = f + 1;
+    }
+
+    for (auto &t: threads)
+        t.join();
+
+    return res;
+}
@@ -0,0 +1,115 @@
+#include "machine.h"
+#include "loader.h"
+#include "mappers.h"
+#include <chrono>
+
+constexpr size_t Machine::ARENA_SIZE;
+
+static_assert(sizeof(DefaultMapper) + sizeof(Mapper::CHR_RAM_BANK) + sizeof(Mapper::RAM_BANK) +
+              2 * Arena::ALIGNMENT <= Machine::ARENA_SIZE,
+              "common cartridges must fit in the machine arena");
+
+Machine::Machine(OutputMode mode, PPU::RenderingBackend *pBackend):
+    m_ppu { pBackend ? pBackend : &m_nullBackend },
+    m_bus { mode },
+    m_arena { m_arenaMem, sizeof(m_arenaMem) },
+    m_cart { &m_arena }
+{
+    connect();
+}
+
+Machine::Machine(const Machine &src, PPU::RenderingBackend *pBackend):
+    m_ppu { pBackend ? pBackend : &m_nullBackend },
+    m_bus { src.m_bus.getMode() },
+    m_arena { m_arenaMem, sizeof(m_arenaMem) },
+    m_cart { src.m_cart, &m_arena }
+{
+    connect();
+
+    if (src.isReady())
+    {
+        m_bus.injectCartrige(&m_cart);
+        copyStateFrom(src);
+    }
+}
+
+void Machine::connect() noexcept
+{
+    m_bus.setCPU(&m_cpu);
+    m_bus.setPPU(&m_ppu);
+    m_bus.setGamePad(0, &m_pads[0]);
+    m_bus.setGamePad(1, &m_pads[1]);
+}
+
+void Machine::loadNES(const char *file)
+{
+    ROMLoader loader { m_cart };
+    loader.loadNES(file);
+    m_bus.injectCartrige(&m_cart);
+}
+
+void Machine::loadNES(std::istream &in)
+{
+    ROMLoader loader { m_cart };
+    loader.loadNES(in);
+    m_bus.injectCartrige(&m_cart);
+}
+
+void Machine::loadRawData(std::istream &in)
+{
+    ROMLoader loader { m_cart };
+    loader.loadRawData(in);
+    m_bus.injectCartrige(&m_cart);
+}
+
+void Machine::reset()
+{
+    assert(isReady());
+    m_cpu.reset();
+}
+
+void Machine::power()
+{
+    assert(isReady());
+    m_bus.injectCartrige(&m_cart);
+}
+
+void Machine::runFrame()
+{
+    if (m_runAhead == 0)
+    {
+        m_bus.runFrame();
+        return;
+    }
+
+    using std::chrono::steady_clock;
+
+    // Real frame, its picture is already outdated
+    m_ppu.setRenderingEnabled(false);
+    m_bus.runFrame();
+    const auto realDone = steady_clock::now();
+
+    m_bus.saveState(m_runAheadState);
+    for (int i = 1; i < m_runAhead; i++)
+        m_bus.runFrame();
+    m_ppu.setRenderingEnabled(true);
+    m_bus.runFrame();
+    m_bus.loadState(m_runAheadState.data(), m_runAheadState.size());
+
+    const double overhead =
+        std::chrono::duration<double, std::micro>(steady_clock::now() - realDone).count();
+    auto &st = m_runAheadStats;
+    st.lastOverheadUs = overhead;
+    st.avgOverheadUs = st.avgOverheadUs > 0 ? st.avgOverheadUs * 0.95 + overhead * 0.05 : overhead;
+}
+
+std::unique_ptr<Machine> Machine::clone(PPU::RenderingBackend *pBackend) const
+{
+    return std::unique_ptr<Machine> { new Machine { *this, pBackend } };
+}
+
+Machine *Machine::cloneAt(void *mem, PPU::RenderingBackend *pBackend) const
+{
+    assert(reinterpret_cast<uintptr_t>(mem) % alignof(Machine) == 0);
+    return ::new (mem) Machine { *this, pBackend };
+}
@@ -0,0 +1,85 @@
+#include "mappedstate.h"
+#include "bus.h"
+#include "state.h"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+constexpr uint32_t MappedState::FILE_ALIGN;
+
+void MappedState::write(const Bus &bus, const char *file)
+{
+    std::vector<c6502_byte_t> blob;
+    bus.saveState(blob);
+
+    StateHeader src, hdr;
+    memcpy(&src, blob.data(), sizeof(src));
+    uint32_t sizes[StateHeader::SECTION_COUNT];
+    for (int i = 0; i < StateHeader::SECTION_COUNT; i++)
+        sizes[i] = src.sections[i].size;
+    hdr.init(sizes, FILE_ALIGN);
+
+    std::vector<c6502_byte_t> out(hdr.size);
+    for (int i = 0; i < StateHeader::SECTION_COUNT; i++)
+        memcpy(out.data() + hdr.sections[i].offset, blob.data() + src.sections[i].offset, sizes[i]);
+    hdr.computeCRCs(out.data());
+    memcpy(out.data(), &hdr, sizeof(hdr));
+
+    std::ofstream f(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!f.is_open())
+        throw Exception(Exception::IOFailure, "unable to create the state file");
+    f.write(reinterpret_cast<const char*>(out.data()), out.size());
+    if (!f.good())
+        throw Exception(Exception::IOFailure, "unable to write the state file");
+}
+
+MappedState::MappedState(const char *file)
+{
+    const int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        throw Exception(Exception::IOFailure, "unable to open the file");
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(StateHeader)) ||
+        st.st_size > 0x7FFFFFFF)
+    {
+        close(fd);
+        throw Exception(Exception::IllegalFormat, "not a save state file");
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void *p = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        throw Exception(Exception::IOFailure, "unable to map the file");
+
+    m_pData = static_cast<const c6502_byte_t*>(p);
+    m_size = st.st_size;
+
+    StateHeader hdr;
+    memcpy(&hdr, m_pData, sizeof(hdr));
+    // write() always fills the CRCs in, a missing one means a damaged header
+    if (!hdr.checkValid(m_size) || !hdr.checkCRCs(m_pData, true))
+    {
+        munmap(p, m_size);
+        throw Exception(Exception::IllegalFormat, "save state file is corrupted");
+    }
+}
+
+MappedState::~MappedState()
+{
+    munmap(const_cast<c6502_byte_t*>(m_pData), m_size);
+}
+
+void MappedState::restore(Bus &bus) const
+{
+    bus.loadState(m_pData, m_size);
+}
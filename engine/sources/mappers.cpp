@@ -21,13 +21,24 @@ c6502_byte_t DefaultMapper::readRAM(c6502_word_t addr)
 
 c6502_byte_t DefaultMapper::readVROM(c6502_word_t addr)
 {
-    assert(m_nVROMs == 1);
     assert(addr < 0x2000u);
 
+    if (m_pCHRRAM)
+        return m_pCHRRAM->Read(addr);
+
     // Only one VROM bank for default mapper
+    assert(m_nVROMs == 1);
     return m_pVROM[0].Read(addr);
 }
 
+void DefaultMapper::writeVROM(c6502_word_t addr, c6502_byte_t val)
+{
+    assert(addr < 0x2000u);
+
+    if (m_pCHRRAM)
+        writeCHRRAM(addr, val);
+}
+
 void DefaultMapper::writeRAM(c6502_word_t, c6502_byte_t)
 {
     throw Exception(Exception::IllegalOperation,
@@ -47,13 +58,13 @@ void DefaultMapper::flash(c6502_word_t addr, c6502_byte_t* p, c6502_d_word_t siz
     else if (addr >= 0x8000)
     {
         addr -= 0x8000;
-        const c6502_d_word_t space =Mapper::ROM_SIZE - addr;
+        const c6502_d_word_t space = Mapper::ROM_SIZE - addr;
         if (size > space)
         {
             flash(0xC000, p + space, size - space);
             size = space;
         }
-        m_pROM[0].Write(addr, p, space);
+        m_pROM[0].Write(addr, p, size);
     }
     else
         throw Exception(Exception::IllegalArgument, "address outside the ROM space");
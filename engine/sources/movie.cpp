@@ -0,0 +1,263 @@
+#include "movie.h"
+#include "machine.h"
+#include "delta.h"
+#include "state.h"
+
+#include <fstream>
+#include <cstring>
+
+using std::ios;
+
+static const char MOVIE_MAGIC[4] = { 'B', '1', 'M', 'V' };
+
+// Frame count limit, about 3 days at 60 frames per second. Frame data of
+// this many frames compresses to a few bytes if the input never changes,
+// so the limit also bounds the memory a small file can make load() take
+static constexpr c6502_d_word_t MAX_FRAMES = 0x1000000u;
+
+static void put32(std::ostream &out, c6502_d_word_t v)
+{
+    const char b[4] = {
+        static_cast<char>(v & 0xFFu),
+        static_cast<char>((v >> 8) & 0xFFu),
+        static_cast<char>((v >> 16) & 0xFFu),
+        static_cast<char>(v >> 24)
+    };
+    out.write(b, 4);
+}
+
+static void sread(void *pDest, size_t nBytes, std::istream &in)
+{
+    in.read(reinterpret_cast<char*>(pDest), nBytes);
+    if (static_cast<size_t>(in.gcount()) < nBytes)
+        throw Exception(Exception::IllegalFormat, "unexpected end of movie file");
+}
+
+static c6502_d_word_t get32(std::istream &in)
+{
+    c6502_byte_t b[4];
+    sread(b, 4, in);
+    return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<c6502_d_word_t>(b[3]) << 24);
+}
+
+static void packFrame(const Movie::Frame &f, c6502_byte_t *p) noexcept
+{
+    *p++ = f.events;
+    for (const auto &pad: f.pads)
+    {
+        *p++ = pad.pressed & 0xFFu;
+        *p++ = pad.pressed >> 8;
+        *p++ = pad.turbo & 0xFFu;
+        *p++ = pad.turbo >> 8;
+    }
+}
+
+static void unpackFrame(const c6502_byte_t *p, Movie::Frame &f) noexcept
+{
+    f.events = *p++;
+    for (auto &pad: f.pads)
+    {
+        pad.pressed = p[0] | (p[1] << 8);
+        pad.turbo = p[2] | (p[3] << 8);
+        p += 4;
+    }
+}
+
+uint64_t Movie::prefixHash(int frames) const noexcept
+{
+    assert(frames >= 0 && frames <= length());
+
+    uint64_t h = 0xCBF29CE484222325u;
+    auto mix = [&h](const c6502_byte_t *p, size_t size) {
+        for (size_t i = 0; i < size; i++)
+            h = (h ^ p[i]) * 0x100000001B3u;
+    };
+
+    mix(m_startState.data(), m_startState.size());
+    c6502_byte_t rec[FRAME_RECORD_SIZE];
+    for (int i = 0; i < frames; i++)
+    {
+        packFrame(m_frames[i], rec);
+        mix(rec, sizeof(rec));
+    }
+    return h;
+}
+
+void Movie::save(const char *file) const
+{
+    std::ofstream out(file, ios::out | ios::binary | ios::trunc);
+    if (!out.is_open())
+        throw Exception(Exception::IOFailure, "unable to create the movie file");
+
+    save(out);
+}
+
+void Movie::save(std::ostream &out) const
+{
+    if (m_frames.size() > MAX_FRAMES)
+        throw Exception(Exception::SizeOverflow, "movie is too long");
+
+    // XOR each record with the previous one, unchanged input becomes zeroes
+    const c6502_d_word_t rawSize = m_frames.size() * FRAME_RECORD_SIZE;
+    std::vector<c6502_byte_t> raw(rawSize);
+    c6502_byte_t prev[FRAME_RECORD_SIZE] = { };
+    for (size_t i = 0; i < m_frames.size(); i++)
+    {
+        c6502_byte_t *p = raw.data() + i * FRAME_RECORD_SIZE;
+        packFrame(m_frames[i], p);
+        for (c6502_d_word_t k = 0; k < FRAME_RECORD_SIZE; k++)
+        {
+            const c6502_byte_t v = p[k];
+            p[k] ^= prev[k];
+            prev[k] = v;
+        }
+    }
+
+    std::vector<c6502_byte_t> packed;
+    DeltaCodec::encode(raw.data(), nullptr, rawSize, packed);
+
+    out.write(MOVIE_MAGIC, 4);
+    put32(out, VERSION);
+    put32(out, m_romHash);
+    put32(out, static_cast<c6502_d_word_t>(m_frames.size()));
+    put32(out, static_cast<c6502_d_word_t>(m_startState.size()));
+    out.write(reinterpret_cast<const char*>(m_startState.data()), m_startState.size());
+    put32(out, static_cast<c6502_d_word_t>(packed.size()));
+    out.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+
+    if (!out.good())
+        throw Exception(Exception::IOFailure, "unable to write the movie");
+}
+
+void Movie::load(const char *file)
+{
+    std::ifstream in(file, ios::in | ios::binary);
+    if (!in.is_open())
+        throw Exception(Exception::IOFailure, "unable to open the file");
+
+    load(in);
+}
+
+void Movie::load(std::istream &in)
+{
+    char magic[4];
+    sread(magic, 4, in);
+    if (memcmp(magic, MOVIE_MAGIC, 4) != 0)
+        throw Exception(Exception::IllegalFormat, "not a movie file");
+    if (get32(in) != VERSION)
+        throw Exception(Exception::IllegalFormat, "unsupported movie version");
+
+    const c6502_d_word_t romHash = get32(in),
+                         nFrames = get32(in);
+    if (nFrames > MAX_FRAMES)
+        throw Exception(Exception::SizeOverflow, "movie is too long");
+
+    // Sizes are checked before anything is allocated for them
+    const c6502_d_word_t stateSize = get32(in);
+    if (stateSize > MAX_STATE_SIZE)
+        throw Exception(Exception::SizeOverflow, "movie start state is too large");
+    std::vector<c6502_byte_t> state(stateSize);
+    sread(state.data(), state.size(), in);
+
+    const c6502_d_word_t rawSize = nFrames * FRAME_RECORD_SIZE,
+                         packedSize = get32(in);
+    if (packedSize > DeltaCodec::maxEncodedSize(rawSize))
+        throw Exception(Exception::SizeOverflow, "movie frame data is too large");
+    std::vector<c6502_byte_t> packed(packedSize);
+    sread(packed.data(), packed.size(), in);
+
+    std::vector<c6502_byte_t> raw(rawSize);
+    if (!DeltaCodec::apply(packed.data(), packed.size(), raw.data(), rawSize))
+        throw Exception(Exception::IllegalFormat, "corrupted movie frame data");
+
+    std::vector<Frame> frames(nFrames);
+    for (c6502_d_word_t i = 0; i < nFrames; i++)
+    {
+        c6502_byte_t *p = raw.data() + i * FRAME_RECORD_SIZE;
+        if (i > 0)
+        {
+            const c6502_byte_t *prev = p - FRAME_RECORD_SIZE;
+            for (c6502_d_word_t k = 0; k < FRAME_RECORD_SIZE; k++)
+                p[k] ^= prev[k];
+        }
+        unpackFrame(p, frames[i]);
+    }
+
+    m_romHash = romHash;
+    m_startState.swap(state);
+    m_frames.swap(frames);
+}
+
+MovieRecorder::MovieRecorder(Machine &m, Movie &movie):
+    m_machine(m),
+    m_movie(movie)
+{
+    if (!m.isReady())
+        throw Exception(Exception::IllegalOperation, "no cartridge to record a movie with");
+
+    m_movie.m_romHash = m.cartrige().romHash();
+    m.bus().saveState(m_movie.m_startState);
+    m_movie.m_frames.clear();
+}
+
+void MovieRecorder::reset()
+{
+    m_machine.reset();
+    m_events |= Movie::RESET;
+}
+
+void MovieRecorder::power()
+{
+    m_machine.power();
+
+    // Power cycle overrides an earlier reset
+    m_events = Movie::POWER;
+}
+
+void MovieRecorder::runFrame()
+{
+    Movie::Frame f;
+    f.events = m_events;
+    f.pads[0] = m_machine.gamepad(0).input();
+    f.pads[1] = m_machine.gamepad(1).input();
+    m_movie.m_frames.push_back(f);
+    m_events = 0;
+
+    m_machine.runFrame();
+}
+
+MoviePlayer::MoviePlayer(Machine &m, const Movie &movie):
+    m_machine(m),
+    m_movie(movie)
+{
+    if (!m.isReady())
+        throw Exception(Exception::IllegalOperation, "no cartridge to play the movie with");
+    if (m.cartrige().romHash() != movie.romHash())
+        throw Exception(Exception::IllegalArgument, "movie was recorded with another ROM");
+
+    const auto &state = movie.startState();
+    m.bus().loadState(state.data(), state.size());
+}
+
+bool MoviePlayer::runFrame()
+{
+    if (atEnd())
+        return false;
+
+    const Movie::Frame &f = m_movie.frames()[m_pos++];
+    if (f.events & Movie::POWER)
+        m_machine.power();
+    if (f.events & Movie::RESET)
+        m_machine.reset();
+
+    m_machine.gamepad(0).setInput(f.pads[0]);
+    m_machine.gamepad(1).setInput(f.pads[1]);
+    m_machine.runFrame();
+    return true;
+}
+
+void MoviePlayer::run()
+{
+    while (runFrame())
+        ;
+}
@@ -0,0 +1,214 @@
+#include "netplay.h"
+#include "transport.h"
+#include "machine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+constexpr RollbackSession::Config RollbackSession::DEFAULT_CONFIG;
+
+static const char PACKET_MAGIC[3] = { 'B', '1', 'N' };
+
+static constexpr c6502_d_word_t HEADER_SIZE = 12,
+                                INPUT_SIZE = 4,
+                                MAX_PACKET_INPUTS = (Transport::MAX_DATAGRAM - HEADER_SIZE) / INPUT_SIZE;
+
+static void put32(c6502_byte_t *p, c6502_d_word_t v) noexcept
+{
+    p[0] = v & 0xFFu;
+    p[1] = (v >> 8) & 0xFFu;
+    p[2] = (v >> 16) & 0xFFu;
+    p[3] = v >> 24;
+}
+
+static int get32(const c6502_byte_t *p) noexcept
+{
+    return static_cast<int32_t>(p[0] | (p[1] << 8) | (p[2] << 16) |
+                                (static_cast<c6502_d_word_t>(p[3]) << 24));
+}
+
+static double elapsedUs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - since).count();
+}
+
+RollbackSession::RollbackSession(Machine &m,
+                                 Transport &transport,
+                                 int localPlayer,
+                                 const Config &cfg):
+    m_machine(m),
+    m_transport(transport),
+    m_cfg(cfg),
+    m_localPlayer(localPlayer),
+    m_localLast(cfg.inputDelay - 1),
+    m_remoteConfirmed(cfg.inputDelay - 1),
+    m_remoteAck(cfg.inputDelay - 1),
+    m_localInput(),
+    m_remoteInput(),
+    m_usedRemote()
+{
+    if (localPlayer < 0 || localPlayer > 1)
+        throw Exception(Exception::IllegalArgument, "player must be 0 or 1");
+    if (cfg.inputDelay < 0 || cfg.inputDelay > MAX_INPUT_DELAY ||
+        cfg.maxRollback < 1 || cfg.maxRollback > MAX_ROLLBACK)
+        throw Exception(Exception::IllegalArgument, "netplay configuration is out of range");
+    if (!m.isReady())
+        throw Exception(Exception::IllegalOperation, "no cartridge to play with");
+
+    m_stateSize = m.bus().stateSize();
+    m_states.resize(m_stateSize * (cfg.maxRollback + 1));
+}
+
+const Gamepad::Input &RollbackSession::remoteInput(int frame) const noexcept
+{
+    // Remote player holds nothing before the first input arrives
+    static const Gamepad::Input NO_INPUT = { 0u, 0u };
+    if (m_remoteConfirmed < 0)
+        return NO_INPUT;
+
+    // Prediction: unknown input repeats the last known one
+    return m_remoteInput[std::min(frame, m_remoteConfirmed) % HISTORY];
+}
+
+void RollbackSession::poll()
+{
+    sendInput();
+    receiveInput();
+}
+
+bool RollbackSession::runFrame(const Gamepad::Input &local)
+{
+    receiveInput();
+
+    if (m_frame - m_remoteConfirmed > m_cfg.maxRollback)
+    {
+        // Too far ahead of the peer, keep the link alive and wait
+        sendInput();
+        m_stats.stalls++;
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    m_localLast = m_frame + m_cfg.inputDelay;
+    m_localInput[m_localLast % HISTORY] = local;
+    sendInput();
+
+    rollback();
+    emulate(m_frame, true);
+    m_frame++;
+
+    auto &st = m_stats;
+    st.frames++;
+    st.lastFrameUs = elapsedUs(start);
+    st.avgFrameUs = st.avgFrameUs > 0 ? st.avgFrameUs * 0.95 + st.lastFrameUs * 0.05 : st.lastFrameUs;
+    return true;
+}
+
+void RollbackSession::sendInput()
+{
+    const int first = m_remoteAck + 1;
+    const c6502_d_word_t count = std::min(static_cast<c6502_d_word_t>(m_localLast - m_remoteAck),
+                                          MAX_PACKET_INPUTS);
+
+    c6502_byte_t buf[Transport::MAX_DATAGRAM];
+    memcpy(buf, PACKET_MAGIC, 3);
+    put32(buf + 3, static_cast<c6502_d_word_t>(m_remoteConfirmed));
+    put32(buf + 7, static_cast<c6502_d_word_t>(first));
+    buf[11] = count;
+
+    c6502_byte_t *p = buf + HEADER_SIZE;
+    for (c6502_d_word_t i = 0; i < count; i++, p += INPUT_SIZE)
+    {
+        const auto &in = m_localInput[(first + i) % HISTORY];
+        p[0] = in.pressed & 0xFFu;
+        p[1] = in.pressed >> 8;
+        p[2] = in.turbo & 0xFFu;
+        p[3] = in.turbo >> 8;
+    }
+
+    m_transport.send(buf, HEADER_SIZE + count * INPUT_SIZE);
+}
+
+void RollbackSession::receiveInput()
+{
+    c6502_byte_t buf[Transport::MAX_DATAGRAM];
+    while (const c6502_d_word_t size = m_transport.receive(buf, sizeof(buf)))
+    {
+        if (size < HEADER_SIZE || memcmp(buf, PACKET_MAGIC, 3) != 0 ||
+            size < HEADER_SIZE + buf[11] * INPUT_SIZE)
+            continue;
+
+        // Datagrams may come out of order, acknowledgements never go back
+        const int ack = std::min(get32(buf + 3), m_localLast);
+        m_remoteAck = std::max(m_remoteAck, ack);
+
+        const int first = get32(buf + 7),
+                  count = buf[11];
+        const c6502_byte_t *p = buf + HEADER_SIZE;
+        for (int f = first; f < first + count; f++, p += INPUT_SIZE)
+        {
+            if (f <= m_remoteConfirmed)
+                continue;
+
+            // Gaps can't be filled, and slots still in use must not be overwritten
+            if (f != m_remoteConfirmed + 1 || f - m_frame >= HISTORY - MAX_ROLLBACK - 1)
+                break;
+
+            auto &in = m_remoteInput[f % HISTORY];
+            in.pressed = p[0] | (p[1] << 8);
+            in.turbo = p[2] | (p[3] << 8);
+            m_remoteConfirmed = f;
+
+            if (f < m_frame && !(in == m_usedRemote[f % HISTORY]) &&
+                (m_rollbackFrom < 0 || f < m_rollbackFrom))
+                m_rollbackFrom = f;
+        }
+    }
+}
+
+void RollbackSession::rollback()
+{
+    if (m_rollbackFrom < 0)
+        return;
+
+    const auto start = std::chrono::steady_clock::now();
+    const int from = m_rollbackFrom;
+    m_rollbackFrom = -1;
+    assert(from >= m_frame - m_cfg.maxRollback);
+
+    m_machine.bus().loadState(state(from), m_stateSize);
+    for (int f = from; f < m_frame; f++)
+        emulate(f, false);
+
+    auto &st = m_stats;
+    const int depth = m_frame - from;
+    const double us = elapsedUs(start);
+    st.avgRollbackUs = (st.avgRollbackUs * st.rollbacks + us) / (st.rollbacks + 1);
+    st.rollbacks++;
+    st.resimulatedFrames += depth;
+    st.maxRollbackDepth = std::max(st.maxRollbackDepth, depth);
+}
+
+void RollbackSession::emulate(int frame, bool render)
+{
+    m_machine.bus().saveState(state(frame));
+
+    auto &used = m_usedRemote[frame % HISTORY];
+    used = remoteInput(frame);
+    m_machine.gamepad(m_localPlayer).setInput(m_localInput[frame % HISTORY]);
+    m_machine.gamepad(1 - m_localPlayer).setInput(used);
+
+    if (render)
+    {
+        m_machine.runFrame();
+        return;
+    }
+
+    // Re-simulated frames have been presented already
+    PPU &ppu = m_machine.ppu();
+    ppu.setRenderingEnabled(false);
+    m_machine.bus().runFrame();
+    ppu.setRenderingEnabled(true);
+}
@@ -0,0 +1,227 @@
+#include "observation.h"
+#include "framebuffer.h"
+
+#include <array>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+const c6502_byte_t *Observer::lumaTable() noexcept
+{
+    static const std::array<c6502_byte_t, 64> s_luma = [] {
+        const uint16_t *palette = FrameBufferBackend::palette();
+        std::array<c6502_byte_t, 64> t;
+        for (int i = 0; i < 64; i++)
+        {
+            const unsigned c = palette[i],
+                           r = (c >> 10) & 0x1Fu,
+                           g = (c >> 5) & 0x1Fu,
+                           b = c & 0x1Fu;
+            // BT.601 weights, 5-bit channels scaled to 0..255
+            t[i] = static_cast<c6502_byte_t>((299 * r + 587 * g + 114 * b) * 255 / (31 * 1000));
+        }
+        return t;
+    }();
+
+    return s_luma.data();
+}
+
+Observer::Observer(int width, int height, bool maxPool):
+    m_width(width),
+    m_height(height),
+    m_maxPool(maxPool)
+{
+    constexpr int W = FrameBufferBackend::WIDTH,
+                  H = FrameBufferBackend::HEIGHT;
+    if (width < 1 || width > W || height < 1 || height > H)
+        throw Exception(Exception::IllegalArgument, "unsupported observation size");
+
+    m_cols.resize(width + 1);
+    for (int x = 0; x <= width; x++)
+        m_cols[x] = x * W / width;
+    m_rows.resize(height + 1);
+    for (int y = 0; y <= height; y++)
+        m_rows[y] = y * H / height;
+
+    const int maxArea = ((W + width - 1) / width) * ((H + height - 1) / height);
+    m_recip.resize(maxArea + 1);
+    m_recip[0] = 0;
+    for (int a = 1; a <= maxArea; a++)
+        m_recip[a] = static_cast<uint32_t>(((1u << 24) + a / 2) / a);
+
+    if (maxPool)
+        m_prev.resize(width * height);
+}
+
+#ifdef __SSSE3__
+// Luma of 16 pixels: the table is four 16-entry shuffles, index bits 4-5 pick one
+static inline __m128i luma16(__m128i pixels, const __m128i (&table)[4]) noexcept
+{
+    const __m128i lo = _mm_and_si128(pixels, _mm_set1_epi8(0x0F)),
+                  hi = _mm_and_si128(_mm_srli_epi16(pixels, 4), _mm_set1_epi8(0x03));
+    __m128i v = _mm_setzero_si128();
+    for (int k = 0; k < 4; k++)
+        v = _mm_or_si128(v, _mm_and_si128(_mm_cmpeq_epi8(hi, _mm_set1_epi8(static_cast<char>(k))),
+                                          _mm_shuffle_epi8(table[k], lo)));
+    return v;
+}
+#else
+// Luma of two neighbouring pixels at once, indexed by left | right << 6
+static const uint16_t *lumaPairs() noexcept
+{
+    static const std::array<uint16_t, 4096> s_pairs = [] {
+        const c6502_byte_t *luma = Observer::lumaTable();
+        std::array<uint16_t, 4096> t;
+        for (unsigned i = 0; i < t.size(); i++)
+            t[i] = static_cast<uint16_t>(luma[i & 0x3Fu] | (luma[i >> 6] << 8));
+        return t;
+    }();
+
+    return s_pairs.data();
+}
+#endif
+
+void Observer::sumRows(const c6502_byte_t *src, int rows) noexcept
+{
+    constexpr int W = FrameBufferBackend::WIDTH;
+#ifdef __SSSE3__
+    __m128i table[4];
+    for (int k = 0; k < 4; k++)
+        table[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lumaTable() + k * 16));
+#else
+    const uint16_t *pairs = lumaPairs();
+#endif
+
+    for (int y = 0; y < rows; y++, src += W)
+    {
+#ifdef __SSSE3__
+        for (int x = 0; x < W; x += 16)
+            _mm_store_si128(reinterpret_cast<__m128i*>(m_luma + x),
+                            luma16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x)), table));
+#else
+        // SSE2 has no byte shuffle, the lookup stays scalar, two pixels at a time
+        for (int x = 0; x < W; x += 2)
+        {
+            const unsigned i = (src[x] & 0x3Fu) | ((src[x + 1] & 0x3Fu) << 6),
+                           v = pairs[i];
+            m_luma[x] = static_cast<c6502_byte_t>(v);
+            m_luma[x + 1] = static_cast<c6502_byte_t>(v >> 8);
+        }
+#endif
+
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        __m128i *sum = reinterpret_cast<__m128i*>(m_rowSum);
+        for (int x = 0; x < W; x += 16, sum += 2)
+        {
+            const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(m_luma + x)),
+                          lo = _mm_unpacklo_epi8(v, zero),
+                          hi = _mm_unpackhi_epi8(v, zero);
+            if (y == 0)
+            {
+                _mm_store_si128(sum, lo);
+                _mm_store_si128(sum + 1, hi);
+            }
+            else
+            {
+                _mm_store_si128(sum, _mm_add_epi16(_mm_load_si128(sum), lo));
+                _mm_store_si128(sum + 1, _mm_add_epi16(_mm_load_si128(sum + 1), hi));
+            }
+        }
+#else
+        for (int x = 0; x < W; x++)
+            m_rowSum[x] = y == 0 ? m_luma[x] : m_rowSum[x] + m_luma[x];
+#endif
+    }
+}
+
+void Observer::prefixSums() noexcept
+{
+    constexpr int W = FrameBufferBackend::WIDTH;
+    m_prefix[0] = 0;
+
+#ifdef __SSE2__
+    // Scan of 4 lanes in two shifted additions, plus the total so far
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    for (int x = 0; x < W; x += 8)
+    {
+        const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(m_rowSum + x));
+        __m128i lo = _mm_unpacklo_epi16(v, zero),
+                hi = _mm_unpackhi_epi16(v, zero);
+        lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 4));
+        lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 8));
+        lo = _mm_add_epi32(lo, total);
+        total = _mm_shuffle_epi32(lo, 0xFF);
+        hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 4));
+        hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 8));
+        hi = _mm_add_epi32(hi, total);
+        total = _mm_shuffle_epi32(hi, 0xFF);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(m_prefix + x + 1), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(m_prefix + x + 5), hi);
+    }
+#else
+    for (int x = 0; x < W; x++)
+        m_prefix[x + 1] = m_prefix[x] + m_rowSum[x];
+#endif
+}
+
+void Observer::observe(const c6502_byte_t *pixels, c6502_byte_t *out) noexcept
+{
+    constexpr int W = FrameBufferBackend::WIDTH;
+
+    for (int oy = 0; oy < m_height; oy++)
+    {
+        // Vertical: luma of the source rows of the box summed per column
+        const int boxH = m_rows[oy + 1] - m_rows[oy];
+        sumRows(pixels + m_rows[oy] * W, boxH);
+        prefixSums();
+
+        // Horizontal: box sums from the prefix sums, mean through a reciprocal
+        c6502_byte_t *dst = out + oy * m_width;
+        for (int ox = 0; ox < m_width; ox++)
+        {
+            const int x0 = m_cols[ox],
+                      x1 = m_cols[ox + 1];
+            const uint32_t s = m_prefix[x1] - m_prefix[x0],
+                           area = (x1 - x0) * boxH;
+            dst[ox] = static_cast<c6502_byte_t>((static_cast<uint64_t>(s) * m_recip[area] + (1u << 23)) >> 24);
+        }
+    }
+
+    if (!m_maxPool)
+        return;
+
+    // out = max(current, previous), previous = current
+    const int n = m_width * m_height;
+    int i = 0;
+    if (m_hasPrev)
+    {
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i)),
+                          prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_prev[i]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&m_prev[i]), cur);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_max_epu8(cur, prev));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            const c6502_byte_t cur = out[i];
+            if (m_prev[i] > out[i])
+                out[i] = m_prev[i];
+            m_prev[i] = cur;
+        }
+    }
+    else
+    {
+        memcpy(m_prev.data(), out, n);
+        m_hasPrev = true;
+    }
+}
@@ -0,0 +1,229 @@
+#include "rewind.h"
+#include "delta.h"
+#include "bus.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+constexpr RewindBuffer::Config RewindBuffer::DEFAULT_CONFIG;
+
+// On a single CPU the helper thread preempts the emulation when woken up,
+// adding two context switches to the compression it was meant to hide
+static RewindBuffer::Config effectiveConfig(const RewindBuffer::Config &cfg) noexcept
+{
+    RewindBuffer::Config c = cfg;
+    if (std::thread::hardware_concurrency() == 1)
+        c.threaded = false;
+    return c;
+}
+
+RewindBuffer::RewindBuffer(Bus &bus, const Config &cfg):
+    m_bus(bus),
+    m_cfg(effectiveConfig(cfg)),
+    m_data(cfg.capacity),
+    m_entries(cfg.maxEntries)
+{
+    assert(cfg.maxEntries > 0 && cfg.interval > 0 && cfg.keyframeInterval > 0);
+
+    if (m_cfg.threaded)
+        m_worker = std::thread(&RewindBuffer::workerLoop, this);
+}
+
+RewindBuffer::~RewindBuffer()
+{
+    if (m_worker.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_worker.join();
+    }
+}
+
+void RewindBuffer::onFrame()
+{
+    if (++m_frameCounter < m_cfg.interval)
+        return;
+    m_frameCounter = 0;
+
+    if (!m_cfg.threaded)
+    {
+        m_bus.saveState(m_pending);
+        store();
+        return;
+    }
+
+    // Never wait for the helper thread here
+    std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || m_hasPending)
+    {
+        m_nSkipped++;
+        return;
+    }
+
+    m_bus.saveState(m_pending);
+    m_hasPending = true;
+    lock.unlock();
+    m_cv.notify_all();
+}
+
+void RewindBuffer::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_cv.wait(lock, [this] { return m_hasPending || m_stop; });
+        if (m_stop)
+            break;
+
+        store();
+        m_hasPending = false;
+        m_cv.notify_all();
+    }
+}
+
+void RewindBuffer::waitIdle(std::unique_lock<std::mutex> &lock) const
+{
+    m_cv.wait(lock, [this] { return !m_hasPending; });
+}
+
+void RewindBuffer::store()
+{
+    // State layout changed (e.g. another cartridge), old history is useless
+    if (!m_current.empty() && m_current.size() != m_pending.size())
+        resetHistory();
+
+    const bool keyframe = m_current.empty() || m_sinceKeyframe + 1 >= m_cfg.keyframeInterval;
+
+    m_encoded.clear();
+    DeltaCodec::encode(m_pending.data(),
+                       keyframe ? nullptr : m_current.data(),
+                       m_pending.size(),
+                       m_encoded);
+
+    if (m_encoded.size() > m_data.size())
+    {
+        resetHistory();
+        return;
+    }
+
+    append(m_encoded, keyframe);
+    m_sinceKeyframe = keyframe ? 0 : m_sinceKeyframe + 1;
+    std::swap(m_current, m_pending);
+}
+
+void RewindBuffer::evictOldest() noexcept
+{
+    assert(m_count > 0);
+    m_first = (m_first + 1) % m_entries.size();
+    m_count--;
+}
+
+void RewindBuffer::append(const std::vector<c6502_byte_t> &enc, bool keyframe)
+{
+    const c6502_d_word_t size = enc.size();
+    c6502_d_word_t off = m_head;
+
+    if (off + size > m_data.size())
+    {
+        // Wrap around; entries past the head are the oldest ones, drop them
+        while (m_count > 0 && entry(0).offset >= m_head)
+            evictOldest();
+        off = 0;
+    }
+
+    while (m_count > 0 &&
+           (m_count == static_cast<int>(m_entries.size()) ||
+            (entry(0).offset < off + size && off < entry(0).offset + entry(0).size)))
+        evictOldest();
+
+    memcpy(m_data.data() + off, enc.data(), size);
+    Entry &e = entry(m_count++);
+    e.offset = off;
+    e.size = size;
+    e.keyframe = keyframe;
+    m_head = off + size;
+}
+
+bool RewindBuffer::unwindNewest()
+{
+    assert(m_count > 0);
+    const Entry e = entry(m_count - 1);
+    m_count--;
+    m_head = e.offset;
+
+    if (!e.keyframe)
+        return DeltaCodec::apply(m_data.data() + e.offset, e.size,
+                                 m_current.data(), m_current.size());
+
+    // Previous state is reachable only from the preceding keyframe
+    int k = m_count - 1;
+    while (k >= 0 && !entry(k).keyframe)
+        k--;
+    if (k < 0)
+        return false;
+
+    std::fill(m_current.begin(), m_current.end(), 0);
+    for (int i = k; i < m_count; i++)
+    {
+        const Entry &d = entry(i);
+        if (!DeltaCodec::apply(m_data.data() + d.offset, d.size,
+                               m_current.data(), m_current.size()))
+            return false;
+    }
+    m_sinceKeyframe = m_count - 1 - k;
+
+    return true;
+}
+
+bool RewindBuffer::rewind()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    waitIdle(lock);
+
+    if (m_count == 0)
+        return false;
+
+    m_bus.loadState(m_current.data(), m_current.size());
+
+    const bool wasKeyframe = entry(m_count - 1).keyframe;
+    if (!unwindNewest())
+        resetHistory();
+    else if (!wasKeyframe && m_sinceKeyframe > 0)
+        m_sinceKeyframe--;
+
+    m_frameCounter = 0;
+    return true;
+}
+
+void RewindBuffer::resetHistory() noexcept
+{
+    m_first = m_count = 0;
+    m_head = 0;
+    m_sinceKeyframe = 0;
+    m_current.clear();
+}
+
+void RewindBuffer::clear()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    waitIdle(lock);
+    resetHistory();
+}
+
+int RewindBuffer::length() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+c6502_d_word_t RewindBuffer::memoryUsed() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    c6502_d_word_t used = 0;
+    for (int i = 0; i < m_count; i++)
+        used += m_entries[(m_first + i) % m_entries.size()].size;
+    return used;
+}
@@ -0,0 +1,236 @@
+#include "savewriter.h"
+#include "bus.h"
+#include "delta.h"
+#include "crc32.h"
+#include "state.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+#include <sys/stat.h>
+
+constexpr int SaveStateWriter::DEFAULT_MAX_QUEUED;
+
+static const char FILE_MAGIC[4] = { 'B', '1', 'S', 'Z' };
+static constexpr c6502_d_word_t FILE_HEADER_SIZE = 12;
+
+static void put32(c6502_byte_t *p, c6502_d_word_t v) noexcept
+{
+    p[0] = v & 0xFFu;
+    p[1] = (v >> 8) & 0xFFu;
+    p[2] = (v >> 16) & 0xFFu;
+    p[3] = v >> 24;
+}
+
+static c6502_d_word_t get32(const c6502_byte_t *p) noexcept
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<c6502_d_word_t>(p[3]) << 24);
+}
+
+SaveStateWriter::SaveStateWriter(int maxQueued):
+    m_maxQueued(maxQueued)
+{
+    assert(maxQueued > 0);
+    m_worker = std::thread(&SaveStateWriter::workerLoop, this);
+}
+
+SaveStateWriter::~SaveStateWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+}
+
+bool SaveStateWriter::save(const Bus &bus, const std::string &file)
+{
+    // The helper thread takes the lock only to pick up or finish a job,
+    // never for the duration of compression or I/O
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = std::find_if(m_queue.begin(), m_queue.end(),
+                           [&file](const Job &j) { return j.file == file; });
+    if (it != m_queue.end())
+    {
+        bus.saveState(it->state);
+        m_stats.coalesced++;
+        return true;
+    }
+
+    if (static_cast<int>(m_queue.size()) >= m_maxQueued)
+    {
+        m_stats.dropped++;
+        return false;
+    }
+
+    Job job;
+    job.file = file;
+    if (!m_freeBuffers.empty())
+    {
+        job.state.swap(m_freeBuffers.back());
+        m_freeBuffers.pop_back();
+    }
+    bus.saveState(job.state);
+    m_queue.push_back(std::move(job));
+    m_cv.notify_all();
+    return true;
+}
+
+void SaveStateWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+SaveStateWriter::Stats SaveStateWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string SaveStateWriter::lastError() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastError;
+}
+
+void SaveStateWriter::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_cv.wait(lock, [this] { return !m_queue.empty() || m_stop; });
+        if (m_queue.empty())
+            break;
+
+        Job job = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_busy = true;
+        lock.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+        std::string error;
+        try
+        {
+            writeFile(job.file, job.state);
+        }
+        catch (Exception &e)
+        {
+            error = job.file + ": " + e.message();
+        }
+        catch (std::exception &e)
+        {
+            // E.g. std::bad_alloc, which must not end the helper thread
+            error = job.file + ": " + e.what();
+        }
+        const double ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        if (error.empty())
+        {
+            m_stats.written++;
+        }
+        else
+        {
+            m_stats.failed++;
+            m_lastError.swap(error);
+        }
+        m_stats.lastWriteMs = ms;
+        m_stats.maxWriteMs = std::max(m_stats.maxWriteMs, ms);
+
+        m_freeBuffers.push_back(std::move(job.state));
+        m_busy = false;
+        m_cv.notify_all();
+    }
+}
+
+void SaveStateWriter::writeFile(const std::string &file, const std::vector<c6502_byte_t> &state)
+{
+    std::vector<c6502_byte_t> data(FILE_HEADER_SIZE);
+    memcpy(data.data(), FILE_MAGIC, 4);
+    put32(data.data() + 4, state.size());
+    put32(data.data() + 8, crc32(state.data(), state.size()));
+    DeltaCodec::encode(state.data(), nullptr, state.size(), data);
+
+    // Unique in the directory, writers in other processes may be saving
+    // the same file at the same time
+    std::string tmp = file + ".XXXXXX";
+    const int fd = mkstemp(&tmp[0]);
+    if (fd < 0)
+        throw Exception(Exception::IOFailure, strerror(errno));
+    fchmod(fd, 0644);
+
+    const c6502_byte_t *p = data.data();
+    size_t left = data.size();
+    while (left > 0)
+    {
+        const ssize_t n = write(fd, p, left);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            const int err = errno;
+            close(fd);
+            unlink(tmp.c_str());
+            throw Exception(Exception::IOFailure, strerror(err));
+        }
+        p += n;
+        left -= n;
+    }
+
+    // Data must reach the storage before the rename makes it visible
+    if (fsync(fd) != 0 || close(fd) != 0)
+    {
+        const int err = errno;
+        unlink(tmp.c_str());
+        throw Exception(Exception::IOFailure, strerror(err));
+    }
+
+    if (rename(tmp.c_str(), file.c_str()) != 0)
+    {
+        const int err = errno;
+        unlink(tmp.c_str());
+        throw Exception(Exception::IOFailure, strerror(err));
+    }
+}
+
+void SaveStateWriter::readFile(const char *file, std::vector<c6502_byte_t> &state)
+{
+    std::ifstream in(file, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+        throw Exception(Exception::IOFailure, "unable to open the file");
+
+    // Sizes are checked before anything is allocated for them
+    const std::streamoff fileSize = in.tellg();
+    if (fileSize < 0 ||
+        static_cast<uint64_t>(fileSize) > FILE_HEADER_SIZE + DeltaCodec::maxEncodedSize(MAX_STATE_SIZE))
+        throw Exception(Exception::IllegalFormat, "not a save state file");
+    in.seekg(0);
+
+    std::vector<c6502_byte_t> data((std::istreambuf_iterator<char>(in)),
+                                   std::istreambuf_iterator<char>());
+    if (data.size() < FILE_HEADER_SIZE || memcmp(data.data(), FILE_MAGIC, 4) != 0)
+        throw Exception(Exception::IllegalFormat, "not a save state file");
+
+    const c6502_d_word_t size = get32(data.data() + 4);
+    if (size > MAX_STATE_SIZE ||
+        data.size() - FILE_HEADER_SIZE > DeltaCodec::maxEncodedSize(size))
+        throw Exception(Exception::IllegalFormat, "save state file is corrupted");
+    std::vector<c6502_byte_t> result(size);
+    if (!DeltaCodec::apply(data.data() + FILE_HEADER_SIZE, data.size() - FILE_HEADER_SIZE,
+                           result.data(), size) ||
+        crc32(result.data(), size) != get32(data.data() + 8))
+        throw Exception(Exception::IllegalFormat, "save state file is corrupted");
+
+    state.swap(result);
+}
@@ -0,0 +1,55 @@
+#include "state.h"
+#include "crc32.h"
+#include <cstring>
+
+static const char STATE_MAGIC[4] = { 'B', '1', 'S', 'T' };
+
+void StateHeader::init(const uint32_t (&sizes)[SECTION_COUNT], uint32_t largeAlign) noexcept
+{
+    assert(largeAlign % SECTION_ALIGN == 0);
+
+    memcpy(magic, STATE_MAGIC, 4);
+    version = VERSION;
+
+    uint32_t off = align(sizeof(StateHeader));
+    for (int i = 0; i < SECTION_COUNT; i++)
+    {
+        if (sizes[i] >= largeAlign)
+            off = align(off, largeAlign);
+        sections[i].offset = off;
+        sections[i].size = sizes[i];
+        sections[i].crc = 0;
+        off = align(off + sizes[i]);
+    }
+    size = off;
+}
+
+bool StateHeader::checkValid(c6502_d_word_t blobSize) const noexcept
+{
+    if (memcmp(magic, STATE_MAGIC, 4) != 0)
+        return false;
+
+    if (version != VERSION || size > blobSize)
+        return false;
+
+    for (const auto &s: sections)
+        if (s.offset < sizeof(StateHeader) || s.offset > size || s.size > size - s.offset)
+            return false;
+
+    return true;
+}
+
+void StateHeader::computeCRCs(const c6502_byte_t *p) noexcept
+{
+    for (auto &s: sections)
+        s.crc = crc32(p + s.offset, s.size);
+}
+
+bool StateHeader::checkCRCs(const c6502_byte_t *p, bool required) const noexcept
+{
+    for (const auto &s: sections)
+        if ((required || s.crc != 0) && crc32(p + s.offset, s.size) != s.crc)
+            return false;
+
+    return true;
+}
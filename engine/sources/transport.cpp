@@ -0,0 +1,138 @@
+#include "transport.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+constexpr LoopbackLink::Conditions LoopbackLink::PERFECT;
+
+LoopbackLink::LoopbackLink(const Conditions &cond):
+    m_cond(cond),
+    m_rng(cond.seed)
+{
+    assert(cond.latencyMs >= 0.0 && cond.jitterMs >= 0.0);
+    assert(cond.lossRate >= 0.0 && cond.lossRate <= 1.0);
+
+    for (int i = 0; i < 2; i++)
+    {
+        m_ends[i].m_pLink = this;
+        m_ends[i].m_n = i;
+    }
+}
+
+void LoopbackLink::advanceTime(double ms) noexcept
+{
+    assert(ms >= 0.0);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_timeMs += ms;
+}
+
+void LoopbackLink::Endpoint::send(const c6502_byte_t *p, c6502_d_word_t size)
+{
+    assert(size <= MAX_DATAGRAM);
+    auto &link = *m_pLink;
+    std::lock_guard<std::mutex> lock(link.m_mutex);
+
+    link.m_nSent++;
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    if (dist(link.m_rng) < link.m_cond.lossRate)
+    {
+        link.m_nLost++;
+        return;
+    }
+
+    const double due = link.m_timeMs + link.m_cond.latencyMs +
+                       dist(link.m_rng) * link.m_cond.jitterMs;
+    link.m_inFlight[1 - m_n].emplace(due, std::vector<c6502_byte_t>(p, p + size));
+}
+
+c6502_d_word_t LoopbackLink::Endpoint::receive(c6502_byte_t *buf, c6502_d_word_t maxSize)
+{
+    auto &link = *m_pLink;
+    std::lock_guard<std::mutex> lock(link.m_mutex);
+
+    auto &queue = link.m_inFlight[m_n];
+    if (queue.empty() || queue.begin()->first > link.m_timeMs)
+        return 0;
+
+    const auto &data = queue.begin()->second;
+    const c6502_d_word_t size = std::min(static_cast<c6502_d_word_t>(data.size()), maxSize);
+    memcpy(buf, data.data(), size);
+    queue.erase(queue.begin());
+    return size;
+}
+
+UdpTransport::UdpTransport(uint16_t localPort, const char *remoteHost, uint16_t remotePort)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    addrinfo *res = nullptr;
+    if (getaddrinfo(remoteHost, nullptr, &hints, &res) != 0 || !res)
+        throw Exception(Exception::IllegalArgument, "unable to resolve the remote host");
+    m_remoteAddr = reinterpret_cast<const sockaddr_in*>(res->ai_addr)->sin_addr.s_addr;
+    m_remotePort = htons(remotePort);
+    freeaddrinfo(res);
+
+    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_socket < 0)
+        throw Exception(Exception::IOFailure, "unable to create a socket");
+
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(localPort);
+
+    if (bind(m_socket, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0 ||
+        fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        close(m_socket);
+        throw Exception(Exception::IOFailure, "unable to bind the socket");
+    }
+}
+
+UdpTransport::~UdpTransport()
+{
+    close(m_socket);
+}
+
+void UdpTransport::send(const c6502_byte_t *p, c6502_d_word_t size)
+{
+    sockaddr_in remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_addr.s_addr = m_remoteAddr;
+    remote.sin_port = m_remotePort;
+
+    // Failures are the same as losses for an unreliable channel
+    sendto(m_socket, p, size, 0, reinterpret_cast<const sockaddr*>(&remote), sizeof(remote));
+}
+
+c6502_d_word_t UdpTransport::receive(c6502_byte_t *buf, c6502_d_word_t maxSize)
+{
+    for (;;)
+    {
+        sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        const ssize_t n = recvfrom(m_socket, buf, maxSize, 0,
+                                   reinterpret_cast<sockaddr*>(&from), &fromLen);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+
+        if (from.sin_addr.s_addr == m_remoteAddr && from.sin_port == m_remotePort)
+            return static_cast<c6502_d_word_t>(n);
+    }
+}
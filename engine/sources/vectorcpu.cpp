@@ -0,0 +1,811 @@
+#include "vectorcpu.h"
+#include "machine.h"
+
+#include <array>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+constexpr int VectorCPU::LANES;
+
+namespace
+{
+
+// Byte vector of all lanes, SSE2 when available
+#ifdef __SSE2__
+struct Vec
+{
+    __m128i v;
+};
+
+inline Vec load(const c6502_byte_t *p) noexcept
+{
+    return { _mm_load_si128(reinterpret_cast<const __m128i*>(p)) };
+}
+
+inline void store(c6502_byte_t *p, Vec a) noexcept
+{
+    _mm_store_si128(reinterpret_cast<__m128i*>(p), a.v);
+}
+
+inline Vec splat(c6502_byte_t b) noexcept
+{
+    return { _mm_set1_epi8(static_cast<char>(b)) };
+}
+
+inline Vec operator&(Vec a, Vec b) noexcept
+{
+    return { _mm_and_si128(a.v, b.v) };
+}
+
+inline Vec operator|(Vec a, Vec b) noexcept
+{
+    return { _mm_or_si128(a.v, b.v) };
+}
+
+inline Vec operator^(Vec a, Vec b) noexcept
+{
+    return { _mm_xor_si128(a.v, b.v) };
+}
+
+inline Vec add(Vec a, Vec b) noexcept
+{
+    return { _mm_add_epi8(a.v, b.v) };
+}
+
+inline Vec sub(Vec a, Vec b) noexcept
+{
+    return { _mm_sub_epi8(a.v, b.v) };
+}
+
+inline Vec addSat(Vec a, Vec b) noexcept
+{
+    return { _mm_adds_epu8(a.v, b.v) };
+}
+
+inline Vec max(Vec a, Vec b) noexcept
+{
+    return { _mm_max_epu8(a.v, b.v) };
+}
+
+/// 0xFF where equal, 0 elsewhere
+inline Vec eq(Vec a, Vec b) noexcept
+{
+    return { _mm_cmpeq_epi8(a.v, b.v) };
+}
+
+inline Vec shl1(Vec a) noexcept
+{
+    return { _mm_add_epi8(a.v, a.v) };
+}
+
+inline Vec shr1(Vec a) noexcept
+{
+    return { _mm_and_si128(_mm_srli_epi16(a.v, 1), _mm_set1_epi8(0x7F)) };
+}
+
+/// @a a where @a m is set, @a b elsewhere
+inline Vec select(Vec m, Vec a, Vec b) noexcept
+{
+    return { _mm_or_si128(_mm_and_si128(m.v, a.v), _mm_andnot_si128(m.v, b.v)) };
+}
+#else
+struct Vec
+{
+    c6502_byte_t b[VectorCPU::LANES];
+};
+
+template <typename F>
+inline Vec map(Vec a, Vec b, F f) noexcept
+{
+    Vec r;
+    for (int i = 0; i < VectorCPU::LANES; i++)
+        r.b[i] = static_cast<c6502_byte_t>(f(a.b[i], b.b[i]));
+    return r;
+}
+
+inline Vec load(const c6502_byte_t *p) noexcept
+{
+    Vec r;
+    memcpy(r.b, p, sizeof(r.b));
+    return r;
+}
+
+inline void store(c6502_byte_t *p, Vec v) noexcept
+{
+    memcpy(p, v.b, sizeof(v.b));
+}
+
+inline Vec splat(c6502_byte_t b) noexcept
+{
+    Vec r;
+    memset(r.b, b, sizeof(r.b));
+    return r;
+}
+
+inline Vec operator&(Vec a, Vec b) noexcept
+{
+    return map(a, b, [](unsigned x, unsigned y) { return x & y; });
+}
+
+inline Vec operator|(Vec a, Vec b) noexcept
+{
+    return map(a, b, [](unsigned x, unsigned y) { return x | y; });
+}
+
+inline Vec operator^(Vec a, Vec b) noexcept
+{
+    return map(a, b, [](unsigned x, unsigned y) { return x ^ y; });
+}
+
+inline Vec add(Vec a, Vec b) noexcept
+{
+    return map(a, b, [](unsigned x, unsigned y) { return x + y; });
+}
+
+inline Vec sub(Vec a, Vec b) noexcept
+{
+    return map(a, b, [](unsigned x, unsigned y) { return x - y; });
+}
+
+inline Vec addSat(Vec a, Vec b) noexcept
+{
+    return map(a, b, [](unsigned x, unsigned y) { return x + y > 0xFFu ? 0xFFu : x + y; });
+}
+
+inline Vec max(Vec a, Vec b) noexcept
+{
+    return map(a, b, [](unsigned x, unsigned y) { return x > y ? x : y; });
+}
+
+inline Vec eq(Vec a, Vec b) noexcept
+{
+    return map(a, b, [](unsigned x, unsigned y) { return x == y ? 0xFFu : 0u; });
+}
+
+inline Vec shl1(Vec a) noexcept
+{
+    return map(a, a, [](unsigned x, unsigned) { return x << 1; });
+}
+
+inline Vec shr1(Vec a) noexcept
+{
+    return map(a, a, [](unsigned x, unsigned) { return x >> 1; });
+}
+
+inline Vec select(Vec m, Vec a, Vec b) noexcept
+{
+    Vec r;
+    for (int i = 0; i < VectorCPU::LANES; i++)
+        r.b[i] = (m.b[i] & a.b[i]) | (~m.b[i] & b.b[i]);
+    return r;
+}
+#endif
+
+inline Vec operator~(Vec a) noexcept
+{
+    return a ^ splat(0xFFu);
+}
+
+// Processor status bits
+constexpr c6502_byte_t FLAG_C = 0x01u,
+                       FLAG_Z = 0x02u,
+                       FLAG_I = 0x04u,
+                       FLAG_D = 0x08u,
+                       FLAG_V = 0x40u,
+                       FLAG_N = 0x80u;
+
+/// @a p with N and Z evaluated from @a r
+inline Vec withNZ(Vec p, Vec r) noexcept
+{
+    return (p & splat(~(FLAG_N | FLAG_Z) & 0xFFu)) | (r & splat(FLAG_N)) |
+           (eq(r, splat(0)) & splat(FLAG_Z));
+}
+
+/// Flag mask (0xFF or 0) to the flag bit @a f
+inline Vec flagBit(Vec m, c6502_byte_t f) noexcept
+{
+    return m & splat(f);
+}
+
+/// 0xFF where bit @a f of @a v is set
+inline Vec hasBit(Vec v, c6502_byte_t f) noexcept
+{
+    return eq(v & splat(f), splat(f));
+}
+
+// Vectorized subset of the instruction set
+enum class Op: c6502_byte_t
+{
+    SCALAR,
+    LDA, LDX, LDY, STA, STX, STY,
+    ADC, SBC, AND, ORA, EOR, CMP, CPX, CPY, BIT,
+    ASL, LSR, ROL, ROR,
+    INX, INY, DEX, DEY, TAX, TAY, TXA, TYA, TSX, TXS,
+    CLC, SEC, CLI, SEI, CLV, CLD, SED, NOP,
+    BRANCH, JMP
+};
+
+enum class Mode: c6502_byte_t
+{
+    IMPL, IMM, ZP, ZP_X, ZP_Y, ABS, ABS_X, ABS_Y, REL
+};
+
+struct OpInfo
+{
+    Op op;
+    Mode mode;
+    c6502_byte_t tacts,
+                 branchFlag,    // Status bit tested by a branch
+                 branchIfSet;
+    bool usePenalty;
+};
+
+using OpTable = std::array<OpInfo, 256>;
+
+bool readsMemory(const OpInfo &info) noexcept
+{
+    return info.mode != Mode::IMPL && info.mode != Mode::IMM && info.mode != Mode::REL &&
+           info.op != Op::STA && info.op != Op::STX && info.op != Op::STY && info.op != Op::JMP;
+}
+
+} // namespace
+
+// Timings come from the CPU6502 opcode table, so they can't drift apart
+static OpTable buildOpTable()
+{
+    OpTable t;
+    t.fill(OpInfo { Op::SCALAR, Mode::IMPL, 0, 0, 0, false });
+
+    auto bind = [&t](c6502_byte_t opcode, Op op, Mode mode) {
+        bool usePenalty;
+        const int tacts = VectorCPU::opTacts(opcode, usePenalty);
+        if (tacts <= 0)
+            return;
+        t[opcode] = OpInfo { op, mode, static_cast<c6502_byte_t>(tacts), 0, 0, usePenalty };
+    };
+
+    const struct
+    {
+        Op op;
+        c6502_byte_t imm, zp, zpi, abs, absX, absY;     // 0 if the mode does not exist
+        Mode zpIndex;
+    } groups[] = {
+        { Op::LDA, 0xA9, 0xA5, 0xB5, 0xAD, 0xBD, 0xB9, Mode::ZP_X },
+        { Op::LDX, 0xA2, 0xA6, 0xB6, 0xAE, 0x00, 0xBE, Mode::ZP_Y },
+        { Op::LDY, 0xA0, 0xA4, 0xB4, 0xAC, 0xBC, 0x00, Mode::ZP_X },
+        { Op::STA, 0x00, 0x85, 0x95, 0x8D, 0x9D, 0x99, Mode::ZP_X },
+        { Op::STX, 0x00, 0x86, 0x96, 0x8E, 0x00, 0x00, Mode::ZP_Y },
+        { Op::STY, 0x00, 0x84, 0x94, 0x8C, 0x00, 0x00, Mode::ZP_X },
+        { Op::ADC, 0x69, 0x65, 0x75, 0x6D, 0x7D, 0x79, Mode::ZP_X },
+        { Op::SBC, 0xE9, 0xE5, 0xF5, 0xED, 0xFD, 0xF9, Mode::ZP_X },
+        { Op::AND, 0x29, 0x25, 0x35, 0x2D, 0x3D, 0x39, Mode::ZP_X },
+        { Op::ORA, 0x09, 0x05, 0x15, 0x0D, 0x1D, 0x19, Mode::ZP_X },
+        { Op::EOR, 0x49, 0x45, 0x55, 0x4D, 0x5D, 0x59, Mode::ZP_X },
+        { Op::CMP, 0xC9, 0xC5, 0xD5, 0xCD, 0xDD, 0xD9, Mode::ZP_X },
+        { Op::CPX, 0xE0, 0xE4, 0x00, 0xEC, 0x00, 0x00, Mode::ZP_X },
+        { Op::CPY, 0xC0, 0xC4, 0x00, 0xCC, 0x00, 0x00, Mode::ZP_X },
+        { Op::BIT, 0x00, 0x24, 0x00, 0x2C, 0x00, 0x00, Mode::ZP_X }
+    };
+
+    for (const auto &g: groups)
+    {
+        if (g.imm)
+            bind(g.imm, g.op, Mode::IMM);
+        if (g.zp)
+            bind(g.zp, g.op, Mode::ZP);
+        if (g.zpi)
+            bind(g.zpi, g.op, g.zpIndex);
+        if (g.abs)
+            bind(g.abs, g.op, Mode::ABS);
+        if (g.absX)
+            bind(g.absX, g.op, Mode::ABS_X);
+        if (g.absY)
+            bind(g.absY, g.op, Mode::ABS_Y);
+    }
+
+    const struct
+    {
+        Op op;
+        c6502_byte_t opcode;
+    } implied[] = {
+        { Op::ASL, 0x0A }, { Op::LSR, 0x4A }, { Op::ROL, 0x2A }, { Op::ROR, 0x6A },
+        { Op::INX, 0xE8 }, { Op::INY, 0xC8 }, { Op::DEX, 0xCA }, { Op::DEY, 0x88 },
+        { Op::TAX, 0xAA }, { Op::TAY, 0xA8 }, { Op::TXA, 0x8A }, { Op::TYA, 0x98 },
+        { Op::TSX, 0xBA }, { Op::TXS, 0x9A },
+        { Op::CLC, 0x18 }, { Op::SEC, 0x38 }, { Op::CLI, 0x58 }, { Op::SEI, 0x78 },
+        { Op::CLV, 0xB8 }, { Op::CLD, 0xD8 }, { Op::SED, 0xF8 }, { Op::NOP, 0xEA }
+    };
+
+    for (const auto &i: implied)
+        bind(i.opcode, i.op, Mode::IMPL);
+
+    bind(0x4C, Op::JMP, Mode::ABS);
+
+    const struct
+    {
+        c6502_byte_t opcode, flag, ifSet;
+    } branches[] = {
+        { 0x10, FLAG_N, 0 }, { 0x30, FLAG_N, 1 }, { 0x50, FLAG_V, 0 }, { 0x70, FLAG_V, 1 },
+        { 0x90, FLAG_C, 0 }, { 0xB0, FLAG_C, 1 }, { 0xD0, FLAG_Z, 0 }, { 0xF0, FLAG_Z, 1 }
+    };
+
+    for (const auto &b: branches)
+    {
+        bind(b.opcode, Op::BRANCH, Mode::REL);
+        t[b.opcode].branchFlag = b.flag;
+        t[b.opcode].branchIfSet = b.ifSet;
+    }
+
+    return t;
+}
+
+int VectorCPU::opTacts(int opcode, bool &usePenalty) noexcept
+{
+    if (opcode >= CPU6502::OPCODE_COUNT)
+        return -1;
+
+    const auto &h = CPU6502::s_opHandlers[opcode];
+    usePenalty = std::get<2>(h);
+    return std::get<1>(h);
+}
+
+VectorCPU::VectorCPU(const std::vector<Machine*> &machines):
+    m_count(static_cast<int>(machines.size()))
+{
+    if (m_count < 1 || m_count > LANES)
+        throw Exception(Exception::IllegalArgument, "unsupported number of machines");
+
+    for (int i = 0; i < m_count; i++)
+    {
+        Machine *m = machines[i];
+        if (!m || !m->isReady())
+            throw Exception(Exception::IllegalArgument, "machine has no cartridge");
+        if (m->bus().getMode() != machines[0]->bus().getMode())
+            throw Exception(Exception::IllegalArgument, "machines differ in output mode");
+
+        m_pBus[i] = &m->bus();
+        m_pCPU[i] = &m->cpu();
+    }
+
+    // Unused lanes stay zero, they are computed but never written back
+    for (int i = 0; i < LANES; i++)
+        m_a[i] = m_x[i] = m_y[i] = m_s[i] = m_p[i] = m_op[i] = 0;
+}
+
+void VectorCPU::runFrame()
+{
+    const unsigned all = (1u << m_count) - 1u;
+    const int CPL = m_pBus[0]->lineCycles(),
+              NMI_LINES = m_pBus[0]->vblankLines();
+
+    loadLanes(all);
+
+    for (int i = 0; i < m_count; i++)
+    {
+        m_pBus[i]->m_nFrame++;
+        m_pBus[i]->getPPU()->startFrame();
+    }
+
+    // Visible scanlines
+    for (int line = 0; line < 240; line++)
+    {
+        for (int i = 0; i < m_count; i++)
+            m_pBus[i]->getPPU()->drawNextLine();
+        run(CPL, all);
+    }
+
+    unsigned nmi = 0;
+    for (int i = 0; i < m_count; i++)
+    {
+        PPU *ppu = m_pBus[i]->getPPU();
+        ppu->endFrame();
+        ppu->onBeginVblank();
+        if (ppu->isNMIEnabled())
+            nmi |= 1u << i;
+    }
+
+    // See Bus::runFrame() for NMI timing
+    if (nmi)
+    {
+        run(7, nmi);
+        storeLanes(nmi);
+        for (int i = 0; i < m_count; i++)
+            if (nmi & (1u << i))
+                m_pBus[i]->m_cpuCycles += m_pCPU[i]->NMI();
+        loadLanes(nmi);
+    }
+
+    for (int line = 0; line < NMI_LINES; line++)
+        run(CPL, all);
+
+    for (int i = 0; i < m_count; i++)
+        m_pBus[i]->getPPU()->onEndVblank();
+
+    storeLanes(all);
+}
+
+void VectorCPU::loadLanes(unsigned lanes) noexcept
+{
+    for (int i = 0; i < m_count; i++)
+    {
+        if (!(lanes & (1u << i)))
+            continue;
+        const auto &r = m_pCPU[i]->m_regs;
+        m_a[i] = r.a;
+        m_x[i] = r.x;
+        m_y[i] = r.y;
+        m_s[i] = r.s;
+        m_p[i] = r.p;
+        m_pc[i] = r.pc;
+    }
+}
+
+void VectorCPU::storeLanes(unsigned lanes) noexcept
+{
+    for (int i = 0; i < m_count; i++)
+    {
+        if (!(lanes & (1u << i)))
+            continue;
+        auto &r = m_pCPU[i]->m_regs;
+        r.a = m_a[i];
+        r.x = m_x[i];
+        r.y = m_y[i];
+        r.s = m_s[i];
+        r.p = m_p[i];
+        r.pc = m_pc[i];
+    }
+}
+
+void VectorCPU::run(int clk, unsigned lanes)
+{
+    assert(clk > 0);
+
+    unsigned active = 0;
+    for (int i = 0; i < m_count; i++)
+    {
+        m_clk[i] = clk;
+        m_spent[i] = 0;
+        if ((lanes & (1u << i)) && m_pCPU[i]->m_state == CPU6502::STATE_RUN)
+            active |= 1u << i;
+    }
+
+    while (active)
+    {
+        // Lane furthest behind leads, the others catch up and join it
+        int leader = -1;
+        for (int i = 0; i < m_count; i++)
+            if ((active & (1u << i)) && (leader < 0 || m_spent[i] < m_spent[leader]))
+                leader = i;
+
+        active &= ~stepGroup(leader, active);
+    }
+
+    for (int i = 0; i < m_count; i++)
+        if (lanes & (1u << i))
+            m_pBus[i]->m_cpuCycles += m_spent[i];
+}
+
+unsigned VectorCPU::stepGroup(int leader, unsigned active)
+{
+    static const OpTable s_opTable = buildOpTable();
+
+    const c6502_word_t pc = m_pc[leader];
+    const c6502_byte_t opcode = m_pBus[leader]->readMem(pc);
+    const OpInfo &info = s_opTable[opcode];
+
+    if (info.op == Op::SCALAR)
+        return stepScalar(leader) ? 0u : 1u << leader;
+
+    // Lanes at the leader's PC with the same opcode and enough clocks left
+    unsigned group = 0,
+             finished = 0;
+    const int need = info.tacts + (info.usePenalty ? 2 : 0);
+    for (int i = 0; i < m_count; i++)
+    {
+        if (!(active & (1u << i)) || m_pc[i] != pc)
+            continue;
+        if (i != leader && m_pBus[i]->readMem(pc) != opcode)
+            continue;
+        if (need > m_clk[i])
+            finished |= 1u << i;
+        else
+            group |= 1u << i;
+    }
+
+    if (!group)
+        return finished;
+
+    // Gather: addressing, memory accesses, branches and clocks, one lane at a time
+    int nLanes = 0;
+    for (int i = 0; i < m_count; i++)
+    {
+        if (!(group & (1u << i)))
+            continue;
+        nLanes++;
+
+        Bus &bus = *m_pBus[i];
+        c6502_word_t next = pc + 1;
+        c6502_word_t ea = 0;
+        int penalty = 0;
+
+        switch (info.mode)
+        {
+            case Mode::IMPL:
+                break;
+            case Mode::IMM:
+            case Mode::REL:
+                m_op[i] = bus.readMem(next++);
+                break;
+            case Mode::ZP:
+                ea = bus.readMem(next++);
+                break;
+            case Mode::ZP_X:
+                ea = (bus.readMem(next++) + m_x[i]) & 0xFFu;
+                break;
+            case Mode::ZP_Y:
+                ea = (bus.readMem(next++) + m_y[i]) & 0xFFu;
+                break;
+            case Mode::ABS:
+            case Mode::ABS_X:
+            case Mode::ABS_Y:
+            {
+                const c6502_word_t al = bus.readMem(next++),
+                                   ah = bus.readMem(next++);
+                const c6502_byte_t index = info.mode == Mode::ABS_X ? m_x[i] :
+                                           info.mode == Mode::ABS_Y ? m_y[i] : 0;
+                penalty = al + index > 0xFFu ? 1 : 0;
+                ea = static_cast<c6502_word_t>((al | (ah << 8)) + index);
+                break;
+            }
+        }
+
+        switch (info.op)
+        {
+            case Op::STA:
+                bus.writeMem(ea, m_a[i]);
+                break;
+            case Op::STX:
+                bus.writeMem(ea, m_x[i]);
+                break;
+            case Op::STY:
+                bus.writeMem(ea, m_y[i]);
+                break;
+            case Op::JMP:
+                next = ea;
+                break;
+            case Op::BRANCH:
+                penalty = 0;
+                if (((m_p[i] & info.branchFlag) != 0) == (info.branchIfSet != 0))
+                {
+                    const c6502_byte_t oldPC_h = hi_byte(next - 1);
+                    next = static_cast<c6502_word_t>(next + static_cast<int8_t>(m_op[i]));
+                    penalty = oldPC_h != hi_byte(next) ? 2 : 1;
+                }
+                break;
+            default:
+                if (readsMemory(info))
+                    m_op[i] = bus.readMem(ea);
+        }
+
+        m_pc[i] = next;
+        const int rt = info.tacts + (info.usePenalty ? penalty : 0);
+        m_clk[i] -= rt;
+        m_spent[i] += rt;
+    }
+
+    m_stats.groupSteps++;
+    m_stats.vectorInstr += nLanes;
+
+    // Execute: registers and flags of all lanes at once, written back to the group only
+    alignas(16) c6502_byte_t groupMask[LANES];
+    for (int i = 0; i < LANES; i++)
+        groupMask[i] = (group & (1u << i)) ? 0xFFu : 0u;
+
+    const Vec m = load(groupMask),
+              a = load(m_a),
+              x = load(m_x),
+              y = load(m_y),
+              p = load(m_p),
+              op = load(m_op),
+              one = splat(1);
+
+    auto setA = [this, &m, &a](Vec v) { store(m_a, select(m, v, a)); };
+    auto setX = [this, &m, &x](Vec v) { store(m_x, select(m, v, x)); };
+    auto setY = [this, &m, &y](Vec v) { store(m_y, select(m, v, y)); };
+    auto setP = [this, &m, &p](Vec v) { store(m_p, select(m, v, p)); };
+    auto clearFlag = [&p](c6502_byte_t f) { return p & splat(~f & 0xFFu); };
+
+    // Addition with carry in; SBC is the same with the operand inverted
+    auto addWithCarry = [&](Vec operand) {
+        const Vec c = p & one,
+                  t = add(operand, c),
+                  r = add(a, t),
+                  carry = ~eq(addSat(operand, c), t) | ~eq(addSat(a, t), r),
+                  v = shr1(~(a ^ operand) & (a ^ r) & splat(FLAG_N));
+        setA(r);
+        setP(withNZ((p & splat(~(FLAG_C | FLAG_V) & 0xFFu)) | flagBit(carry, FLAG_C) | v, r));
+    };
+
+    // C set when no borrow
+    auto compare = [&](Vec reg) {
+        const Vec r = sub(reg, op);
+        setP(withNZ(clearFlag(FLAG_C) | flagBit(eq(max(reg, op), reg), FLAG_C), r));
+    };
+
+    switch (info.op)
+    {
+        case Op::LDA:
+            setA(op);
+            setP(withNZ(p, op));
+            break;
+        case Op::LDX:
+            setX(op);
+            setP(withNZ(p, op));
+            break;
+        case Op::LDY:
+            setY(op);
+            setP(withNZ(p, op));
+            break;
+        case Op::ADC:
+            addWithCarry(op);
+            break;
+        case Op::SBC:
+            addWithCarry(~op);
+            break;
+        case Op::AND:
+            setA(a & op);
+            setP(withNZ(p, a & op));
+            break;
+        case Op::ORA:
+            setA(a | op);
+            setP(withNZ(p, a | op));
+            break;
+        case Op::EOR:
+            setA(a ^ op);
+            setP(withNZ(p, a ^ op));
+            break;
+        case Op::CMP:
+            compare(a);
+            break;
+        case Op::CPX:
+            compare(x);
+            break;
+        case Op::CPY:
+            compare(y);
+            break;
+        case Op::BIT:
+        {
+            const Vec keep = p & splat(~(FLAG_N | FLAG_V | FLAG_Z) & 0xFFu);
+            setP(keep | (op & splat(FLAG_N | FLAG_V)) | flagBit(eq(a & op, splat(0)), FLAG_Z));
+            break;
+        }
+        case Op::ASL:
+        {
+            const Vec r = shl1(a);
+            setA(r);
+            setP(withNZ(clearFlag(FLAG_C) | flagBit(hasBit(a, FLAG_N), FLAG_C), r));
+            break;
+        }
+        case Op::LSR:
+        {
+            const Vec r = shr1(a);
+            setA(r);
+            setP(withNZ(clearFlag(FLAG_C) | (a & one), r));
+            break;
+        }
+        case Op::ROL:
+        {
+            const Vec r = shl1(a) | (p & one);
+            setA(r);
+            setP(withNZ(clearFlag(FLAG_C) | flagBit(hasBit(a, FLAG_N), FLAG_C), r));
+            break;
+        }
+        case Op::ROR:
+        {
+            const Vec r = shr1(a) | flagBit(hasBit(p, FLAG_C), FLAG_N);
+            setA(r);
+            setP(withNZ(clearFlag(FLAG_C) | (a & one), r));
+            break;
+        }
+        case Op::INX:
+            setX(add(x, one));
+            setP(withNZ(p, add(x, one)));
+            break;
+        case Op::INY:
+            setY(add(y, one));
+            setP(withNZ(p, add(y, one)));
+            break;
+        case Op::DEX:
+            setX(sub(x, one));
+            setP(withNZ(p, sub(x, one)));
+            break;
+        case Op::DEY:
+            setY(sub(y, one));
+            setP(withNZ(p, sub(y, one)));
+            break;
+        case Op::TAX:
+            setX(a);
+            setP(withNZ(p, a));
+            break;
+        case Op::TAY:
+            setY(a);
+            setP(withNZ(p, a));
+            break;
+        case Op::TXA:
+            setA(x);
+            setP(withNZ(p, x));
+            break;
+        case Op::TYA:
+            setA(y);
+            setP(withNZ(p, y));
+            break;
+        case Op::TSX:
+        {
+            const Vec s = load(m_s);
+            setX(s);
+            setP(withNZ(p, s));
+            break;
+        }
+        case Op::TXS:
+            store(m_s, select(m, x, load(m_s)));
+            break;
+        case Op::CLC:
+            setP(clearFlag(FLAG_C));
+            break;
+        case Op::SEC:
+            setP(p | splat(FLAG_C));
+            break;
+        case Op::CLI:
+            setP(clearFlag(FLAG_I));
+            break;
+        case Op::SEI:
+            setP(p | splat(FLAG_I));
+            break;
+        case Op::CLV:
+            setP(clearFlag(FLAG_V));
+            break;
+        case Op::CLD:
+            setP(clearFlag(FLAG_D));
+            break;
+        case Op::SED:
+            setP(p | splat(FLAG_D));
+            break;
+        default:
+            // Stores, jumps and branches are complete after the gather
+            break;
+    }
+
+    return finished;
+}
+
+bool VectorCPU::stepScalar(int lane)
+{
+    CPU6502 &cpu = *m_pCPU[lane];
+    auto &r = cpu.m_regs;
+    r.a = m_a[lane];
+    r.x = m_x[lane];
+    r.y = m_y[lane];
+    r.s = m_s[lane];
+    r.p = m_p[lane];
+    r.pc = m_pc[lane];
+
+    const int rt = cpu.step(m_clk[lane]);
+
+    m_a[lane] = r.a;
+    m_x[lane] = r.x;
+    m_y[lane] = r.y;
+    m_s[lane] = r.s;
+    m_p[lane] = r.p;
+    m_pc[lane] = r.pc;
+
+    if (rt == 0)
+        return false;
+
+    m_clk[lane] -= rt;
+    m_spent[lane] += rt;
+    m_stats.scalarInstr++;
+    return true;
+}
@@ -0,0 +1,264 @@
+#include "videodump.h"
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+constexpr int VideoDumper::DEFAULT_MAX_QUEUED;
+constexpr size_t VideoDumper::FRAME_SIZE;
+
+namespace
+{
+
+constexpr int W = FrameBufferBackend::WIDTH,
+              H = FrameBufferBackend::HEIGHT;
+
+static_assert(VideoDumper::FRAME_SIZE == W * H * 3 / 2, "frame size doesn't match the picture");
+
+// Tables indexed by two horizontally adjacent pixels, left | right << 6:
+// their Y values, and the sums of their U and V values. A 2x2 block of the
+// picture takes two lookups for Y and two for U and V together.
+struct PairTables
+{
+    uint16_t y[64 * 64];        // Left Y in the low byte, as stored
+    uint32_t uv[64 * 64];       // U sum in the low half, V sum in the high half
+};
+
+const PairTables &pairTables() noexcept
+{
+    static const PairTables *s_pTables = [] {
+        // BT.601 limited range
+        const uint16_t *palette = FrameBufferBackend::palette();
+        int y[64], u[64], v[64];
+        for (int i = 0; i < 64; i++)
+        {
+            const int c = palette[i],
+                      r = ((c >> 10) & 0x1F) * 255 / 31,
+                      g = ((c >> 5) & 0x1F) * 255 / 31,
+                      b = (c & 0x1F) * 255 / 31;
+            y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+            u[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            v[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        }
+
+        PairTables *t = new PairTables;
+        for (int l = 0; l < 64; l++)
+            for (int r = 0; r < 64; r++)
+            {
+                t->y[l | r << 6] = static_cast<uint16_t>(y[l] | y[r] << 8);
+                t->uv[l | r << 6] = static_cast<uint32_t>(u[l] + u[r]) | static_cast<uint32_t>(v[l] + v[r]) << 16;
+            }
+        return t;
+    }();
+
+    return *s_pTables;
+}
+
+inline unsigned pairIndex(const c6502_byte_t *p) noexcept
+{
+    return (p[0] & 0x3Fu) | (p[1] & 0x3Fu) << 6;
+}
+
+}
+
+void VideoDumper::toYUV420(const c6502_byte_t *pixels, c6502_byte_t *yuv) noexcept
+{
+    const PairTables &t = pairTables();
+    c6502_byte_t *pY = yuv,
+                 *pU = yuv + W * H,
+                 *pV = pU + W * H / 4;
+
+    for (int y = 0; y < H; y += 2)
+    {
+        const c6502_byte_t *src0 = pixels + y * W,
+                           *src1 = src0 + W;
+        c6502_byte_t *dstY0 = pY + y * W,
+                     *dstY1 = dstY0 + W,
+                     *dstU = pU + y / 2 * (W / 2),
+                     *dstV = pV + y / 2 * (W / 2);
+        for (int x = 0; x < W; x += 2)
+        {
+            const unsigned i0 = pairIndex(src0 + x),
+                           i1 = pairIndex(src1 + x);
+            memcpy(dstY0 + x, &t.y[i0], 2);
+            memcpy(dstY1 + x, &t.y[i1], 2);
+
+            // Both sums of the block in one addition, they don't overflow 16 bits
+            const uint32_t uv = t.uv[i0] + t.uv[i1] + (2u | 2u << 16);
+            dstU[x / 2] = static_cast<c6502_byte_t>((uv & 0xFFFFu) >> 2);
+            dstV[x / 2] = static_cast<c6502_byte_t>(uv >> 18);
+        }
+    }
+}
+
+void VideoDumper::frameRate(OutputMode mode, uint32_t &num, uint32_t &den) noexcept
+{
+    // 60.0988 Hz (NTSC), 50.0070 Hz (PAL)
+    if (mode == OutputMode::PAL)
+    {
+        num = 50007;
+        den = 1000;
+    }
+    else
+    {
+        num = 39375000;
+        den = 655171;
+    }
+}
+
+std::string VideoDumper::streamHeader(OutputMode mode)
+{
+    uint32_t num, den;
+    frameRate(mode, num, den);
+
+    char header[64];
+    snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%u:%u Ip A1:1 C420jpeg\n", W, H, num, den);
+    return header;
+}
+
+VideoDumper::VideoDumper(const std::string &file, OutputMode mode, int maxQueued):
+    m_maxQueued(maxQueued),
+    m_pictures((maxQueued + 1) * W * H)
+{
+    assert(maxQueued > 0);
+
+    // The standard output is duplicated, so the caller may redirect it afterwards
+    m_fd = file == "-" ? dup(STDOUT_FILENO) : open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+        throw Exception(Exception::IOFailure, strerror(errno));
+
+    const std::string header = streamHeader(mode);
+    std::string error;
+    if (!writeAll(header.data(), header.size(), error))
+    {
+        close(m_fd);
+        throw Exception(Exception::IOFailure, error.c_str());
+    }
+
+    m_worker = std::thread(&VideoDumper::workerLoop, this);
+}
+
+VideoDumper::~VideoDumper()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+
+    close(m_fd);
+}
+
+bool VideoDumper::push(const c6502_byte_t *pixels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_stats.failed || static_cast<int>(m_count) >= m_maxQueued)
+    {
+        m_stats.dropped++;
+        return false;
+    }
+
+    // Never the slot being written: that one precedes m_head
+    memcpy(slot(m_head + m_count), pixels, W * H);
+    m_count++;
+    m_cv.notify_all();
+    return true;
+}
+
+c6502_byte_t *VideoDumper::slot(size_t i) noexcept
+{
+    return m_pictures.data() + i % (m_maxQueued + 1) * (W * H);
+}
+
+void VideoDumper::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_count == 0 && !m_busy; });
+}
+
+VideoDumper::Stats VideoDumper::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string VideoDumper::lastError() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastError;
+}
+
+void VideoDumper::workerLoop()
+{
+    static const char FRAME_HEADER[] = "FRAME\n";
+    std::vector<c6502_byte_t> yuv(sizeof(FRAME_HEADER) - 1 + FRAME_SIZE);
+    memcpy(yuv.data(), FRAME_HEADER, sizeof(FRAME_HEADER) - 1);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_cv.wait(lock, [this] { return m_count > 0 || m_stop; });
+        if (m_count == 0)
+            break;
+
+        // Out of the queue, but push() leaves the slot alone until the next one is taken
+        const c6502_byte_t *pixels = slot(m_head);
+        m_head = (m_head + 1) % (m_maxQueued + 1);
+        m_count--;
+        m_busy = true;
+        lock.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+        toYUV420(pixels, yuv.data() + sizeof(FRAME_HEADER) - 1);
+        std::string error;
+        const bool ok = writeAll(yuv.data(), yuv.size(), error);
+        const double ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        if (ok)
+        {
+            m_stats.written++;
+        }
+        else
+        {
+            // A broken stream can't be resumed: later frames are dropped
+            m_stats.failed = true;
+            m_stats.dropped += m_count + 1;
+            m_head = (m_head + m_count) % (m_maxQueued + 1);
+            m_count = 0;
+            m_lastError.swap(error);
+        }
+        m_stats.lastWriteMs = ms;
+        m_stats.maxWriteMs = std::max(m_stats.maxWriteMs, ms);
+
+        m_busy = false;
+        m_cv.notify_all();
+    }
+}
+
+bool VideoDumper::writeAll(const void *p, size_t size, std::string &error) noexcept
+{
+    const char *c = static_cast<const char*>(p);
+    while (size > 0)
+    {
+        const ssize_t n = write(m_fd, c, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            error = strerror(errno);
+            return false;
+        }
+        c += n;
+        size -= n;
+    }
+    return true;
+}
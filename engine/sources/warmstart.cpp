@@ -0,0 +1,101 @@
+#include "warmstart.h"
+#include "machine.h"
+#include "movie.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <exception>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+WarmStartCache::WarmStartCache(const std::string &dir):
+    m_dir(dir)
+{
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        throw Exception(Exception::IOFailure, "warm-start cache directory does not exist");
+}
+
+std::string WarmStartCache::path(c6502_d_word_t romHash, int frames, uint64_t prefixHash) const
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%08x-%d-%016" PRIx64 ".b1sz", romHash, frames, prefixHash);
+    return m_dir + "/" + name;
+}
+
+int WarmStartCache::restore(Machine &m, const Movie &movie, int maxFrames)
+{
+    // States stored by this process may still be queued
+    m_writer.flush();
+
+    // Candidates of this ROM, scanned every time: other jobs add states
+    std::vector<std::pair<int, uint64_t>> candidates;
+    if (DIR *dir = opendir(m_dir.c_str()))
+    {
+        const int limit = std::min(maxFrames, movie.length());
+        while (const dirent *e = readdir(dir))
+        {
+            unsigned rom;
+            int frames, len = 0;
+            uint64_t hash;
+            if (sscanf(e->d_name, "%8x-%d-%16" SCNx64 ".b1sz%n", &rom, &frames, &hash, &len) == 3 &&
+                len > 0 && e->d_name[len] == '\0' &&
+                rom == movie.romHash() && frames > 0 && frames <= limit)
+                candidates.emplace_back(frames, hash);
+        }
+        closedir(dir);
+    }
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<int, uint64_t> &a, const std::pair<int, uint64_t> &b) {
+                  return a.first > b.first;
+              });
+
+    std::vector<c6502_byte_t> state;
+    for (const auto &c: candidates)
+    {
+        if (movie.prefixHash(c.first) != c.second)
+            continue;
+
+        // Unreadable files (e.g. from another engine version, or damaged)
+        // are skipped
+        try
+        {
+            SaveStateWriter::readFile(path(movie.romHash(), c.first, c.second).c_str(), state);
+            if (state.size() != m.bus().stateSize())
+                continue;
+            m.bus().loadState(state.data(), static_cast<c6502_d_word_t>(state.size()));
+        }
+        catch (const Exception&)
+        {
+            continue;
+        }
+        catch (const std::exception&)
+        {
+            continue;
+        }
+
+        m_stats.hits++;
+        m_stats.framesSkipped += c.first;
+        return c.first;
+    }
+
+    m_stats.misses++;
+    return 0;
+}
+
+void WarmStartCache::store(const Machine &m, const Movie &movie, int frames)
+{
+    assert(frames > 0 && frames <= movie.length());
+
+    const std::string file = path(movie.romHash(), frames, movie.prefixHash(frames));
+    struct stat st;
+    if (stat(file.c_str(), &st) == 0)
+        return;
+
+    if (m_writer.save(m.bus(), file))
+        m_stats.stored++;
+}